@@ -0,0 +1,207 @@
+#include <FFIAlignedMemory.hxx>
+
+#include <FFITypes.hxx>
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// Size of a transparent huge page on x86-64 and most 64 bit ARM kernels
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+//------------------------------------------------------------------------------
+
+/// Writes to one byte of each page, so that all pages are backed by memory
+static void touchPages(char *buffer, size_t size, size_t pageSize)
+{
+  volatile char *bytes = buffer;
+  for (size_t offset = 0; offset < size; offset += pageSize)
+  {
+    bytes[offset] = 0;
+  }
+}
+
+/// Returns the size rounded up to whole pages
+static size_t roundToPages(size_t size, size_t pageSize)
+{
+  return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIAlignedMemory::getPageSize()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return pageSize;
+#endif
+}
+
+size_t FFIAlignedMemory::getHugePageSize()
+{
+  return HUGE_PAGE_SIZE;
+}
+
+//------------------------------------------------------------------------------
+
+void *FFIAlignedMemory::allocate(size_t size, size_t alignment, unsigned int flags, Backing &backing)
+{
+  if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
+  {
+    return 0;
+  }
+
+  if (alignment < sizeof(void *))
+  {
+    alignment = sizeof(void *);
+  }
+
+  // a locked buffer covers whole pages, because the locks of a page are not
+  // counted. unlocking a buffer would otherwise unlock its neighbours too.
+  size_t allocSize = size;
+  if (flags & CTRLFFI_ALLOC_LOCK)
+  {
+    if (alignment < getPageSize())
+    {
+      alignment = getPageSize();
+    }
+
+    allocSize = roundToPages(size, getPageSize());
+  }
+
+  backing = Backing();
+  backing.size = size;
+  backing.flags = flags;
+
+  char *buffer = 0;
+
+#ifdef _WIN32
+  // huge pages need a privilege on Windows, so they are not used
+  buffer = static_cast<char *>(_aligned_malloc(allocSize, alignment));
+  if (! buffer)
+  {
+    return 0;
+  }
+
+  memset(buffer, 0, allocSize);
+  backing.alignment = alignment;
+
+  if (flags & CTRLFFI_ALLOC_LOCK)
+  {
+    backing.locked = (VirtualLock(buffer, allocSize) != 0);
+  }
+#else
+  if (flags & CTRLFFI_ALLOC_HUGE_PAGES)
+  {
+    // a mapping of its own, aligned to the huge page size, so that the
+    // kernel can back it with huge pages from the start
+    if (alignment < HUGE_PAGE_SIZE)
+    {
+      alignment = HUGE_PAGE_SIZE;
+    }
+
+    size_t mappedSize = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    size_t reservedSize = mappedSize + alignment;
+
+    void *reserved = mmap(0, reservedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+      return 0;
+    }
+
+    // unmap the parts before and after the aligned range
+    uintptr_t start = reinterpret_cast<uintptr_t>(reserved);
+    uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t) (alignment - 1);
+
+    if (aligned > start)
+    {
+      munmap(reserved, aligned - start);
+    }
+
+    size_t tail = start + reservedSize - (aligned + mappedSize);
+    if (tail > 0)
+    {
+      munmap(reinterpret_cast<void *>(aligned + mappedSize), tail);
+    }
+
+    buffer = reinterpret_cast<char *>(aligned);
+    backing.mappedSize = mappedSize;
+
+#ifdef MADV_HUGEPAGE
+    backing.hugePages = (madvise(buffer, mappedSize, MADV_HUGEPAGE) == 0);
+#endif
+
+    // anonymous mappings are zeroed by the kernel. the pages are only
+    // touched after the advice, otherwise they would be small pages.
+    if (flags & CTRLFFI_ALLOC_PREFAULT)
+    {
+      touchPages(buffer, mappedSize, getPageSize());
+    }
+  }
+  else
+  {
+    void *memory = 0;
+    if (posix_memalign(&memory, alignment, allocSize) != 0)
+    {
+      return 0;
+    }
+
+    // zeroing the buffer also touches all of its pages
+    buffer = static_cast<char *>(memory);
+    memset(buffer, 0, allocSize);
+  }
+
+  backing.alignment = alignment;
+
+  if (flags & CTRLFFI_ALLOC_LOCK)
+  {
+    backing.locked = (mlock(buffer, backing.mappedSize ? backing.mappedSize : allocSize) == 0);
+  }
+#endif
+
+  return buffer;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIAlignedMemory::release(void *buffer, const Backing &backing)
+{
+  if (! buffer)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  if (backing.locked)
+  {
+    VirtualUnlock(buffer, roundToPages(backing.size, getPageSize()));
+  }
+
+  _aligned_free(buffer);
+#else
+  if (backing.mappedSize)
+  {
+    // unmapping also unlocks the pages
+    munmap(buffer, backing.mappedSize);
+    return;
+  }
+
+  if (backing.locked)
+  {
+    munlock(buffer, roundToPages(backing.size, getPageSize()));
+  }
+
+  free(buffer);
+#endif
+}
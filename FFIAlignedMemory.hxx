@@ -0,0 +1,66 @@
+#ifndef _FFIALIGNEDMEMORY_H_
+#define _FFIALIGNEDMEMORY_H_
+
+#include <cstddef>
+
+/// Flags for ffiAllocAlignedBuffer
+enum AllocFlags
+{
+  // back the buffer with transparent huge pages, to reduce TLB misses
+  CTRLFFI_ALLOC_HUGE_PAGES = 0x1,
+  // touch all pages of the buffer at the allocation, so that the first
+  // access does not cause page faults
+  CTRLFFI_ALLOC_PREFAULT = 0x2,
+  // lock the buffer into memory, so that it is never swapped out
+  CTRLFFI_ALLOC_LOCK = 0x4,
+
+  CTRLFFI_ALLOC_MASK = CTRLFFI_ALLOC_HUGE_PAGES | CTRLFFI_ALLOC_PREFAULT | CTRLFFI_ALLOC_LOCK
+};
+
+/**
+ * Allocates zeroed buffers with a given alignment.
+ *
+ * Buffers are allocated with posix_memalign(), unless huge pages are
+ * requested, which need a mapping of their own. Such buffers are not
+ * compatible with free(), so the Backing must be kept to release them.
+ * Locked buffers are aligned and sized to whole pages, so that they share
+ * no page with other allocations.
+ */
+class FFIAlignedMemory
+{
+public:
+  /// How a buffer was allocated
+  struct Backing
+  {
+    Backing() : size(0), alignment(0), flags(0), mappedSize(0), hugePages(false), locked(false) { }
+
+    /// Requested size in bytes
+    size_t size;
+    /// Alignment of the address in bytes
+    size_t alignment;
+    /// Requested AllocFlags
+    unsigned int flags;
+    /// Size of the mapping, or 0 if the buffer is on the heap
+    size_t mappedSize;
+    /// True if the kernel was advised to use huge pages for the buffer
+    bool hugePages;
+    /// True if the buffer is locked into memory
+    bool locked;
+  };
+
+  /// Allocates a zeroed buffer. The alignment must be a power of two, smaller
+  /// values than the size of a pointer are raised. Returns 0 on failure.
+  /// Huge pages and locking are optional, backing tells whether they were applied.
+  static void *allocate(size_t size, size_t alignment, unsigned int flags, Backing &backing);
+
+  /// Releases a buffer returned by allocate()
+  static void release(void *buffer, const Backing &backing);
+
+  /// Returns the size of a memory page
+  static size_t getPageSize();
+
+  /// Returns the size of a transparent huge page
+  static size_t getHugePageSize();
+};
+
+#endif // _FFIALIGNEDMEMORY_H_
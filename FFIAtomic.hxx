@@ -0,0 +1,63 @@
+#ifndef _FFIATOMIC_H_
+#define _FFIATOMIC_H_
+
+#include <cstddef>
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+/**
+ * Minimal set of atomic operations on size_t values, for data that is shared
+ * between the Ctrl thread and native threads.
+ *
+ * Loads have acquire semantics, stores have release semantics and the
+ * read-modify-write operations are full barriers.
+ */
+class FFIAtomic
+{
+public:
+#ifdef _WIN32
+  // on x64, MSVC gives volatile accesses acquire/release semantics
+  static size_t load(const volatile size_t *ptr) { return *ptr; }
+
+  static void store(volatile size_t *ptr, size_t value) { *ptr = value; }
+
+  static bool compareExchange(volatile size_t *ptr, size_t expected, size_t desired)
+  {
+    return _InterlockedCompareExchange64(reinterpret_cast<volatile __int64 *>(ptr),
+                                         (__int64) desired, (__int64) expected) == (__int64) expected;
+  }
+
+  static size_t fetchAdd(volatile size_t *ptr, size_t value)
+  {
+    return (size_t) _InterlockedExchangeAdd64(reinterpret_cast<volatile __int64 *>(ptr), (__int64) value);
+  }
+#else
+  static size_t load(const volatile size_t *ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+
+  static void store(volatile size_t *ptr, size_t value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+
+  static bool compareExchange(volatile size_t *ptr, size_t expected, size_t desired)
+  {
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  }
+
+  static size_t fetchAdd(volatile size_t *ptr, size_t value)
+  {
+    return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+  }
+#endif
+
+  /// Raises the value to at least the given value
+  static void storeMax(volatile size_t *ptr, size_t value)
+  {
+    size_t current = load(ptr);
+    while (current < value && ! compareExchange(ptr, current, value))
+    {
+      current = load(ptr);
+    }
+  }
+};
+
+#endif // _FFIATOMIC_H_
@@ -11,14 +11,29 @@
 #include <ULongVar.hxx>
 #include <FloatVar.hxx>
 #include <TextVar.hxx>
+#include <TimeVar.hxx>
 #include <MappingVar.hxx>
 #include <Resources.hxx>
-#include <SharedLib.hxx>
 
 #include <PVSSMacros.hxx>
 
+#include <FFIAlignedMemory.hxx>
+#include <FFIKernels.hxx>
+#include <FFIProbes.hxx>
+#include <FFIQueue.hxx>
+#include <FFIRecorder.hxx>
+#include <FFIRemoteHost.hxx>
+#include <FFISampler.hxx>
+#include <FFISharedMemory.hxx>
+#include <FFISink.hxx>
+#include <FFIStringArray.hxx>
+#include <FFITypeTraits.hxx>
+
+#include <algorithm>
 #include <memory>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
 
 
 /// Enum of the functions implemented in this Ctrl extension
@@ -26,24 +41,88 @@ enum
 {
   // basic interaction with functions
   F_fiiDeclareFunction = 0,
+  F_ffiDeclareFunctionPointer,
+  F_ffiGetSymbolAddress,
+  F_ffiUndeclareFunction,
   F_ffiCallFunction,
   F_ffiGetAllFunctions,
+  F_ffiSetOutputDeallocator,
   F_ffiGetTypeSize,
   F_ffiGetTypeName,
   // allocation
   F_ffiAllocBuffer,
+  F_ffiAllocAlignedBuffer,
   F_ffiFreeBuffer,
+  F_ffiGetBufferInfo,
+  F_ffiGetMemoryStats,
+  F_ffiSetMemoryTracking,
   // copy from raw memory to various structures
   F_ffiBufferToString,
   F_ffiBufferToStruct,
   F_ffiBufferToDyn,
+  F_ffiBufferToColumns,
+  F_ffiBufferToDynString,
+  F_ffiBufferToMatrix,
   // copy from various structures to raw memory
   F_ffiFillBufferWithString,
   F_ffiFillBufferWithStruct,
   F_ffiFillBufferWithDyn,
+  F_ffiFillBufferFromColumns,
+  F_ffiFillBufferWithDynString,
+  F_ffiFillBufferWithMatrix,
+  // search and checksums over raw memory
+  F_ffiBufferFind,
+  F_ffiBufferFindByte,
+  F_ffiBufferCrc32,
+  F_ffiBufferCrc32C,
+  F_ffiBufferCrc16Modbus,
+  F_ffiBufferHash,
+  F_ffiBufferReduce,
   // direct memory access
   F_ffiReadFromPointer,
-  F_ffiWriteToPointer
+  F_ffiWriteToPointer,
+  // shared memory
+  F_ffiSharedMemoryCreate,
+  F_ffiSharedMemoryOpen,
+  F_ffiSharedMemoryClose,
+  // native queues
+  F_ffiQueueCreate,
+  F_ffiQueueDestroy,
+  F_ffiQueueGetPushFunction,
+  F_ffiQueuePopBatch,
+  F_ffiQueueGetStats,
+  // isolation
+  F_ffiIsolateLibrary,
+  // periodic sampling
+  F_ffiStartSampler,
+  F_ffiReadSamples,
+  F_ffiStopSampler,
+  F_ffiGetSamplerStats,
+
+  F_ffiStartRecording,
+  F_ffiStopRecording,
+  F_ffiSetProfiling,
+
+  F_ffiCreateView,
+  F_ffiViewGet,
+  F_ffiViewSlice,
+  F_ffiViewFind,
+  F_ffiDestroyView,
+
+  F_ffiSnapshotCreate,
+  F_ffiSnapshotDiff,
+  F_ffiSnapshotDestroy,
+
+  F_ffiCreatePipeline,
+  F_ffiRunPipeline,
+  F_ffiDestroyPipeline,
+
+  F_ffiCreateSink,
+  F_ffiFlushSink,
+  F_ffiGetSinkStats,
+  F_ffiDestroySink,
+  F_ffiBufferToSink,
+  F_ffiSamplesToSink
 };
 
 static FunctionListRec fnList[] =
@@ -51,24 +130,88 @@ static FunctionListRec fnList[] =
 //  return type, function name, parameter list, thread safe
 //------------------------------------------------------------------------------
   { UINTEGER_VAR,   "ffiDeclareFunction",      "(string libPath, string name [, int returntype [, int paramtype1, ...] ] )", false },
+  { UINTEGER_VAR,   "ffiDeclareFunctionPointer", "(ulong fnPtr [, int returntype [, int paramtype1, ...] ] )", false },
+  { ULONG_VAR,      "ffiGetSymbolAddress",     "(string libPath, string name)", false },
+  { BIT_VAR,        "ffiUndeclareFunction",    "(uint funcId)", false },
   { BIT_VAR,        "ffiCallFunction",         "(uint funcId, anytype &returnvalue, anytype &paramvalue1, ...)", false },
   { DYNMAPPING_VAR, "ffiGetAllFunctions",      "", false },
+  { BIT_VAR,        "ffiSetOutputDeallocator", "(uint funcId, uint paramIndex [, uint deallocFuncId] )", false },
   { UINTEGER_VAR,   "ffiGetTypeSize",          "(int type)", false },
   { TEXT_VAR,       "ffiGetTypeName",          "(int type)", false },
 
-  { ULONG_VAR,      "ffiAllocBuffer",          "(ulong bytes, bool setzero = true)", false },
+  { ULONG_VAR,      "ffiAllocBuffer",          "(ulong bytes, bool setzero = true, string tag = \"\")", false },
+  { ULONG_VAR,      "ffiAllocAlignedBuffer",   "(ulong bytes, uint alignment, uint flags = 0, string tag = \"\")", false },
   { NO_VAR,         "ffiFreeBuffer",           "(ulong ptr)", false },
+  { MAPPING_VAR,    "ffiGetBufferInfo",        "(ulong ptr)", false },
+  { MAPPING_VAR,    "ffiGetMemoryStats",       "(uint oldestCount = 10)", false },
+  { NO_VAR,         "ffiSetMemoryTracking",    "(bool enable)", false },
 
   { TEXT_VAR,       "ffiBufferToString",       "(ulong ptr [, int strlen] )", false },
   { DYN_VAR,        "ffiBufferToStruct",       "(ulong ptr, dyn_int fieldtypes)", false },
   { DYN_VAR,        "ffiBufferToDyn",          "(ulong ptr, int itemtype, uint itemcount)", false },
+  { DYN_VAR,        "ffiBufferToColumns",      "(ulong ptr, dyn_int fieldtypes, uint count [, uint stride] )", false },
+  { DYN_VAR,        "ffiBufferToDynString",    "(ulong ptr [, int count] )", false },
+  { DYN_VAR,        "ffiBufferToMatrix",       "(ulong ptr, int itemtype, uint rows, uint cols [, bool colMajor [, uint leadingDim] ] )", false },
 
   { NO_VAR,         "ffiFillBufferWithString", "(ulong ptr, string text)", false },
   { NO_VAR,         "ffiFillBufferWithStruct", "(ulong ptr, dyn_int fieldtypes, dyn_anytype fieldvalues)", false },
   { NO_VAR,         "ffiFillBufferWithDyn",    "(ulong ptr, int itemtype, dyn_anytype itemvalues)", false },
-
-  { ANYTYPE_VAR,    "ffiReadFromPointer",      "(ulong ptr, int type)", false },
-  { NO_VAR,         "ffiWriteToPointer",       "(ulong ptr, int type, anytype value)", false }
+  { NO_VAR,         "ffiFillBufferFromColumns", "(ulong ptr, dyn_int fieldtypes, dyn_dyn_anytype columns [, uint stride] )", false },
+  { ULONG_VAR,      "ffiFillBufferWithDynString", "(dyn_string texts, string tag = \"\")", false },
+  { NO_VAR,         "ffiFillBufferWithMatrix", "(ulong ptr, int itemtype, dyn_dyn_anytype matrix [, bool colMajor [, uint leadingDim] ] )", false },
+
+  { LONG_VAR,       "ffiBufferFind",           "(ulong ptr, ulong len, anytype pattern)", false },
+  { LONG_VAR,       "ffiBufferFindByte",       "(ulong ptr, ulong len, uint value)", false },
+  { UINTEGER_VAR,   "ffiBufferCrc32",          "(ulong ptr, ulong len)", false },
+  { UINTEGER_VAR,   "ffiBufferCrc32C",         "(ulong ptr, ulong len)", false },
+  { UINTEGER_VAR,   "ffiBufferCrc16Modbus",    "(ulong ptr, ulong len)", false },
+  { ULONG_VAR,      "ffiBufferHash",           "(ulong ptr, ulong len, ulong seed = 0)", false },
+  { MAPPING_VAR,    "ffiBufferReduce",         "(ulong ptr, int itemtype, uint count, uint stride, uint ops [, float above [, float below] ] )", false },
+
+  { ANYTYPE_VAR,    "ffiReadFromPointer",      "(ulong ptr, int type [, anytype &target] )", false },
+  { NO_VAR,         "ffiWriteToPointer",       "(ulong ptr, int type, anytype value)", false },
+
+  { ULONG_VAR,      "ffiSharedMemoryCreate",   "(string name, ulong bytes)", false },
+  { ULONG_VAR,      "ffiSharedMemoryOpen",     "(string name)", false },
+  { NO_VAR,         "ffiSharedMemoryClose",    "(ulong ptr, bool unlink = false)", false },
+
+  { ULONG_VAR,      "ffiQueueCreate",          "(uint itemSize, uint capacity)", false },
+  { NO_VAR,         "ffiQueueDestroy",         "(ulong queue)", false },
+  { ULONG_VAR,      "ffiQueueGetPushFunction", "", false },
+  { DYN_VAR,        "ffiQueuePopBatch",        "(ulong queue, dyn_int fieldtypes, uint maxItems)", false },
+  { MAPPING_VAR,    "ffiQueueGetStats",        "(ulong queue)", false },
+
+  { BIT_VAR,        "ffiIsolateLibrary",       "(string libPath, string hostExecutable = \"CtrlFFIHost\", uint callTimeoutMs = 30000)", false },
+
+  { ULONG_VAR,      "ffiStartSampler",         "(uint funcId, uint intervalMs, anytype paramvalue1, ...)", false },
+  { MAPPING_VAR,    "ffiReadSamples",          "(ulong samplerId, ulong sinceIndex)", false },
+  { NO_VAR,         "ffiStopSampler",          "(ulong samplerId)", false },
+  { MAPPING_VAR,    "ffiGetSamplerStats",      "(ulong samplerId)", false },
+
+  { BIT_VAR,        "ffiStartRecording",       "(string path)", false },
+  { MAPPING_VAR,    "ffiStopRecording",        "", false },
+  { BIT_VAR,        "ffiSetProfiling",         "(bool perfMap, bool traceLocation = false)", false },
+
+  { ULONG_VAR,      "ffiCreateView",           "(ulong ptr, anytype itemtype, uint count [, uint stride] )", false },
+  { ANYTYPE_VAR,    "ffiViewGet",              "(ulong view, uint index [, uint field] )", false },
+  { ULONG_VAR,      "ffiViewSlice",            "(ulong view, uint first, uint count)", false },
+  { UINTEGER_VAR,   "ffiViewFind",             "(ulong view, uint field, anytype value [, uint start] )", false },
+  { NO_VAR,         "ffiDestroyView",          "(ulong view)", false },
+
+  { ULONG_VAR,      "ffiSnapshotCreate",       "(ulong ptr, uint bytes)", false },
+  { MAPPING_VAR,    "ffiSnapshotDiff",         "(ulong snapshot, ulong ptr, int itemtype [, float deadband [, ulong sink] ] )", false },
+  { NO_VAR,         "ffiSnapshotDestroy",      "(ulong snapshot)", false },
+
+  { ULONG_VAR,      "ffiCreatePipeline",       "(dyn_mapping steps)", false },
+  { BIT_VAR,        "ffiRunPipeline",          "(ulong pipeline, dyn_anytype inputs, dyn_dyn_anytype &outputs [, ulong sink] )", false },
+  { NO_VAR,         "ffiDestroyPipeline",      "(ulong pipeline)", false },
+
+  { ULONG_VAR,      "ffiCreateSink",           "(dyn_string dpes, bool inMemory = false)", false },
+  { BIT_VAR,        "ffiFlushSink",            "(ulong sink)", false },
+  { MAPPING_VAR,    "ffiGetSinkStats",         "(ulong sink)", false },
+  { NO_VAR,         "ffiDestroySink",          "(ulong sink)", false },
+  { BIT_VAR,        "ffiBufferToSink",         "(ulong ptr, int itemtype, uint itemcount, ulong sink)", false },
+  { ULONG_VAR,      "ffiSamplesToSink",        "(ulong samplerId, ulong sinceIndex, ulong sink)", false }
 };
 
 CTRL_EXTENSION(FFIExternHdl, fnList);
@@ -77,64 +220,168 @@ CTRL_EXTENSION(FFIExternHdl, fnList);
 // debug flag "-dbg CTRLFFI"
 PVSSshort FFIExternHdl::dbgFlag = -1;
 
-// an array to map from the enum IntegralType to an appropriate type name
-static const char * const TYPE_NAMES[CTRLFFI_MAX_VALUE] = {
-  0,                 // CTRLFFI_FIRST_VALUE_TYPE
-
-  "FFI_UCHAR",       // CTRLFFI_UCHAR
-  "FFI_CHAR",        // CTRLFFI_CHAR
-  "FFI_USHORT",      // CTRLFFI_USHORT
-  "FFI_SHORT",       // CTRLFFI_SHORT
-  "FFI_UINT",        // CTRLFFI_UINT
-  "FFI_INT",         // CTRLFFI_INT
-  "FFI_ULONG",       // CTRLFFI_ULONG
-  "FFI_LONG",        // CTRLFFI_LONG
-  "FFI_FLOAT",       // CTRLFFI_FLOAT
-  "FFI_DOUBLE",      // CTRLFFI_DOUBLE
-
-  "FFI_UINT8",       // CTRLFFI_UINT8
-  "FFI_INT8",        // CTRLFFI_INT8
-  "FFI_UINT16",      // CTRLFFI_UINT16
-  "FFI_INT16",       // CTRLFFI_INT16
-  "FFI_UINT32",      // CTRLFFI_UINT32
-  "FFI_INT32",       // CTRLFFI_INT32
-  "FFI_UINT64",      // CTRLFFI_UINT64
-  "FFI_INT64",       // CTRLFFI_INT64
-
-  0,                 // CTRLFFI_LAST_VALUE_TYPE
-  0,                 // CTRLFFI_FIRST_PTR
-
-  "FFI_UCHAR_PTR",   // CTRLFFI_UCHAR_PTR
-  "FFI_CHAR_PTR",    // CTRLFFI_CHAR_PTR
-  "FFI_USHORT_PTR",  // CTRLFFI_USHORT_PTR
-  "FFI_SHORT_PTR",   // CTRLFFI_SHORT_PTR
-  "FFI_UINT_PTR",    // CTRLFFI_UINT_PTR
-  "FFI_INT_PTR",     // CTRLFFI_INT_PTR
-  "FFI_ULONG_PTR",   // CTRLFFI_ULONG_PTR
-  "FFI_LONG_PTR",    // CTRLFFI_LONG_PTR
-  "FFI_FLOAT_PTR",   // CTRLFFI_FLOAT_PTR
-  "FFI_DOUBLE_PTR",  // CTRLFFI_DOUBLE_PTR
-
-  "FFI_UINT8_PTR",   // CTRLFFI_UINT8_PTR
-  "FFI_INT8_PTR",    // CTRLFFI_INT8_PTR
-  "FFI_UINT16_PTR",  // CTRLFFI_UINT16_PTR
-  "FFI_INT16_PTR",   // CTRLFFI_INT16_PTR
-  "FFI_UINT32_PTR",  // CTRLFFI_UINT32_PTR
-  "FFI_INT32_PTR",   // CTRLFFI_INT32_PTR
-  "FFI_UINT64_PTR",  // CTRLFFI_UINT64_PTR
-  "FFI_INT64_PTR",   // CTRLFFI_INT64_PTR
-
-  0,                 // CTRLFFI_LAST_PTR
-
-  "FFI_POINTER",     // CTRLFFI_POINTER
-  "FFI_VOID",        // CTRLFFI_VOID
-  "FFI_STRING",      // CTRLFFI_STRING
+// number of records in the ring buffer of a sampler
+static const size_t SAMPLER_CAPACITY = 4096;
+
+// a function id consists of the one-based slot index in the lower bits and
+// the generation of the slot in the upper bits. the first generation is zero,
+// so the ids of functions in fresh slots are just the one-based index.
+static const unsigned int FUNCTION_SLOT_BITS = 20;
+static const unsigned int FUNCTION_SLOT_MASK = (1u << FUNCTION_SLOT_BITS) - 1;
+
+// the last generation that fits into the upper bits. a slot that reaches it
+// is not reused any more, because its next generation would repeat old ids.
+static const unsigned int FUNCTION_LAST_GENERATION = (1u << (32 - FUNCTION_SLOT_BITS)) - 1;
+
+// flags that can be combined with the types, also added as global vars
+static const struct { const char *name; unsigned int value; } FLAG_NAMES[] = {
+  { "FFI_IN",    CTRLFFI_DIR_IN },
+  { "FFI_OUT",   CTRLFFI_DIR_OUT },
+  { "FFI_INOUT", CTRLFFI_DIR_INOUT },
+
+  { "FFI_BIG_ENDIAN",    CTRLFFI_BIG_ENDIAN },
+  { "FFI_LITTLE_ENDIAN", CTRLFFI_LITTLE_ENDIAN },
+
+  // flags of ffiAllocAlignedBuffer
+  { "FFI_ALLOC_HUGE_PAGES", CTRLFFI_ALLOC_HUGE_PAGES },
+  { "FFI_ALLOC_PREFAULT",   CTRLFFI_ALLOC_PREFAULT },
+  { "FFI_ALLOC_LOCK",       CTRLFFI_ALLOC_LOCK },
+
+  // aggregates of ffiBufferReduce
+  { "FFI_REDUCE_SUM",      CTRLFFI_REDUCE_SUM },
+  { "FFI_REDUCE_MIN",      CTRLFFI_REDUCE_MIN },
+  { "FFI_REDUCE_MAX",      CTRLFFI_REDUCE_MAX },
+  { "FFI_REDUCE_MEAN",     CTRLFFI_REDUCE_MEAN },
+  { "FFI_REDUCE_VARIANCE", CTRLFFI_REDUCE_VARIANCE },
+  { "FFI_REDUCE_ARGMIN",   CTRLFFI_REDUCE_ARGMIN },
+  { "FFI_REDUCE_ARGMAX",   CTRLFFI_REDUCE_ARGMAX },
+  { "FFI_REDUCE_ABOVE",    CTRLFFI_REDUCE_ABOVE },
+  { "FFI_REDUCE_BELOW",    CTRLFFI_REDUCE_BELOW },
+  { "FFI_REDUCE_ALL",      CTRLFFI_REDUCE_ALL }
 };
 
 //------------------------------------------------------------------------------
 
+/// Reads a value through a converter. If necessary, the byte order of the
+/// value is reversed in a temporary copy first.
+static void readValue(const FFIValue &converter, Variable &var, const char *buffer,
+                      size_t size, bool byteSwap)
+{
+  if (byteSwap && size <= sizeof(PVSSulonglong))
+  {
+    PVSSulonglong tmp;
+    FFIKernels::copySwapped(&tmp, buffer, size);
+    converter.readValueFromRawMemory(var, &tmp);
+  }
+  else
+  {
+    converter.readValueFromRawMemory(var, buffer);
+  }
+}
+
+/// Writes a value through a converter. If necessary, the byte order of the
+/// value is reversed after the conversion.
+static void writeValue(const FFIValue &converter, const Variable &var, char *buffer,
+                       size_t size, bool byteSwap)
+{
+  if (byteSwap && size <= sizeof(PVSSulonglong))
+  {
+    PVSSulonglong tmp;
+    converter.writeValueToRawMemory(var, &tmp);
+    FFIKernels::copySwapped(buffer, &tmp, size);
+  }
+  else
+  {
+    converter.writeValueToRawMemory(var, buffer);
+  }
+}
+
+/// Returns the one-based index of the first of count items whose value of
+/// type T at the start of the item equals value, or 0 if there is none
+template <typename T>
+static unsigned int findValue(const char *item, size_t count, size_t stride, const void *value)
+{
+  T needle;
+  memcpy(&needle, value, sizeof(T));
+
+  for (size_t i = 0; i < count; ++i, item += stride)
+  {
+    T current;
+    memcpy(&current, item, sizeof(T));
+    if (current == needle)
+    {
+      return (unsigned int) (i + 1);
+    }
+  }
+
+  return 0;
+}
+
+/// Returns the value stored in an anytype, or the variable itself for other types
+static const Variable *getAnyValue(const Variable *var)
+{
+  if (var && var->isA() == ANYTYPE_VAR)
+  {
+    return static_cast<const AnyTypeVar *>(var)->getVar();
+  }
+
+  return var;
+}
+
+/// Returns the value of a FLOAT or DOUBLE item, in host byte order
+static double readReal(int baseType, const char *item, bool byteSwap)
+{
+  char bytes[sizeof(double)];
+  size_t size = (baseType == CTRLFFI_FLOAT) ? sizeof(float) : sizeof(double);
+
+  if (byteSwap)
+  {
+    FFIKernels::copySwapped(bytes, item, size);
+  }
+  else
+  {
+    memcpy(bytes, item, size);
+  }
+
+  if (baseType == CTRLFFI_FLOAT)
+  {
+    float value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+  }
+
+  double value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+/// Evaluates the first two arguments of a function as a buffer address and
+/// its length. Returns 0 if they are missing or the address is null.
+static const char *getBufferArgs(ExecuteParamRec &param, size_t &size)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  ULongVar paramLen;
+  paramLen = *(param.args->getNext()->evaluate(param.thread));
+
+  size = static_cast<size_t>(paramLen.getValue());
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  return reinterpret_cast<const char *>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
 FFIExternHdl::FFIExternHdl(BaseExternHdl *nextHdl, PVSSulong funcCount, FunctionListRec fnList[])
-  : BaseExternHdl(nextHdl, funcCount, fnList)
+  : BaseExternHdl(nextHdl, funcCount, fnList),
+    recorder(0),
+    traceLocations(false)
 {
   if (dbgFlag == -1)
   {
@@ -145,9 +392,9 @@ FFIExternHdl::FFIExternHdl(BaseExternHdl *nextHdl, PVSSulong funcCount, Function
   // issues, but it seems a lot better than changing the Ctrl interpreter code
   // because of a Ctrl extension.
 
-  for (unsigned int i = 0; i < (sizeof(TYPE_NAMES) / sizeof(*TYPE_NAMES)); ++i)
+  for (int i = 0; i < CTRLFFI_MAX_VALUE; ++i)
   {
-    const char *typeName = TYPE_NAMES[i];
+    const char *typeName = FFITypeTraits::get(i).name;
     if (typeName != 0)
     {
       CtrlVar *typeVar = new CtrlVar(new UIntegerVar(i));
@@ -155,12 +402,97 @@ FFIExternHdl::FFIExternHdl(BaseExternHdl *nextHdl, PVSSulong funcCount, Function
       Controller::thisPtr->addGlobal(typeVar);
     }
   }
+
+  for (unsigned int i = 0; i < (sizeof(FLAG_NAMES) / sizeof(*FLAG_NAMES)); ++i)
+  {
+    CtrlVar *flagVar = new CtrlVar(new UIntegerVar(FLAG_NAMES[i].value));
+    flagVar->setName(FLAG_NAMES[i].name);
+    Controller::thisPtr->addGlobal(flagVar);
+  }
 }
 
 //------------------------------------------------------------------------------
 
 FFIExternHdl::~FFIExternHdl()
 {
+  // the samplers use the function declarations, so stop them first
+  for (std::vector<SamplerEntry *>::iterator it = samplers.begin(); it != samplers.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<FunctionSlot>::iterator it = functions.begin(); it != functions.end(); ++it)
+  {
+    delete it->function;
+  }
+
+  for (std::vector<FFISharedMemory *>::iterator it = sharedMemories.begin();
+       it != sharedMemories.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<FFIQueue *>::iterator it = queues.begin(); it != queues.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<FFIRemoteHost *>::iterator it = remoteHosts.begin(); it != remoteHosts.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<BufferView *>::iterator it = views.begin(); it != views.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<std::vector<char> *>::iterator it = snapshots.begin(); it != snapshots.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<Pipeline *>::iterator it = pipelines.begin(); it != pipelines.end(); ++it)
+  {
+    delete *it;
+  }
+
+  for (std::vector<FFISink *>::iterator it = sinks.begin(); it != sinks.end(); ++it)
+  {
+    delete *it;
+  }
+
+  delete recorder;
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::SamplerEntry::~SamplerEntry()
+{
+  delete sampler;
+
+  for (std::vector<FFIValue *>::iterator it = values.begin(); it != values.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::PipelineStep::~PipelineStep()
+{
+  for (std::vector<FFIValue *>::iterator it = values.begin(); it != values.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+FFIExternHdl::Pipeline::~Pipeline()
+{
+  for (std::vector<PipelineStep *>::iterator it = steps.begin(); it != steps.end(); ++it)
+  {
+    delete *it;
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -169,6 +501,7 @@ const Variable *FFIExternHdl::execute(ExecuteParamRec &param)
 {
   static UIntegerVar returnUInt;
   static ULongVar returnULong;
+  static LongVar returnLong;
   static BitVar returnBool;
   static TextVar returnText;
   static AnyTypeVar returnAny;
@@ -176,25 +509,96 @@ const Variable *FFIExternHdl::execute(ExecuteParamRec &param)
   switch (param.funcNum)
   {
     case F_fiiDeclareFunction: returnUInt.setValue(ffiDeclareFunction(param)); return &returnUInt;
+    case F_ffiDeclareFunctionPointer: returnUInt.setValue(ffiDeclareFunctionPointer(param)); return &returnUInt;
+    case F_ffiGetSymbolAddress:  returnULong.setValue(ffiGetSymbolAddress(param)); return &returnULong;
+    case F_ffiUndeclareFunction: returnBool.setValue(ffiUndeclareFunction(param)); return &returnBool;
     case F_ffiCallFunction:    returnBool.setValue(ffiCallFunction(param)); return &returnBool;
     case F_ffiGetAllFunctions: returnAny.setVar(ffiGetAllFunctions(param)); return &returnAny;
+    case F_ffiSetOutputDeallocator: returnBool.setValue(ffiSetOutputDeallocator(param)); return &returnBool;
     case F_ffiGetTypeSize:     returnUInt.setValue(ffiGetTypeSize(param)); return &returnUInt;
     case F_ffiGetTypeName:     returnText.setValue(ffiGetTypeName(param)); return &returnText;
 
     case F_ffiAllocBuffer:     returnULong.setValue(ffiAllocBuffer(param)); return &returnULong;
+    case F_ffiAllocAlignedBuffer: returnULong.setValue(ffiAllocAlignedBuffer(param)); return &returnULong;
     case F_ffiFreeBuffer:      ffiFreeBuffer(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+    case F_ffiGetBufferInfo:   returnAny.setVar(ffiGetBufferInfo(param)); return &returnAny;
+    case F_ffiGetMemoryStats:  returnAny.setVar(ffiGetMemoryStats(param)); return &returnAny;
+    case F_ffiSetMemoryTracking: ffiSetMemoryTracking(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
 
     case F_ffiBufferToString:  returnText.setValuePtr(ffiBufferToString(param)); return &returnText;
     case F_ffiBufferToStruct:  returnAny.setVar(ffiBufferToStruct(param)); return &returnAny;
     case F_ffiBufferToDyn:     returnAny.setVar(ffiBufferToDyn(param)); return &returnAny;
+    case F_ffiBufferToColumns: returnAny.setVar(ffiBufferToColumns(param)); return &returnAny;
+    case F_ffiBufferToDynString: returnAny.setVar(ffiBufferToDynString(param)); return &returnAny;
+    case F_ffiBufferToMatrix:  returnAny.setVar(ffiBufferToMatrix(param)); return &returnAny;
 
     case F_ffiFillBufferWithString: ffiFillBufferWithString(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
     case F_ffiFillBufferWithStruct: ffiFillBufferWithStruct(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
     case F_ffiFillBufferWithDyn:    ffiFillBufferWithDyn(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
-
-    case F_ffiReadFromPointer: returnAny.setVar(ffiReadFromPointer(param)); return &returnAny;
+    case F_ffiFillBufferFromColumns: ffiFillBufferFromColumns(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+    case F_ffiFillBufferWithDynString: returnULong.setValue(ffiFillBufferWithDynString(param)); return &returnULong;
+    case F_ffiFillBufferWithMatrix: ffiFillBufferWithMatrix(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+
+    case F_ffiBufferFind:        returnLong.setValue(ffiBufferFind(param)); return &returnLong;
+    case F_ffiBufferFindByte:    returnLong.setValue(ffiBufferFindByte(param)); return &returnLong;
+    case F_ffiBufferCrc32:       returnUInt.setValue(ffiBufferCrc32(param)); return &returnUInt;
+    case F_ffiBufferCrc32C:      returnUInt.setValue(ffiBufferCrc32C(param)); return &returnUInt;
+    case F_ffiBufferCrc16Modbus: returnUInt.setValue(ffiBufferCrc16Modbus(param)); return &returnUInt;
+    case F_ffiBufferHash:        returnULong.setValue(ffiBufferHash(param)); return &returnULong;
+    case F_ffiBufferReduce:      returnAny.setVar(ffiBufferReduce(param)); return &returnAny;
+
+    case F_ffiReadFromPointer:
+      if (param.args->getNumberOfItems() > 2)
+      {
+        returnBool.setValue(ffiReadFromPointerToTarget(param));
+        return &returnBool;
+      }
+      returnAny.setVar(ffiReadFromPointer(param));
+      return &returnAny;
     case F_ffiWriteToPointer:  ffiWriteToPointer(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
 
+    case F_ffiSharedMemoryCreate: returnULong.setValue(ffiSharedMemoryCreate(param)); return &returnULong;
+    case F_ffiSharedMemoryOpen:   returnULong.setValue(ffiSharedMemoryOpen(param)); return &returnULong;
+    case F_ffiSharedMemoryClose:  ffiSharedMemoryClose(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+
+    case F_ffiQueueCreate:          returnULong.setValue(ffiQueueCreate(param)); return &returnULong;
+    case F_ffiQueueDestroy:         ffiQueueDestroy(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+    case F_ffiQueueGetPushFunction: returnULong.setValue(ffiQueueGetPushFunction(param)); return &returnULong;
+    case F_ffiQueuePopBatch:        returnAny.setVar(ffiQueuePopBatch(param)); return &returnAny;
+    case F_ffiQueueGetStats:        returnAny.setVar(ffiQueueGetStats(param)); return &returnAny;
+
+    case F_ffiIsolateLibrary:       returnBool.setValue(ffiIsolateLibrary(param)); return &returnBool;
+
+    case F_ffiStartSampler:    returnULong.setValue(ffiStartSampler(param)); return &returnULong;
+    case F_ffiReadSamples:     returnAny.setVar(ffiReadSamples(param)); return &returnAny;
+    case F_ffiStopSampler:     ffiStopSampler(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+    case F_ffiGetSamplerStats: returnAny.setVar(ffiGetSamplerStats(param)); return &returnAny;
+
+    case F_ffiStartRecording: returnBool.setValue(ffiStartRecording(param)); return &returnBool;
+    case F_ffiStopRecording:  returnAny.setVar(ffiStopRecording(param)); return &returnAny;
+    case F_ffiSetProfiling:   returnBool.setValue(ffiSetProfiling(param)); return &returnBool;
+
+    case F_ffiCreateView:  returnULong.setValue(ffiCreateView(param)); return &returnULong;
+    case F_ffiViewGet:     returnAny.setVar(ffiViewGet(param)); return &returnAny;
+    case F_ffiViewSlice:   returnULong.setValue(ffiViewSlice(param)); return &returnULong;
+    case F_ffiViewFind:    returnUInt.setValue(ffiViewFind(param)); return &returnUInt;
+    case F_ffiDestroyView: ffiDestroyView(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+
+    case F_ffiSnapshotCreate:  returnULong.setValue(ffiSnapshotCreate(param)); return &returnULong;
+    case F_ffiSnapshotDiff:    returnAny.setVar(ffiSnapshotDiff(param)); return &returnAny;
+    case F_ffiSnapshotDestroy: ffiSnapshotDestroy(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+
+    case F_ffiCreatePipeline:  returnULong.setValue(ffiCreatePipeline(param)); return &returnULong;
+    case F_ffiRunPipeline:     returnBool.setValue(ffiRunPipeline(param)); return &returnBool;
+    case F_ffiDestroyPipeline: ffiDestroyPipeline(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+
+    case F_ffiCreateSink:    returnULong.setValue(ffiCreateSink(param)); return &returnULong;
+    case F_ffiFlushSink:     returnBool.setValue(ffiFlushSink(param)); return &returnBool;
+    case F_ffiGetSinkStats:  returnAny.setVar(ffiGetSinkStats(param)); return &returnAny;
+    case F_ffiDestroySink:   ffiDestroySink(param); returnBool.setValue(PVSS_TRUE); return &returnBool;
+    case F_ffiBufferToSink:  returnBool.setValue(ffiBufferToSink(param)); return &returnBool;
+    case F_ffiSamplesToSink: returnULong.setValue(ffiSamplesToSink(param)); return &returnULong;
+
     default:
     {
       ErrClass err(ErrClass::PRIO_SEVERE, ErrClass::ERR_CONTROL, ErrClass::UNDEFD_FUNC,
@@ -228,97 +632,178 @@ unsigned int FFIExternHdl::ffiDeclareFunction(ExecuteParamRec &param)
   TextVar paramFuncName;
   paramFuncName = *(param.args->getNext()->evaluate(param.thread));
 
-  // load the library
-  if (! SharedLib::load(paramLibPath.getValue()))
+  // create the function declaration
+  std::auto_ptr<FFIFunction> newFunc(new FFIFunction());
+  if (! readSignature(param, 2, *newFunc))
+  {
+    // TODO: error. invalid signature.
+    return 0;
+  }
+
+  // functions of isolated libraries are only declared in their host
+  FFIRemoteHost *remoteHost = findRemoteHost(paramLibPath.getValue());
+  if (remoteHost)
+  {
+    std::vector<int> remoteArgTypes(newFunc->argTypes.begin(), newFunc->argTypes.end());
+    newFunc->remoteFunction = remoteHost->declare(paramFuncName.getValue(), newFunc->returnType, remoteArgTypes);
+
+    if (newFunc->remoteFunction < 0)
+    {
+      // TODO: error. host not started, function not found or unsupported type.
+      return 0;
+    }
+
+    newFunc->libName = paramLibPath.getString();
+    newFunc->funcName = paramFuncName.getString();
+    newFunc->remoteHost = remoteHost;
+
+    DEBUG_PRINT(dbgFlag, "Declared isolated function " << newFunc->funcName << " from library " << newFunc->libName);
+
+    return addFunction(newFunc.release());
+  }
+
+  // load the library, or take it from the cache
+  FFILibrary *library = libraries.acquire(paramLibPath.getValue());
+  if (! library)
   {
     // TODO: error. lib not found.
     return 0;
   }
 
-  SharedLibraryFunction fn = SharedLib::getFuncPtr(paramLibPath.getValue(), paramFuncName.getValue(), true);
+  void *fn = FFILibraryCache::getSymbol(library, paramFuncName.getValue());
   if (! fn)
   {
     // TODO: error. function not found in lib.
+    libraries.release(library);
     return 0;
   }
 
-  // create the function declaration
-  std::auto_ptr<FFIFunction> newFunc(new FFIFunction());
-  newFunc->returnType = CTRLFFI_VOID;
-  ffi_type *returnType = &ffi_type_void;
-  ffi_type **argTypes = 0;
-  unsigned int argCount = 0;
+  newFunc->libName = paramLibPath.getString();
+  newFunc->funcName = paramFuncName.getString();
+  newFunc->funcPtr = reinterpret_cast<VoidFunction>(fn);
+  newFunc->library = library;
 
-  // get the return type
-  if (param.args->getNumberOfItems() > 2)
+  DEBUG_PRINT(dbgFlag, "Declared function " << newFunc->funcName << " from library " << newFunc->libName);
+
+  return addFunction(newFunc.release());
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: unsigned int ffiDeclareFunctionPointer(ulong fnPtr [, int returntype [, int paramtype1, ... ] ] )
+unsigned int FFIExternHdl::ffiDeclareFunctionPointer(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
   {
-    IntegerVar paramReturnType;
-    paramReturnType = *(param.args->getNext()->evaluate(param.thread));
+    // TODO: error
+    return 0;
+  }
 
-    // CTRLFFI_<FOO>_PTR cannot be used as return type.
-    if (paramReturnType.getValue() >= CTRLFFI_FIRST_PTR &&
-        paramReturnType.getValue() <= CTRLFFI_LAST_PTR)
-    {
-      // TODO: error. invalid type for return value.
-      return 0;
-    }
+  ULongVar paramFnPtr;
+  paramFnPtr = *(param.args->getFirst()->evaluate(param.thread));
 
-    returnType = getFFIType(paramReturnType.getValue());
-    if (! returnType)
-    {
-      // TODO: error
-      return 0;
-    }
+  if (paramFnPtr.getValue() == 0)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
 
-    newFunc->returnType = static_cast<IntegralType>(paramReturnType.getValue());
+  std::auto_ptr<FFIFunction> newFunc(new FFIFunction());
+  if (! readSignature(param, 1, *newFunc))
+  {
+    // TODO: error. invalid signature.
+    return 0;
+  }
 
-    // get the argument types
-    if (param.args->getNumberOfItems() > 3)
-    {
-      argCount = param.args->getNumberOfItems() - 3;
-      newFunc->argTypes.reserve(argCount);
+  // the function belongs to no library, so it is named after its address
+  char name[32];
+  sprintf(name, "0x%llx", (unsigned long long) paramFnPtr.getValue());
 
-      argTypes = new ffi_type *[argCount];
+  newFunc->funcName = name;
+  newFunc->funcPtr = reinterpret_cast<VoidFunction>(static_cast<uintptr_t>(paramFnPtr.getValue()));
 
-      for (unsigned int i = 0; i < argCount; ++i)
-      {
-        IntegerVar paramArgType;
-        paramArgType = *(param.args->getNext()->evaluate(param.thread));
+  DEBUG_PRINT(dbgFlag, "Declared function pointer " << newFunc->funcName);
 
-        ffi_type *argType = getFFIType(paramArgType.getValue());
-        if (! argType)
-        {
-          // TODO: error
-          delete[] argTypes;
-          return 0;
-        }
+  return addFunction(newFunc.release());
+}
 
-        argTypes[i] = argType;
-        newFunc->argTypes.push_back(static_cast<IntegralType>(paramArgType.getValue()));
-      }
-    }
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiGetSymbolAddress(string libPath, string name)
+PVSSulonglong FFIExternHdl::ffiGetSymbolAddress(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error
+    return 0;
   }
 
-  // take the cif from the function object to avoid leaks
-  ffi_cif *cif = &(newFunc->callInterface);
-  ffi_status res = ffi_prep_cif(cif, FFI_DEFAULT_ABI, argCount, returnType, argTypes);
+  TextVar paramLibPath;
+  paramLibPath = *(param.args->getFirst()->evaluate(param.thread));
+
+  TextVar paramName;
+  paramName = *(param.args->getNext()->evaluate(param.thread));
 
-  if (res == FFI_OK)
+  // the symbols of an isolated library live in its host process
+  if (findRemoteHost(paramLibPath.getValue()))
   {
-    newFunc->libName = paramLibPath.getString();
-    newFunc->funcName = paramFuncName.getString();
-    newFunc->funcPtr = reinterpret_cast<VoidFunction>(fn);
+    // TODO: error. library is isolated.
+    return 0;
+  }
+
+  void *address = libraries.pinSymbol(paramLibPath.getValue(), paramName.getValue());
+  if (! address)
+  {
+    // TODO: error. lib or symbol not found.
+    return 0;
+  }
 
-    DEBUG_PRINT(dbgFlag, "Declared function " << newFunc->funcName << " from library " << newFunc->libName);
+  return reinterpret_cast<uintptr_t>(address);
+}
 
-    functions.append(newFunc.release());
+//------------------------------------------------------------------------------
 
-    // the function id is a one-based index in the list
-    // (because zero is already used to indicate failure)
-    return functions.getNumberOfItems();
+// Ctrl: bool ffiUndeclareFunction(uint funcId)
+bool FFIExternHdl::ffiUndeclareFunction(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return false;
   }
 
-  return 0;
+  UIntegerVar paramFuncId;
+  paramFuncId = *(param.args->getFirst()->evaluate(param.thread));
+
+  FFIFunction *func = findFunction(paramFuncId.getValue());
+  if (! func)
+  {
+    // TODO: error. invalid function id.
+    return false;
+  }
+
+  DEBUG_PRINT(dbgFlag, "Undeclared function " << func->funcName << " from library " << func->libName);
+
+  // free the slot, and make sure that the old id does not match a new function
+  unsigned int slot = (paramFuncId.getValue() & FUNCTION_SLOT_MASK) - 1;
+  functions[slot].function = 0;
+  if (functions[slot].generation < FUNCTION_LAST_GENERATION)
+  {
+    ++(functions[slot].generation);
+    freeFunctionSlots.push_back(slot);
+  }
+  else
+  {
+    DEBUG_PRINT(dbgFlag, "Retired function slot " << slot << " after " << FUNCTION_LAST_GENERATION << " reuses");
+  }
+
+  stopSamplers(func);
+
+  // unloads the library if this was its last function
+  libraries.release(func->library);
+  delete func;
+
+  return true;
 }
 
 //------------------------------------------------------------------------------
@@ -336,25 +821,19 @@ bool FFIExternHdl::ffiCallFunction(ExecuteParamRec &param)
   UIntegerVar paramFuncId;
   paramFuncId = *(param.args->getFirst()->evaluate(param.thread));
 
-  if (paramFuncId.getValue() < 1 || paramFuncId.getValue() > functions.getNumberOfItems())
-  {
-    // TODO: error. invalid function id.
-    return false;
-  }
-
-  FFIFunction *func = functions.getAt(paramFuncId.getValue() - 1);
+  FFIFunction *func = findFunction(paramFuncId.getValue());
   if (! func)
   {
-    // TODO: error. shouldn't happen, we already checked the id.
+    // TODO: error. invalid function id.
     return false;
   }
 
-  // check the number of params
+  // check the number of params. functions returning void do not need a
+  // return value param, but it is accepted for compatibility.
   size_t argCount = func->argTypes.size();
-  size_t expectedParams = 1;
-
-  if (argCount > 0) { expectedParams += (argCount + 1); }
-  else if (func->returnType != CTRLFFI_VOID) { ++expectedParams; }
+  bool hasReturnParam = (func->returnType != CTRLFFI_VOID) ||
+                        (param.args->getNumberOfItems() > argCount + 1);
+  size_t expectedParams = 1 + argCount + (hasReturnParam ? 1 : 0);
 
   if (param.args->getNumberOfItems() < expectedParams)
   {
@@ -376,40 +855,87 @@ bool FFIExternHdl::ffiCallFunction(ExecuteParamRec &param)
   storedValues.append(returnValueStorage.release());
 
   // skip return value param, we don't need it now
-  param.args->getNext();
+  if (hasReturnParam)
+  {
+    param.args->getNext();
+  }
 
   // prepare function args
-  void **argValues = new void *[argCount];
+  std::vector<void *> argValues(argCount);
 
   for (size_t i = 0; i < argCount; ++i)
   {
-    int argType = func->argTypes.at(i);
+    int argType = func->argTypes[i];
     std::auto_ptr<FFIValue> argValueStorage(FFIValue::allocateValue(argType));
 
     if (! argValueStorage.get())
     {
       // TODO: error. shouldn't happen.
-      delete[] argValues;
       return false;
     }
 
-    const Variable *paramArgVar = param.args->getNext()->evaluate(param.thread);
-    if (! paramArgVar) // TODO: can this be null?
+    CtrlExpr *paramArgExpr = param.args->getNext();
+
+    // output-only parameters start with a zero value
+    if (func->argDirections[i] & CTRLFFI_DIR_IN)
     {
-      // TODO: error
-      delete[] argValues;
-      return false;
+      const Variable *paramArgVar = paramArgExpr->evaluate(param.thread);
+      if (! paramArgVar) // TODO: can this be null?
+      {
+        // TODO: error
+        return false;
+      }
+
+      argValueStorage->setValue(*paramArgVar);
     }
 
-    argValueStorage->setValue(*paramArgVar);
     argValues[i] = argValueStorage->getPtr();
     storedValues.append(argValueStorage.release());
   }
 
+  // the inputs are recorded before the function can change them
+  long long callStart = 0;
+  if (recorder)
+  {
+    recordCall(paramFuncId.getValue(), func, argValues);
+    callStart = FFIRecorder::getTime();
+  }
+
   // actual function call
   DEBUG_PRINT(dbgFlag, "Calling function " << func->funcName << " from library " << func->libName);
 
-  ffi_call(&(func->callInterface), func->funcPtr, returnValue, argValues);
+  // the location is only taken if requested, because it has to be formatted
+  CharString location;
+  if (traceLocations)
+  {
+    location = param.thread->getLocation();
+  }
+
+  const char *callLocation = traceLocations ? (const char *) location : 0;
+  CTRLFFI_PROBE_CALL_ENTRY(paramFuncId.getValue(), (const char *) func->funcName, callLocation);
+
+  bool called = true;
+  if (func->remoteHost)
+  {
+    called = func->remoteHost->call(func->remoteFunction, returnValue, argCount ? &argValues[0] : 0);
+  }
+  else
+  {
+    ffi_call(&(func->callInterface), func->funcPtr, returnValue, argCount ? &argValues[0] : 0);
+  }
+
+  CTRLFFI_PROBE_CALL_RETURN(paramFuncId.getValue(), (const char *) func->funcName, callLocation, called ? 1 : 0);
+
+  if (recorder)
+  {
+    recorder->endCall(callStart, FFIRecorder::getTime() - callStart);
+  }
+
+  if (! called)
+  {
+    // TODO: error. the host crashed and was restarted.
+    return false;
+  }
 
   // convert args and return value back
 
@@ -420,10 +946,20 @@ bool FFIExternHdl::ffiCallFunction(ExecuteParamRec &param)
   // this allows using literals as params.
   // TODO: maybe throw a warning?
 
-  // index 0 is the return value, index 1 to <argCount> are the arguments
-  for (size_t i = 0; i <= argCount; ++i)
+  // index 0 is the return value, index 1 to <argCount> are the arguments.
+  // only the return value and output params are written back.
+  for (size_t i = hasReturnParam ? 0 : 1; i <= argCount; ++i)
   {
-    Variable *target = param.args->getNext()->getTarget(param.thread);
+    CtrlExpr *paramExpr = param.args->getNext();
+
+    bool isOutput = (i == 0) ? (func->returnType != CTRLFFI_VOID)
+                             : ((func->argDirections[i - 1] & CTRLFFI_DIR_OUT) != 0);
+    if (! isOutput)
+    {
+      continue;
+    }
+
+    Variable *target = paramExpr->getTarget(param.thread);
     if (! target) // TODO: can this be null?
     {
       // TODO: error
@@ -431,6 +967,16 @@ bool FFIExternHdl::ffiCallFunction(ExecuteParamRec &param)
     }
 
     storedValues.getAt((unsigned int) i)->getValue(*target);
+
+    // the memory behind an out slot is not needed after the conversion
+    if (i > 0 && i <= func->outputDeallocators.size() && func->outputDeallocators[i - 1].enabled)
+    {
+      void *memory = **static_cast<void ***>(argValues[i - 1]);
+      if (memory)
+      {
+        freeOutput(func->outputDeallocators[i - 1], memory);
+      }
+    }
   }
 
   return true;
@@ -443,12 +989,18 @@ DynVar *FFIExternHdl::ffiGetAllFunctions(ExecuteParamRec &param)
 {
   DynVar *result = new DynVar(MAPPING_VAR);
 
-  for (unsigned int i = 0; i < functions.getNumberOfItems(); ++i)
+  for (unsigned int i = 0; i < functions.size(); ++i)
   {
-    const FFIFunction *function = functions.getAt(i);
+    const FFIFunction *function = functions[i].function;
+    if (! function)
+    {
+      continue;
+    }
+
+    unsigned int funcId = (functions[i].generation << FUNCTION_SLOT_BITS) | (i + 1);
 
     MappingVar *funcDesc = new MappingVar();
-    funcDesc->setAt(new TextVar("id"),         new UIntegerVar(i + 1));
+    funcDesc->setAt(new TextVar("id"),         new UIntegerVar(funcId));
     funcDesc->setAt(new TextVar("name"),       new TextVar(function->funcName));
     funcDesc->setAt(new TextVar("library"),    new TextVar(function->libName));
     funcDesc->setAt(new TextVar("returntype"), new UIntegerVar(function->returnType));
@@ -462,6 +1014,21 @@ DynVar *FFIExternHdl::ffiGetAllFunctions(ExecuteParamRec &param)
 
     funcDesc->setAt(new TextVar("argtypes"), argTypes);
 
+    DynVar *argDirections = new DynVar(UINTEGER_VAR);
+    for (std::vector<int>::const_iterator it = function->argDirections.begin();
+         it != function->argDirections.end(); ++it)
+    {
+      argDirections->append(new UIntegerVar(*it));
+    }
+
+    funcDesc->setAt(new TextVar("argdirections"), argDirections);
+
+    // resource usage, to keep an eye on long running managers
+    funcDesc->setAt(new TextVar("memory"), new UIntegerVar((unsigned int) function->getMemoryUsage()));
+    funcDesc->setAt(new TextVar("libraryrefs"),
+                    new UIntegerVar(function->library ? function->library->refCount : 0));
+    funcDesc->setAt(new TextVar("isolated"), new BitVar(function->remoteHost != 0));
+
     result->append(funcDesc);
   }
 
@@ -470,6 +1037,71 @@ DynVar *FFIExternHdl::ffiGetAllFunctions(ExecuteParamRec &param)
 
 //------------------------------------------------------------------------------
 
+// Ctrl: bool ffiSetOutputDeallocator(uint funcId, uint paramIndex [, uint deallocFuncId] )
+bool FFIExternHdl::ffiSetOutputDeallocator(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  UIntegerVar paramFuncId;
+  paramFuncId = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramIndex;
+  paramIndex = *(param.args->getNext()->evaluate(param.thread));
+
+  FFIFunction *func = findFunction(paramFuncId.getValue());
+  if (! func)
+  {
+    // TODO: error. invalid function id.
+    return false;
+  }
+
+  // the index is one-based, like the parameter values of ffiCallFunction
+  unsigned int index = paramIndex.getValue();
+  if (index < 1 || index > func->argTypes.size() || ! isOutputOnly(func->argTypes[index - 1]))
+  {
+    // TODO: error. not an out slot parameter.
+    return false;
+  }
+
+  // without a deallocator function, free() is used. zero removes the deallocator.
+  OutputDeallocator deallocator;
+  deallocator.enabled = true;
+  deallocator.funcId = 0;
+
+  if (param.args->getNumberOfItems() > 2)
+  {
+    UIntegerVar paramDeallocFuncId;
+    paramDeallocFuncId = *(param.args->getNext()->evaluate(param.thread));
+
+    deallocator.funcId = paramDeallocFuncId.getValue();
+    deallocator.enabled = (deallocator.funcId != 0);
+
+    const FFIFunction *deallocFunc = findFunction(deallocator.funcId);
+    if (deallocator.enabled &&
+        (! deallocFunc || deallocFunc->remoteHost || deallocFunc->argTypes.size() != 1 ||
+         getFFIType(deallocFunc->argTypes[0]) != &ffi_type_pointer || isOutputOnly(deallocFunc->argTypes[0])))
+    {
+      // TODO: error. the deallocator has to take exactly one pointer.
+      return false;
+    }
+  }
+
+  OutputDeallocator none;
+  none.enabled = false;
+  none.funcId = 0;
+
+  func->outputDeallocators.resize(func->argTypes.size(), none);
+  func->outputDeallocators[index - 1] = deallocator;
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
 // Ctrl: uint ffiGetTypeSize(int type)
 unsigned int FFIExternHdl::ffiGetTypeSize(ExecuteParamRec &param)
 {
@@ -482,13 +1114,16 @@ unsigned int FFIExternHdl::ffiGetTypeSize(ExecuteParamRec &param)
   IntegerVar paramType;
   paramType = *(param.args->getFirst()->evaluate(param.thread));
 
+  // the byte order does not change the size
+  int baseType = getMemoryBaseType(paramType.getValue());
+
   // ffi_type_void has size 1, but 0 seems more sensible
-  if (paramType.getValue() == CTRLFFI_VOID)
+  if (baseType == CTRLFFI_VOID)
   {
     return 0;
   }
 
-  ffi_type *type = getFFIType(paramType.getValue());
+  ffi_type *type = getFFIType(baseType);
   if (type)
   {
     return (unsigned int) type->size;
@@ -511,14 +1146,14 @@ const char *FFIExternHdl::ffiGetTypeName(ExecuteParamRec &param)
   IntegerVar paramType;
   paramType = *(param.args->getFirst()->evaluate(param.thread));
 
-  int typeArraySize = (int) sizeof(TYPE_NAMES) / sizeof(*TYPE_NAMES);
-  if (paramType.getValue() < 0 || paramType.getValue() >= typeArraySize)
+  const char *typeName = FFITypeTraits::get(paramType.getValue()).name;
+  if (! typeName)
   {
     // TODO: error. out of range.
     return "";
   }
 
-  return TYPE_NAMES[paramType.getValue()];
+  return typeName;
 }
 
 //------------------------------------------------------------------------------
@@ -550,10 +1185,21 @@ PVSSulonglong FFIExternHdl::ffiAllocBuffer(ExecuteParamRec &param)
     setzero = paramZero.isTrue();
   }
 
+  TextVar paramTag;
+  if (param.args->getNumberOfItems() > 2)
+  {
+    paramTag = *(param.args->getNext()->evaluate(param.thread));
+  }
+
   // allocate the buffer.
   // we use malloc() since libffi is only meant to call C libraries,
   // which probably use free() to delete this buffer.
   void *buffer = malloc(static_cast<size_t>(paramBytes.getValue()));
+  if (! buffer)
+  {
+    // TODO: error. out of memory.
+    return 0;
+  }
 
   // if requested, clear the buffer
   if (setzero)
@@ -561,6 +1207,82 @@ PVSSulonglong FFIExternHdl::ffiAllocBuffer(ExecuteParamRec &param)
     memset(buffer, 0, static_cast<size_t>(paramBytes.getValue()));
   }
 
+  if (memoryTracker.isEnabled())
+  {
+    CharString location = param.thread->getLocation();
+    memoryTracker.add(buffer, static_cast<size_t>(paramBytes.getValue()), paramTag.getValue(), location);
+  }
+
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(buffer);
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiAllocAlignedBuffer(ulong bytes, uint alignment, uint flags = 0, string tag = "")
+PVSSulonglong FFIExternHdl::ffiAllocAlignedBuffer(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramBytes;
+  paramBytes = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramAlignment;
+  paramAlignment = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramFlags(0);
+  if (param.args->getNumberOfItems() > 2)
+  {
+    paramFlags = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  TextVar paramTag;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    paramTag = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  if (paramFlags.getValue() & ~(unsigned int) CTRLFFI_ALLOC_MASK)
+  {
+    // TODO: error. unknown flags.
+    return 0;
+  }
+
+  size_t size = static_cast<size_t>(paramBytes.getValue());
+
+  FFIAlignedMemory::Backing backing;
+  void *buffer = FFIAlignedMemory::allocate(size, paramAlignment.getValue(), paramFlags.getValue(), backing);
+  if (! buffer)
+  {
+    // TODO: error. invalid alignment or out of memory.
+    return 0;
+  }
+
+  // both are only optimizations, so the buffer is still returned without them
+  if ((paramFlags.getValue() & CTRLFFI_ALLOC_HUGE_PAGES) && ! backing.hugePages)
+  {
+    DEBUG_PRINT(dbgFlag, "Buffer " << reinterpret_cast<uintptr_t>(buffer) << " allocated without huge pages");
+  }
+
+  if ((paramFlags.getValue() & CTRLFFI_ALLOC_LOCK) && ! backing.locked)
+  {
+    DEBUG_PRINT(dbgFlag, "Buffer " << reinterpret_cast<uintptr_t>(buffer) << " could not be locked");
+  }
+
+  // the backing is registered independent of the tracking, since it is
+  // needed to free the buffer
+  memoryTracker.addBacking(buffer, backing);
+
+  if (memoryTracker.isEnabled())
+  {
+    CharString location = param.thread->getLocation();
+    memoryTracker.add(buffer, size, paramTag.getValue(), location);
+  }
+
   uintptr_t ptrValue = reinterpret_cast<uintptr_t>(buffer);
   return static_cast<PVSSulonglong>(ptrValue);
 }
@@ -588,6 +1310,37 @@ void FFIExternHdl::ffiFreeBuffer(ExecuteParamRec &param)
   uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
   void *buffer = reinterpret_cast<void *>(ptrValue);
 
+  // buffers from ffiAllocAlignedBuffer are not necessarily compatible with free()
+  FFIAlignedMemory::Backing backing;
+  if (memoryTracker.removeBacking(buffer, backing))
+  {
+    memoryTracker.remove(buffer);
+    FFIAlignedMemory::release(buffer, backing);
+    return;
+  }
+
+  switch (memoryTracker.remove(buffer))
+  {
+    case FFIMemoryTracker::FREE_DOUBLE:
+    {
+      // the address may as well be a new buffer of a native library, which
+      // got it from malloc again, so it is only reported and still freed
+      ErrClass err(ErrClass::PRIO_WARNING, ErrClass::ERR_CONTROL, ErrClass::ILLEGAL_ARG,
+                   param.thread->getLocation(), param.funcName, "buffer may have been freed before");
+      ErrHdl::error(err);
+      param.thread->appendLastError(err);
+      break;
+    }
+
+    case FFIMemoryTracker::FREE_FOREIGN:
+      // probably allocated by a native library, which is allowed
+      DEBUG_PRINT(dbgFlag, "Freeing buffer " << ptrValue << " that was not allocated by ffiAllocBuffer");
+      break;
+
+    default:
+      break;
+  }
+
   // we use free() since libffi is only meant to call C libraries,
   // which probably used malloc() to allocate this buffer.
   free(buffer);
@@ -595,6 +1348,133 @@ void FFIExternHdl::ffiFreeBuffer(ExecuteParamRec &param)
 
 //------------------------------------------------------------------------------
 
+// Ctrl: mapping ffiGetBufferInfo(ulong ptr)
+MappingVar *FFIExternHdl::ffiGetBufferInfo(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  if (ptrValue == 0)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  const void *buffer = reinterpret_cast<const void *>(ptrValue);
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  const FFIAlignedMemory::Backing *backing = memoryTracker.findBacking(buffer);
+
+  size_t size = backing ? backing->size : (allocation ? allocation->size : 0);
+
+  MappingVar *info = new MappingVar();
+
+  // the largest power of two dividing the address
+  info->setAt(new TextVar("alignment"), new ULongVar(ptrValue & (~ptrValue + 1)));
+  info->setAt(new TextVar("size"),      new ULongVar(size));
+  info->setAt(new TextVar("tracked"),   new BitVar(allocation != 0));
+  info->setAt(new TextVar("tag"),       new TextVar(allocation ? memoryTracker.getString(allocation->tag).c_str() : ""));
+  info->setAt(new TextVar("aligned"),   new BitVar(backing != 0));
+
+  if (backing)
+  {
+    info->setAt(new TextVar("flags"),     new UIntegerVar(backing->flags));
+    info->setAt(new TextVar("mapped"),    new BitVar(backing->mappedSize != 0));
+    info->setAt(new TextVar("hugepages"), new BitVar(backing->hugePages));
+    info->setAt(new TextVar("locked"),    new BitVar(backing->locked));
+  }
+
+  return info;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiGetMemoryStats(uint oldestCount = 10)
+MappingVar *FFIExternHdl::ffiGetMemoryStats(ExecuteParamRec &param)
+{
+  UIntegerVar paramOldestCount(10);
+  if (param.args->getNumberOfItems() > 0)
+  {
+    paramOldestCount = *(param.args->getFirst()->evaluate(param.thread));
+  }
+
+  MappingVar *stats = new MappingVar();
+  stats->setAt(new TextVar("enabled"),      new BitVar(memoryTracker.isEnabled()));
+  stats->setAt(new TextVar("livebytes"),    new ULongVar(memoryTracker.getLiveBytes()));
+  stats->setAt(new TextVar("peakbytes"),    new ULongVar(memoryTracker.getPeakBytes()));
+  stats->setAt(new TextVar("livecount"),    new ULongVar(memoryTracker.getLiveCount()));
+  stats->setAt(new TextVar("allocs"),       new ULongVar(memoryTracker.getAllocCount()));
+  stats->setAt(new TextVar("frees"),        new ULongVar(memoryTracker.getFreeCount()));
+  stats->setAt(new TextVar("doublefrees"),  new ULongVar(memoryTracker.getDoubleFreeCount()));
+  stats->setAt(new TextVar("foreignfrees"), new ULongVar(memoryTracker.getForeignFreeCount()));
+  stats->setAt(new TextVar("overhead"),     new ULongVar(memoryTracker.getOverhead()));
+
+  // live allocations per tag
+  MappingVar *tags = new MappingVar();
+  const std::vector<FFIMemoryTracker::TagStats> &tagStats = memoryTracker.getTagStats();
+
+  for (std::vector<FFIMemoryTracker::TagStats>::const_iterator it = tagStats.begin(); it != tagStats.end(); ++it)
+  {
+    MappingVar *tag = new MappingVar();
+    tag->setAt(new TextVar("count"), new ULongVar(it->count));
+    tag->setAt(new TextVar("bytes"), new ULongVar(it->bytes));
+    tags->setAt(new TextVar(memoryTracker.getString(it->tag).c_str()), tag);
+  }
+
+  stats->setAt(new TextVar("tags"), tags);
+
+  // the oldest live allocations, which are the most likely leaks
+  std::vector<FFIMemoryTracker::Allocation> oldest;
+  memoryTracker.getOldest(paramOldestCount.getValue(), oldest);
+
+  DynVar *oldestList = new DynVar(MAPPING_VAR);
+  PVSSlonglong now = (PVSSlonglong) time(0);
+
+  for (std::vector<FFIMemoryTracker::Allocation>::const_iterator it = oldest.begin(); it != oldest.end(); ++it)
+  {
+    MappingVar *allocation = new MappingVar();
+    allocation->setAt(new TextVar("ptr"),      new ULongVar(static_cast<PVSSulonglong>(it->address)));
+    allocation->setAt(new TextVar("size"),     new ULongVar(it->size));
+    allocation->setAt(new TextVar("tag"),      new TextVar(memoryTracker.getString(it->tag).c_str()));
+    allocation->setAt(new TextVar("location"), new TextVar(memoryTracker.getString(it->location).c_str()));
+    allocation->setAt(new TextVar("age"),      new ULongVar(now > it->time ? now - it->time : 0));
+    oldestList->append(allocation);
+  }
+
+  stats->setAt(new TextVar("oldest"), oldestList);
+
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiSetMemoryTracking(bool enable)
+void FFIExternHdl::ffiSetMemoryTracking(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  BitVar paramEnable;
+  paramEnable = *(param.args->getFirst()->evaluate(param.thread));
+
+  // a new tracking period starts with empty statistics
+  if (paramEnable.isTrue() != memoryTracker.isEnabled())
+  {
+    memoryTracker.setEnabled(paramEnable.isTrue());
+  }
+}
+
+//------------------------------------------------------------------------------
+
 // Ctrl: string ffiBufferToString(ulong ptr [, int strlen] )
 char *FFIExternHdl::ffiBufferToString(ExecuteParamRec &param)
 {
@@ -663,48 +1543,20 @@ DynVar *FFIExternHdl::ffiBufferToStruct(ExecuteParamRec &param)
     return 0;
   }
 
-  // HACK: iterate through the memory by incrementing an uintptr_t and
-  // casting to a pointer when necessary.
   uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
-
-  std::auto_ptr<DynVar> result(new DynVar());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
 
   DynVar paramFields;
   paramFields = *(param.args->getNext()->evaluate(param.thread));
 
-  for (const Variable *field = paramFields.getFirst(); field != 0;
-                       field = paramFields.getNext())
+  StructLayout layout;
+  if (! getStructLayout(paramFields, layout))
   {
-    IntegerVar typeVal;
-    typeVal = *field;
-    if (typeVal.getValue() == CTRLFFI_VOID) // TODO: use isvalid...
-    {
-      // TODO: error. void cannot be a struct field.
-      return 0;
-    }
-
-    ffi_type *type = getFFIType(typeVal.getValue());
-    if (type == 0)
-    {
-      // TODO: error. invalid type.
-      return 0;
-    }
-
-    const char *buffer = reinterpret_cast<const char *>(ptrValue);
-    Variable *fieldValue = readAddress(typeVal.getValue(), buffer);
-    if (! fieldValue)
-    {
-      // TODO: error. failed to read field?
-      return 0;
-    }
-
-    result->append(fieldValue);
-
-    // advance to next field
-    ptrValue += type->size;
+    // TODO: error. invalid type.
+    return 0;
   }
 
-  return result.release();
+  return readStruct(layout, buffer);
 }
 
 //------------------------------------------------------------------------------
@@ -721,9 +1573,8 @@ DynVar *FFIExternHdl::ffiBufferToDyn(ExecuteParamRec &param)
   ULongVar paramPtr;
   paramPtr = *(param.args->getFirst()->evaluate(param.thread));
 
-  // HACK: iterate through the memory by incrementing an uintptr_t and
-  // casting to a pointer when necessary.
   uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
 
   std::auto_ptr<DynVar> result(new DynVar());
 
@@ -733,33 +1584,37 @@ DynVar *FFIExternHdl::ffiBufferToDyn(ExecuteParamRec &param)
   UIntegerVar paramItemCount;
   paramItemCount = *(param.args->getNext()->evaluate(param.thread));
 
-  if (! isValidForRawMemoryOperation(paramItemType.getValue()))
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
   {
     // TODO: error. invalid type.
     return 0;
   }
 
-  ffi_type *type = getFFIType(paramItemType.getValue());
-  if (type == 0)
+  ffi_type *type = getFFIType(itemType);
+  std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+  if (type == 0 || converter.get() == 0)
   {
     // TODO: error. invalid type.
     return 0;
   }
 
-  for (unsigned int i = 0; i < paramItemCount.getValue(); ++i)
+  size_t itemCount = paramItemCount.getValue();
+
+  // for the other byte order, swap a copy of the whole array at once
+  std::vector<char> swapped;
+  if (needsByteSwap(paramItemType.getValue()) && itemCount > 0)
   {
-    const char *buffer = reinterpret_cast<const char *>(ptrValue);
-    Variable *fieldValue = readAddress(paramItemType.getValue(), buffer);
-    if (! fieldValue)
-    {
-      // TODO: error. failed to read field?
-      return 0;
-    }
+    swapped.assign(buffer, buffer + itemCount * type->size);
+    FFIKernels::swapBytes(&swapped[0], type->size, itemCount);
+    buffer = &swapped[0];
+  }
 
+  for (size_t i = 0; i < itemCount; ++i)
+  {
+    Variable *fieldValue = converter->allocateCtrlVar();
+    converter->readValueFromRawMemory(*fieldValue, buffer + i * type->size);
     result->append(fieldValue);
-
-    // advance to next field
-    ptrValue += type->size;
   }
 
   return result.release();
@@ -767,13 +1622,251 @@ DynVar *FFIExternHdl::ffiBufferToDyn(ExecuteParamRec &param)
 
 //------------------------------------------------------------------------------
 
-// Ctrl: void ffiFillBufferWithString(ulong ptr, string text)
-void FFIExternHdl::ffiFillBufferWithString(ExecuteParamRec &param)
+// Ctrl: dyn_dyn_anytype ffiBufferToColumns(ulong ptr, dyn_int fieldtypes, uint count [, uint stride] )
+DynVar *FFIExternHdl::ffiBufferToColumns(ExecuteParamRec &param)
 {
-  if (param.args->getNumberOfItems() < 2)
+  if (param.args->getNumberOfItems() < 3)
   {
-    // TODO: error
-    return;
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  if (paramPtr.getValue() == 0)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  DynVar paramFields;
+  paramFields = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramCount;
+  paramCount = *(param.args->getNext()->evaluate(param.thread));
+
+  StructLayout layout;
+  if (! getStructLayout(paramFields, layout))
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  // the records are packed, unless a stride is given
+  size_t stride = layout.size;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    UIntegerVar paramStride;
+    paramStride = *(param.args->getNext()->evaluate(param.thread));
+    stride = paramStride.getValue();
+  }
+
+  // the records in a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && paramCount.getValue() > 0 &&
+      (paramCount.getValue() - 1) * stride + layout.size > allocation->size)
+  {
+    // TODO: error. the records exceed the buffer.
+    return 0;
+  }
+
+  // create one dyn per field, typed like the values of the field
+  std::vector<DynVar *> columns;
+  std::auto_ptr<DynVar> result(new DynVar(DYNANYTYPE_VAR));
+
+  for (std::vector<StructField>::const_iterator it = layout.fields.begin();
+       it != layout.fields.end(); ++it)
+  {
+    std::auto_ptr<Variable> sample(it->converter->allocateCtrlVar());
+    if (! sample.get())
+    {
+      // TODO: error. type has no Ctrl value.
+      return 0;
+    }
+
+    DynVar *column = new DynVar(sample->isA());
+    result->append(column);
+    columns.push_back(column);
+  }
+
+  // walk through the records once, and distribute the fields to the columns
+  for (unsigned int row = 0; row < paramCount.getValue(); ++row)
+  {
+    const char *record = buffer + row * stride;
+
+    for (size_t i = 0; i < layout.fields.size(); ++i)
+    {
+      const StructField &field = layout.fields[i];
+
+      Variable *value = field.converter->allocateCtrlVar();
+      readValue(*field.converter, *value, record + field.offset, field.size, field.byteSwap);
+      columns[i]->append(value);
+    }
+  }
+
+  return result.release();
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: dyn_string ffiBufferToDynString(ulong ptr [, int count] )
+DynVar *FFIExternHdl::ffiBufferToDynString(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  // without a count, the table ends with a null pointer
+  size_t count = FFIStringArray::NULL_TERMINATED;
+  if (param.args->getNumberOfItems() > 1)
+  {
+    IntegerVar paramCount;
+    paramCount = *(param.args->getNext()->evaluate(param.thread));
+
+    if (paramCount.getValue() >= 0)
+    {
+      count = static_cast<size_t>(paramCount.getValue());
+    }
+  }
+
+  DynVar *result = new DynVar(TEXT_VAR);
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *const *table = reinterpret_cast<const char *const *>(ptrValue);
+
+  // a null table is an empty list, e.g. from a function that found nothing
+  if (table)
+  {
+    FFIStringArray::unpack(table, count, *result);
+  }
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: dyn_dyn_anytype ffiBufferToMatrix(ulong ptr, int itemtype, uint rows, uint cols [, bool colMajor [, uint leadingDim] ] )
+DynVar *FFIExternHdl::ffiBufferToMatrix(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 4)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  IntegerVar paramItemType;
+  paramItemType = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramRows;
+  paramRows = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramCols;
+  paramCols = *(param.args->getNext()->evaluate(param.thread));
+
+  bool colMajor = false;
+  if (param.args->getNumberOfItems() > 4)
+  {
+    BitVar paramColMajor;
+    paramColMajor = *(param.args->getNext()->evaluate(param.thread));
+    colMajor = paramColMajor.isTrue();
+  }
+
+  size_t leadingDim = 0;
+  if (param.args->getNumberOfItems() > 5)
+  {
+    UIntegerVar paramLeadingDim;
+    paramLeadingDim = *(param.args->getNext()->evaluate(param.thread));
+    leadingDim = paramLeadingDim.getValue();
+  }
+
+  if (paramPtr.getValue() == 0)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+  std::auto_ptr<Variable> sample(converter->allocateCtrlVar());
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  size_t rows = paramRows.getValue();
+  size_t cols = paramCols.getValue();
+  size_t size = getFFIType(itemType)->size;
+  bool byteSwap = needsByteSwap(paramItemType.getValue());
+
+  if (! checkMatrix(buffer, rows, cols, size, colMajor, leadingDim))
+  {
+    // TODO: error. invalid leading dimension, or the matrix exceeds the buffer.
+    return 0;
+  }
+
+  // a column-major matrix is transposed to rows first, so that it is read sequentially
+  std::vector<char> transposed;
+  size_t rowStride = leadingDim;
+  if (colMajor && rows > 0 && cols > 0)
+  {
+    transposed.resize(rows * cols * size);
+    FFIKernels::transpose(&transposed[0], cols, buffer, leadingDim, cols, rows, size);
+
+    if (byteSwap)
+    {
+      FFIKernels::swapBytes(&transposed[0], size, rows * cols);
+      byteSwap = false;
+    }
+
+    buffer = &transposed[0];
+    rowStride = cols;
+  }
+
+  std::auto_ptr<DynVar> result(new DynVar(DYNANYTYPE_VAR));
+
+  for (size_t r = 0; r < rows; ++r)
+  {
+    DynVar *row = new DynVar(sample->isA());
+    result->append(row);
+
+    const char *item = buffer + r * rowStride * size;
+    for (size_t c = 0; c < cols; ++c, item += size)
+    {
+      Variable *value = converter->allocateCtrlVar();
+      readValue(*converter, *value, item, size, byteSwap);
+      row->append(value);
+    }
+  }
+
+  return result.release();
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiFillBufferWithString(ulong ptr, string text)
+void FFIExternHdl::ffiFillBufferWithString(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error
+    return;
   }
 
   ULongVar paramPtr;
@@ -807,9 +1900,8 @@ void FFIExternHdl::ffiFillBufferWithStruct(ExecuteParamRec &param)
   ULongVar paramPtr;
   paramPtr = *(param.args->getFirst()->evaluate(param.thread));
 
-  // HACK: iterate through the memory by incrementing an uintptr_t and
-  // casting to a pointer when necessary.
   uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  char *buffer = reinterpret_cast<char *>(ptrValue);
 
   DynVar paramFieldTypes;
   paramFieldTypes = *(param.args->getNext()->evaluate(param.thread));
@@ -823,28 +1915,27 @@ void FFIExternHdl::ffiFillBufferWithStruct(ExecuteParamRec &param)
     return;
   }
 
-  for (unsigned int i = 1; i <= paramFieldTypes.getNumberOfItems(); ++i)
+  // the same layout as ffiBufferToStruct, checked before any byte is written
+  StructLayout layout;
+  if (! getStructLayout(paramFieldTypes, layout))
   {
-    IntegerVar fieldType;
-    fieldType = *(paramFieldTypes[i]);
-    if (fieldType.getValue() == CTRLFFI_VOID) // TODO: use isvalid...
-    {
-      // TODO: error. void cannot be a struct field.
-      return;
-    }
-
-    ffi_type *type = getFFIType(fieldType.getValue());
-    if (type == 0)
-    {
-      // TODO: error. invalid type.
-      return;
-    }
+    // TODO: error. invalid type.
+    return;
+  }
 
-    char *buffer = reinterpret_cast<char *>(ptrValue);
-    writeAddress(fieldType.getValue(), buffer, *(paramFieldValues[i]));
+  // the struct must fit into a buffer from ffiAllocBuffer
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && layout.size > allocation->size)
+  {
+    // TODO: error. the struct exceeds the buffer.
+    return;
+  }
 
-    // advance to next field
-    ptrValue += type->size;
+  for (size_t i = 0; i < layout.fields.size(); ++i)
+  {
+    const StructField &field = layout.fields[i];
+    writeValue(*field.converter, *(paramFieldValues[(unsigned int) i + 1]), buffer + field.offset,
+               field.size, field.byteSwap);
   }
 }
 
@@ -869,13 +1960,13 @@ void FFIExternHdl::ffiFillBufferWithDyn(ExecuteParamRec &param)
   IntegerVar paramItemType;
   paramItemType = *(param.args->getNext()->evaluate(param.thread));
 
-  if (paramItemType.getValue() == CTRLFFI_VOID) // use isvalid...
+  if (getMemoryBaseType(paramItemType.getValue()) == CTRLFFI_VOID) // use isvalid...
   {
     // TODO: error. void cannot be a struct field.
     return;
   }
 
-  ffi_type *type = getFFIType(paramItemType.getValue());
+  ffi_type *type = getFFIType(getMemoryBaseType(paramItemType.getValue()));
   if (type == 0)
   {
     // TODO: error. invalid type.
@@ -897,142 +1988,3254 @@ void FFIExternHdl::ffiFillBufferWithDyn(ExecuteParamRec &param)
 
 //------------------------------------------------------------------------------
 
-// Ctrl: anytype ffiReadFromPointer(ulong ptr, int type)
-Variable *FFIExternHdl::ffiReadFromPointer(ExecuteParamRec &param)
+// Ctrl: void ffiFillBufferFromColumns(ulong ptr, dyn_int fieldtypes, dyn_dyn_anytype columns [, uint stride] )
+void FFIExternHdl::ffiFillBufferFromColumns(ExecuteParamRec &param)
 {
-  if (param.args->getNumberOfItems() < 2)
+  if (param.args->getNumberOfItems() < 3)
   {
-    // TODO: error
-    return 0;
+    // TODO: error. too few arguments.
+    return;
   }
 
   ULongVar paramPtr;
   paramPtr = *(param.args->getFirst()->evaluate(param.thread));
 
-  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
-  const char *buffer = reinterpret_cast<const char *>(ptrValue);
-
-  IntegerVar paramType;
-  paramType = *(param.args->getNext()->evaluate(param.thread));
-
-  Variable *newValue = readAddress(paramType.getValue(), buffer);
-  if (! newValue)
-  {
-    // TODO: error. failed to read from address? invalid type?
-    return 0;
-  }
-
-  return newValue;
-}
-
-//------------------------------------------------------------------------------
-
-// Ctrl: void ffiWriteToPointer(ulong ptr, int type, anytype value)
-void FFIExternHdl::ffiWriteToPointer(ExecuteParamRec &param)
-{
-  if (param.args->getNumberOfItems() < 2)
+  if (paramPtr.getValue() == 0)
   {
-    // TODO: error
+    // TODO: error. null pointer.
     return;
   }
 
-  ULongVar paramPtr;
-  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
-
   uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
   char *buffer = reinterpret_cast<char *>(ptrValue);
 
-  IntegerVar paramType;
-  paramType = *(param.args->getNext()->evaluate(param.thread));
+  DynVar paramFields;
+  paramFields = *(param.args->getNext()->evaluate(param.thread));
 
-  const Variable *paramValue = param.args->getNext()->evaluate(param.thread);
+  DynVar paramColumns;
+  paramColumns = *(param.args->getNext()->evaluate(param.thread));
 
-  writeAddress(paramType.getValue(), buffer, *paramValue);
-}
+  StructLayout layout;
+  if (! getStructLayout(paramFields, layout))
+  {
+    // TODO: error. invalid type.
+    return;
+  }
 
-//------------------------------------------------------------------------------
-// helper functions:
+  size_t stride = layout.size;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    UIntegerVar paramStride;
+    paramStride = *(param.args->getNext()->evaluate(param.thread));
+    stride = paramStride.getValue();
+  }
 
-ffi_type *FFIExternHdl::getFFIType(int type)
-{
-  // all CTRLFFI_<FOO>_PTR types are just pointers for libffi
-  if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+  if (paramColumns.getNumberOfItems() != layout.fields.size())
   {
-    return &ffi_type_pointer;
-  }
-
-  switch (type)
-  {
-    // normal types
-    case CTRLFFI_UCHAR:   return &ffi_type_uchar;
-    case CTRLFFI_CHAR:    return &ffi_type_schar;
-    case CTRLFFI_USHORT:  return &ffi_type_ushort;
-    case CTRLFFI_SHORT:   return &ffi_type_sshort;
-    case CTRLFFI_UINT:    return &ffi_type_uint;
-    case CTRLFFI_INT:     return &ffi_type_sint;
-    case CTRLFFI_ULONG:   return &ffi_type_ulong;
-    case CTRLFFI_LONG:    return &ffi_type_slong;
-    case CTRLFFI_FLOAT:   return &ffi_type_float;
-    case CTRLFFI_DOUBLE:  return &ffi_type_double;
-    // fixed length types
-    case CTRLFFI_UINT8:   return &ffi_type_uint8;
-    case CTRLFFI_INT8:    return &ffi_type_sint8;
-    case CTRLFFI_UINT16:  return &ffi_type_uint16;
-    case CTRLFFI_INT16:   return &ffi_type_sint16;
-    case CTRLFFI_UINT32:  return &ffi_type_uint32;
-    case CTRLFFI_INT32:   return &ffi_type_sint32;
-    case CTRLFFI_UINT64:  return &ffi_type_uint64;
-    case CTRLFFI_INT64:   return &ffi_type_sint64;
-    // special types
-    case CTRLFFI_STRING: // fall through
-    case CTRLFFI_POINTER: return &ffi_type_pointer;
-    case CTRLFFI_VOID:    return &ffi_type_void;
-
-    default: break; // TODO: error. invalid type.
+    // TODO: error. need exactly one column per field.
+    return;
   }
 
-  return 0;
-}
+  // all columns must have the same length
+  std::vector<DynVar *> columns;
+  unsigned int rowCount = 0;
 
-//------------------------------------------------------------------------------
+  for (unsigned int i = 1; i <= paramColumns.getNumberOfItems(); ++i)
+  {
+    Variable *column = paramColumns[i];
+    if (! column || ! column->isDynVar())
+    {
+      // TODO: error. column is not a dyn.
+      return;
+    }
 
-bool FFIExternHdl::isValidForRawMemoryOperation(int type)
-{
-  return (type > CTRLFFI_FIRST_VALUE_TYPE && type < CTRLFFI_LAST_VALUE_TYPE) ||
-          type == CTRLFFI_POINTER;
-}
+    DynVar *dynColumn = static_cast<DynVar *>(column);
+    if (i == 1)
+    {
+      rowCount = dynColumn->getNumberOfItems();
+    }
+    else if (dynColumn->getNumberOfItems() != rowCount)
+    {
+      // TODO: error. columns have different lengths.
+      return;
+    }
 
-//------------------------------------------------------------------------------
+    columns.push_back(dynColumn);
+  }
 
-Variable *FFIExternHdl::readAddress(int type, const char *buffer)
-{
-  std::auto_ptr<FFIValue> conversionObj;
-  conversionObj.reset(FFIValue::allocateValue(type));
+  // the records in a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && rowCount > 0 && (rowCount - 1) * stride + layout.size > allocation->size)
+  {
+    // TODO: error. the records exceed the buffer.
+    return;
+  }
 
-  if (conversionObj.get())
+  for (unsigned int row = 0; row < rowCount; ++row)
   {
-    Variable *resultVar = conversionObj->allocateCtrlVar();
+    char *record = buffer + row * stride;
 
-    if (resultVar)
+    for (size_t i = 0; i < layout.fields.size(); ++i)
     {
-      conversionObj->readValueFromRawMemory(*resultVar, buffer);
-      return resultVar;
+      const StructField &field = layout.fields[i];
+      writeValue(*field.converter, *((*columns[i])[row + 1]), record + field.offset,
+                 field.size, field.byteSwap);
     }
   }
-
-  return 0;
 }
 
 //------------------------------------------------------------------------------
 
-/// Writes from a Ctrl var to a pointer
-void FFIExternHdl::writeAddress(int type, char *buffer, const Variable &var)
+// Ctrl: ulong ffiFillBufferWithDynString(dyn_string texts, string tag = "")
+PVSSulonglong FFIExternHdl::ffiFillBufferWithDynString(ExecuteParamRec &param)
 {
-  std::auto_ptr<FFIValue> conversionObj;
-  conversionObj.reset(FFIValue::allocateValue(type));
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  const Variable *paramTexts = param.args->getFirst()->evaluate(param.thread);
+  if (! paramTexts || ! paramTexts->isDynVar())
+  {
+    // TODO: error. not a dyn.
+    return 0;
+  }
 
-  if (conversionObj.get())
+  TextVar paramTag;
+  if (param.args->getNumberOfItems() > 1)
   {
-    conversionObj->writeValueToRawMemory(var, buffer);
+    paramTag = *(param.args->getNext()->evaluate(param.thread));
   }
+
+  const DynVar &texts = static_cast<const DynVar &>(*paramTexts);
+
+  // the table and the texts in one buffer, which is released by a single
+  // ffiFreeBuffer(). malloc() aligns it for the pointers.
+  size_t size = FFIStringArray::getPackedSize(texts);
+  char *buffer = static_cast<char *>(malloc(size));
+  if (! buffer)
+  {
+    // TODO: error. out of memory.
+    return 0;
+  }
+
+  FFIStringArray::pack(texts, buffer);
+
+  if (memoryTracker.isEnabled())
+  {
+    CharString location = param.thread->getLocation();
+    memoryTracker.add(buffer, size, paramTag.getValue(), location);
+  }
+
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(buffer);
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiFillBufferWithMatrix(ulong ptr, int itemtype, dyn_dyn_anytype matrix [, bool colMajor [, uint leadingDim] ] )
+void FFIExternHdl::ffiFillBufferWithMatrix(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  IntegerVar paramItemType;
+  paramItemType = *(param.args->getNext()->evaluate(param.thread));
+
+  const Variable *paramMatrix = param.args->getNext()->evaluate(param.thread);
+
+  bool colMajor = false;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    BitVar paramColMajor;
+    paramColMajor = *(param.args->getNext()->evaluate(param.thread));
+    colMajor = paramColMajor.isTrue();
+  }
+
+  size_t leadingDim = 0;
+  if (param.args->getNumberOfItems() > 4)
+  {
+    UIntegerVar paramLeadingDim;
+    paramLeadingDim = *(param.args->getNext()->evaluate(param.thread));
+    leadingDim = paramLeadingDim.getValue();
+  }
+
+  if (paramPtr.getValue() == 0)
+  {
+    // TODO: error. null pointer.
+    return;
+  }
+
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
+  {
+    // TODO: error. invalid type.
+    return;
+  }
+
+  if (! paramMatrix || ! paramMatrix->isDynVar())
+  {
+    // TODO: error. not a dyn_dyn.
+    return;
+  }
+
+  // all rows must have the same length
+  const DynVar &matrix = static_cast<const DynVar &>(*paramMatrix);
+  size_t rows = matrix.getNumberOfItems();
+  size_t cols = 0;
+
+  for (unsigned int r = 1; r <= rows; ++r)
+  {
+    if (! matrix[r] || ! matrix[r]->isDynVar() ||
+        (r > 1 && static_cast<const DynVar *>(matrix[r])->getNumberOfItems() != cols))
+    {
+      // TODO: error. rows of different length.
+      return;
+    }
+
+    cols = static_cast<const DynVar *>(matrix[r])->getNumberOfItems();
+  }
+
+  std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  char *buffer = reinterpret_cast<char *>(ptrValue);
+
+  size_t size = getFFIType(itemType)->size;
+  bool byteSwap = needsByteSwap(paramItemType.getValue());
+
+  if (! checkMatrix(buffer, rows, cols, size, colMajor, leadingDim))
+  {
+    // TODO: error. invalid leading dimension, or the matrix exceeds the buffer.
+    return;
+  }
+
+  if (rows == 0 || cols == 0)
+  {
+    return;
+  }
+
+  // a column-major matrix is converted row by row first, and transposed
+  // into the buffer afterwards, so that both passes write sequentially
+  std::vector<char> packed;
+  char *target = buffer;
+  size_t rowStride = leadingDim;
+  if (colMajor)
+  {
+    packed.resize(rows * cols * size);
+    target = &packed[0];
+    rowStride = cols;
+  }
+
+  for (size_t r = 0; r < rows; ++r)
+  {
+    const DynVar &row = static_cast<const DynVar &>(*matrix[(unsigned int) r + 1]);
+
+    char *item = target + r * rowStride * size;
+    for (unsigned int c = 1; c <= cols; ++c, item += size)
+    {
+      if (colMajor)
+      {
+        converter->writeValueToRawMemory(*row[c], item);
+      }
+      else
+      {
+        writeValue(*converter, *row[c], item, size, byteSwap);
+      }
+    }
+  }
+
+  if (colMajor)
+  {
+    if (byteSwap)
+    {
+      FFIKernels::swapBytes(&packed[0], size, rows * cols);
+    }
+
+    FFIKernels::transpose(buffer, leadingDim, &packed[0], cols, rows, cols, size);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: long ffiBufferFind(ulong ptr, ulong len, anytype pattern)
+PVSSlonglong FFIExternHdl::ffiBufferFind(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer || param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. invalid arguments.
+    return -1;
+  }
+
+  const Variable *paramPattern = param.args->getNext()->evaluate(param.thread);
+  if (! paramPattern)
+  {
+    // TODO: error
+    return -1;
+  }
+
+  // the pattern is either a string, or a dyn with the values of its bytes
+  std::vector<char> pattern;
+
+  if (paramPattern->isDynVar())
+  {
+    DynVar patternBytes;
+    patternBytes = *paramPattern;
+
+    pattern.reserve(patternBytes.getNumberOfItems());
+    for (unsigned int i = 1; i <= patternBytes.getNumberOfItems(); ++i)
+    {
+      UIntegerVar byteValue;
+      byteValue = *(patternBytes[i]);
+      pattern.push_back((char) (byteValue.getValue() & 0xff));
+    }
+  }
+  else
+  {
+    TextVar patternText;
+    patternText = *paramPattern;
+    pattern.assign(patternText.getValue(), patternText.getValue() + strlen(patternText.getValue()));
+  }
+
+  size_t offset = FFIKernels::find(buffer, size, pattern.empty() ? 0 : &pattern[0], pattern.size());
+
+  return (offset == FFIKernels::NOT_FOUND) ? -1 : (PVSSlonglong) offset;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: long ffiBufferFindByte(ulong ptr, ulong len, uint value)
+PVSSlonglong FFIExternHdl::ffiBufferFindByte(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer || param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. invalid arguments.
+    return -1;
+  }
+
+  UIntegerVar paramValue;
+  paramValue = *(param.args->getNext()->evaluate(param.thread));
+
+  size_t offset = FFIKernels::findByte(buffer, size, (unsigned char) (paramValue.getValue() & 0xff));
+
+  return (offset == FFIKernels::NOT_FOUND) ? -1 : (PVSSlonglong) offset;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: uint ffiBufferCrc32(ulong ptr, ulong len)
+unsigned int FFIExternHdl::ffiBufferCrc32(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer)
+  {
+    // TODO: error. invalid arguments.
+    return 0;
+  }
+
+  return FFIKernels::crc32(buffer, size);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: uint ffiBufferCrc32C(ulong ptr, ulong len)
+unsigned int FFIExternHdl::ffiBufferCrc32C(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer)
+  {
+    // TODO: error. invalid arguments.
+    return 0;
+  }
+
+  return FFIKernels::crc32c(buffer, size);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: uint ffiBufferCrc16Modbus(ulong ptr, ulong len)
+unsigned int FFIExternHdl::ffiBufferCrc16Modbus(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer)
+  {
+    // TODO: error. invalid arguments.
+    return 0;
+  }
+
+  return FFIKernels::crc16Modbus(buffer, size);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiBufferHash(ulong ptr, ulong len, ulong seed = 0)
+PVSSulonglong FFIExternHdl::ffiBufferHash(ExecuteParamRec &param)
+{
+  size_t size = 0;
+  const char *buffer = getBufferArgs(param, size);
+
+  if (! buffer)
+  {
+    // TODO: error. invalid arguments.
+    return 0;
+  }
+
+  ULongVar paramSeed(0);
+  if (param.args->getNumberOfItems() > 2)
+  {
+    paramSeed = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  return FFIKernels::hash64(buffer, size, paramSeed.getValue());
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiBufferReduce(ulong ptr, int itemtype, uint count, uint stride, uint ops [, float above [, float below] ] )
+MappingVar *FFIExternHdl::ffiBufferReduce(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 5)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  IntegerVar paramItemType;
+  paramItemType = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramCount;
+  paramCount = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramStride;
+  paramStride = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramOps;
+  paramOps = *(param.args->getNext()->evaluate(param.thread));
+
+  FloatVar paramAbove(0.0);
+  if (param.args->getNumberOfItems() > 5)
+  {
+    paramAbove = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  FloatVar paramBelow(0.0);
+  if (param.args->getNumberOfItems() > 6)
+  {
+    paramBelow = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  if (paramPtr.getValue() == 0)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  size_t count = paramCount.getValue();
+  size_t size = getFFIType(itemType)->size;
+  bool byteSwap = needsByteSwap(paramItemType.getValue());
+  unsigned int ops = paramOps.getValue();
+
+  // the items are packed, unless a stride is given
+  size_t stride = (paramStride.getValue() != 0) ? paramStride.getValue() : size;
+  if (stride < size)
+  {
+    // TODO: error. the items overlap.
+    return 0;
+  }
+
+  // the items in a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && count > 0 && (count - 1) * stride + size > allocation->size)
+  {
+    // TODO: error. the items exceed the buffer.
+    return 0;
+  }
+
+  FFIKernels::Reduction reduction;
+  if (! FFIKernels::reduce(buffer, count, stride, itemType, byteSwap,
+                           paramAbove.getValue(), paramBelow.getValue(),
+                           (ops & CTRLFFI_REDUCE_VARIANCE) != 0, reduction))
+  {
+    // TODO: error. the type is not numeric.
+    return 0;
+  }
+
+  MappingVar *result = new MappingVar();
+
+  if (ops & CTRLFFI_REDUCE_SUM)
+  {
+    result->setAt(new TextVar("sum"), new FloatVar(reduction.sum));
+  }
+
+  if ((ops & CTRLFFI_REDUCE_MEAN) && count > 0)
+  {
+    result->setAt(new TextVar("mean"), new FloatVar(reduction.sum / count));
+  }
+
+  if ((ops & CTRLFFI_REDUCE_VARIANCE) && count > 0)
+  {
+    result->setAt(new TextVar("variance"), new FloatVar(reduction.squaredDeviations / count));
+  }
+
+  // the minimum and the maximum are read again from the buffer, so that they
+  // have the type of the items and are exact even for 64 bit integers
+  if (ops & (CTRLFFI_REDUCE_MIN | CTRLFFI_REDUCE_MAX))
+  {
+    std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+
+    if ((ops & CTRLFFI_REDUCE_MIN) && reduction.minIndex != FFIKernels::NOT_FOUND)
+    {
+      Variable *min = converter->allocateCtrlVar();
+      readValue(*converter, *min, buffer + reduction.minIndex * stride, size, byteSwap);
+      result->setAt(new TextVar("min"), min);
+    }
+
+    if ((ops & CTRLFFI_REDUCE_MAX) && reduction.maxIndex != FFIKernels::NOT_FOUND)
+    {
+      Variable *max = converter->allocateCtrlVar();
+      readValue(*converter, *max, buffer + reduction.maxIndex * stride, size, byteSwap);
+      result->setAt(new TextVar("max"), max);
+    }
+  }
+
+  // the indexes are one-based like a dyn, 0 if only NaNs were found
+  if (ops & CTRLFFI_REDUCE_ARGMIN)
+  {
+    size_t index = (reduction.minIndex != FFIKernels::NOT_FOUND) ? reduction.minIndex + 1 : 0;
+    result->setAt(new TextVar("argmin"), new UIntegerVar(index));
+  }
+
+  if (ops & CTRLFFI_REDUCE_ARGMAX)
+  {
+    size_t index = (reduction.maxIndex != FFIKernels::NOT_FOUND) ? reduction.maxIndex + 1 : 0;
+    result->setAt(new TextVar("argmax"), new UIntegerVar(index));
+  }
+
+  if (ops & CTRLFFI_REDUCE_ABOVE)
+  {
+    result->setAt(new TextVar("above"), new UIntegerVar(reduction.above));
+  }
+
+  if (ops & CTRLFFI_REDUCE_BELOW)
+  {
+    result->setAt(new TextVar("below"), new UIntegerVar(reduction.below));
+  }
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: anytype ffiReadFromPointer(ulong ptr, int type)
+Variable *FFIExternHdl::ffiReadFromPointer(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  IntegerVar paramType;
+  paramType = *(param.args->getNext()->evaluate(param.thread));
+
+  const FFITypeTraits &traits = FFITypeTraits::get(getMemoryBaseType(paramType.getValue()));
+  if (! traits.read)
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  Variable *newValue = traits.allocateCtrlVar();
+  readAddress(paramType.getValue(), buffer, *newValue);
+
+  return newValue;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiReadFromPointer(ulong ptr, int type, anytype &target)
+bool FFIExternHdl::ffiReadFromPointerToTarget(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error
+    return false;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  IntegerVar paramType;
+  paramType = *(param.args->getNext()->evaluate(param.thread));
+
+  Variable *target = param.args->getNext()->getTarget(param.thread);
+  if (! target)
+  {
+    // TODO: error. not a variable.
+    return false;
+  }
+
+  // the value is converted into the variable of the caller, which allocates
+  // nothing if it already has the Ctrl type of the value
+  if (! readAddress(paramType.getValue(), buffer, *target))
+  {
+    // TODO: error. invalid type.
+    return false;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiWriteToPointer(ulong ptr, int type, anytype value)
+void FFIExternHdl::ffiWriteToPointer(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error
+    return;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  char *buffer = reinterpret_cast<char *>(ptrValue);
+
+  IntegerVar paramType;
+  paramType = *(param.args->getNext()->evaluate(param.thread));
+
+  const Variable *paramValue = param.args->getNext()->evaluate(param.thread);
+
+  if (! writeAddress(paramType.getValue(), buffer, *paramValue))
+  {
+    // TODO: error. invalid type.
+    return;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiSharedMemoryCreate(string name, ulong bytes)
+PVSSulonglong FFIExternHdl::ffiSharedMemoryCreate(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  TextVar paramName;
+  paramName = *(param.args->getFirst()->evaluate(param.thread));
+
+  ULongVar paramBytes;
+  paramBytes = *(param.args->getNext()->evaluate(param.thread));
+
+  FFISharedMemory *region = FFISharedMemory::create(paramName.getValue(),
+                                                    static_cast<size_t>(paramBytes.getValue()));
+  if (! region)
+  {
+    // TODO: error. could not create the region.
+    return 0;
+  }
+
+  DEBUG_PRINT(dbgFlag, "Created shared memory " << paramName.getValue() << " with " << region->getSize() << " bytes");
+
+  sharedMemories.push_back(region);
+
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(region->getAddress());
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiSharedMemoryOpen(string name)
+PVSSulonglong FFIExternHdl::ffiSharedMemoryOpen(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  TextVar paramName;
+  paramName = *(param.args->getFirst()->evaluate(param.thread));
+
+  FFISharedMemory *region = FFISharedMemory::open(paramName.getValue());
+  if (! region)
+  {
+    // TODO: error. region does not exist.
+    return 0;
+  }
+
+  DEBUG_PRINT(dbgFlag, "Opened shared memory " << paramName.getValue() << " with " << region->getSize() << " bytes");
+
+  sharedMemories.push_back(region);
+
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(region->getAddress());
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiSharedMemoryClose(ulong ptr, bool unlink = false)
+void FFIExternHdl::ffiSharedMemoryClose(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  bool unlink = false;
+  if (param.args->getNumberOfItems() > 1)
+  {
+    BitVar paramUnlink;
+    paramUnlink = *(param.args->getNext()->evaluate(param.thread));
+    unlink = paramUnlink.isTrue();
+  }
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  void *address = reinterpret_cast<void *>(ptrValue);
+
+  for (std::vector<FFISharedMemory *>::iterator it = sharedMemories.begin();
+       it != sharedMemories.end(); ++it)
+  {
+    if ((*it)->getAddress() == address)
+    {
+      if (unlink)
+      {
+        (*it)->unlink();
+      }
+
+      delete *it;
+      sharedMemories.erase(it);
+      return;
+    }
+  }
+
+  // TODO: error. not a shared memory region.
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiQueueCreate(uint itemSize, uint capacity)
+PVSSulonglong FFIExternHdl::ffiQueueCreate(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  UIntegerVar paramItemSize;
+  paramItemSize = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramCapacity;
+  paramCapacity = *(param.args->getNext()->evaluate(param.thread));
+
+  FFIQueue *queue = FFIQueue::create(paramItemSize.getValue(), paramCapacity.getValue());
+  if (! queue)
+  {
+    // TODO: error. invalid size or capacity.
+    return 0;
+  }
+
+  queues.push_back(queue);
+
+  // the queue handle is also the context argument for ffiQueuePush()
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(queue);
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiQueueDestroy(ulong queue)
+void FFIExternHdl::ffiQueueDestroy(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramQueue;
+  paramQueue = *(param.args->getFirst()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramQueue.getValue());
+  FFIQueue *queue = reinterpret_cast<FFIQueue *>(ptrValue);
+
+  for (std::vector<FFIQueue *>::iterator it = queues.begin(); it != queues.end(); ++it)
+  {
+    if (*it == queue)
+    {
+      delete *it;
+      queues.erase(it);
+      return;
+    }
+  }
+
+  // TODO: error. not a queue.
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiQueueGetPushFunction()
+PVSSulonglong FFIExternHdl::ffiQueueGetPushFunction(ExecuteParamRec &)
+{
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(&ffiQueuePush);
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: dyn_dyn_anytype ffiQueuePopBatch(ulong queue, dyn_int fieldtypes, uint maxItems)
+DynVar *FFIExternHdl::ffiQueuePopBatch(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramQueue;
+  paramQueue = *(param.args->getFirst()->evaluate(param.thread));
+
+  FFIQueue *queue = findQueue(paramQueue.getValue());
+  if (! queue)
+  {
+    // TODO: error. not a queue.
+    return 0;
+  }
+
+  DynVar paramFields;
+  paramFields = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramMaxItems;
+  paramMaxItems = *(param.args->getNext()->evaluate(param.thread));
+
+  // the struct must fit into an item, otherwise we would read past it
+  StructLayout layout;
+  if (! getStructLayout(paramFields, layout) || layout.size > queue->getItemSize())
+  {
+    // TODO: error. invalid struct layout.
+    return 0;
+  }
+
+  std::auto_ptr<DynVar> result(new DynVar(DYNANYTYPE_VAR));
+  std::vector<char> item(queue->getItemSize());
+
+  for (unsigned int i = 0; i < paramMaxItems.getValue() && queue->pop(&item[0]); ++i)
+  {
+    DynVar *fields = readStruct(layout, &item[0]);
+    if (! fields)
+    {
+      // TODO: error. failed to convert the item. the items before it were
+      // already popped, so they are returned anyway.
+      break;
+    }
+
+    result->append(fields);
+  }
+
+  return result.release();
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiQueueGetStats(ulong queue)
+MappingVar *FFIExternHdl::ffiQueueGetStats(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramQueue;
+  paramQueue = *(param.args->getFirst()->evaluate(param.thread));
+
+  const FFIQueue *queue = findQueue(paramQueue.getValue());
+  if (! queue)
+  {
+    // TODO: error. not a queue.
+    return 0;
+  }
+
+  MappingVar *stats = new MappingVar();
+  stats->setAt(new TextVar("itemsize"),  new UIntegerVar((unsigned int) queue->getItemSize()));
+  stats->setAt(new TextVar("capacity"),  new UIntegerVar((unsigned int) queue->getCapacity()));
+  stats->setAt(new TextVar("depth"),     new UIntegerVar((unsigned int) queue->getDepth()));
+  stats->setAt(new TextVar("highwater"), new UIntegerVar((unsigned int) queue->getHighWaterMark()));
+  stats->setAt(new TextVar("pushed"),    new ULongVar(queue->getPushCount()));
+  stats->setAt(new TextVar("popped"),    new ULongVar(queue->getPopCount()));
+  stats->setAt(new TextVar("drops"),     new ULongVar(queue->getDropCount()));
+
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiIsolateLibrary(string libPath, string hostExecutable = "CtrlFFIHost", uint callTimeoutMs = 30000)
+bool FFIExternHdl::ffiIsolateLibrary(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  TextVar paramLibPath;
+  paramLibPath = *(param.args->getFirst()->evaluate(param.thread));
+
+  TextVar paramHostExecutable("CtrlFFIHost");
+  if (param.args->getNumberOfItems() > 1)
+  {
+    paramHostExecutable = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  UIntegerVar paramCallTimeout(FFIRemoteHost::DEFAULT_CALL_TIMEOUT);
+  if (param.args->getNumberOfItems() > 2)
+  {
+    paramCallTimeout = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  if (findRemoteHost(paramLibPath.getValue()))
+  {
+    // already isolated
+    return true;
+  }
+
+  // functions which are already declared would keep running in this process
+  for (std::vector<FunctionSlot>::const_iterator it = functions.begin(); it != functions.end(); ++it)
+  {
+    if (it->function && it->function->libName == paramLibPath.getString())
+    {
+      // TODO: error. library already in use.
+      return false;
+    }
+  }
+
+#ifdef _WIN32
+  // TODO: error. not supported on Windows yet.
+  return false;
+#else
+  // the host is started when the first function is declared
+  remoteHosts.push_back(new FFIRemoteHost(paramLibPath.getValue(), paramHostExecutable.getValue(),
+                                          (int) paramCallTimeout.getValue()));
+
+  DEBUG_PRINT(dbgFlag, "Isolated library " << paramLibPath.getValue());
+
+  return true;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiStartSampler(uint funcId, uint intervalMs, anytype paramvalue1, ...)
+PVSSulonglong FFIExternHdl::ffiStartSampler(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  UIntegerVar paramFuncId;
+  paramFuncId = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramInterval;
+  paramInterval = *(param.args->getNext()->evaluate(param.thread));
+
+  const FFIFunction *func = findFunction(paramFuncId.getValue());
+  if (! func)
+  {
+    // TODO: error. invalid function id.
+    return 0;
+  }
+
+  // the text of a returned string might be gone before it is read, and the
+  // host of an isolated library can only be used from the Ctrl thread
+  if (func->returnType == CTRLFFI_STRING || func->returnType == CTRLFFI_STRING_ARRAY || func->remoteHost)
+  {
+    // TODO: error. function cannot be sampled.
+    return 0;
+  }
+
+  // the memory returned through out slots would have to be freed per call
+  for (std::vector<IntegralType>::const_iterator it = func->argTypes.begin(); it != func->argTypes.end(); ++it)
+  {
+    if (isOutputOnly(*it))
+    {
+      // TODO: error. function cannot be sampled.
+      return 0;
+    }
+  }
+
+  size_t argCount = func->argTypes.size();
+  if (param.args->getNumberOfItems() < 2 + argCount || paramInterval.getValue() == 0)
+  {
+    // TODO: error. invalid arguments.
+    return 0;
+  }
+
+  std::auto_ptr<SamplerEntry> entry(new SamplerEntry());
+  entry->function = func;
+  entry->argValues.resize(argCount);
+
+  std::vector<FFISampler::Capture> captures;
+
+  // index 0 is the return value, index 1 to <argCount> are the arguments.
+  // the arguments are converted once, and the return value and the output
+  // arguments are captured after each call.
+  for (size_t i = 0; i <= argCount; ++i)
+  {
+    int type = (i == 0) ? func->returnType : func->argTypes[i - 1];
+
+    FFIValue *value = FFIValue::allocateValue(type);
+    if (! value)
+    {
+      // TODO: error. shouldn't happen.
+      return 0;
+    }
+
+    entry->values.push_back(value);
+
+    if (i > 0)
+    {
+      if (func->argDirections[i - 1] & CTRLFFI_DIR_IN)
+      {
+        const Variable *paramArgVar = param.args->getNext()->evaluate(param.thread);
+        if (! paramArgVar)
+        {
+          // TODO: error
+          return 0;
+        }
+
+        value->setValue(*paramArgVar);
+      }
+      else
+      {
+        param.args->getNext();
+      }
+
+      entry->argValues[i - 1] = value->getPtr();
+    }
+
+    bool isOutput = (i == 0) ? (type != CTRLFFI_VOID)
+                             : ((func->argDirections[i - 1] & CTRLFFI_DIR_OUT) != 0);
+    if (! isOutput)
+    {
+      continue;
+    }
+
+    // output arguments are pointers to the captured value
+    FFISampler::Capture capture;
+    if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+    {
+      capture.address = *static_cast<void **>(value->getPtr());
+      capture.size = getFFIType(type - CTRLFFI_FIRST_PTR + CTRLFFI_FIRST_VALUE_TYPE)->size;
+    }
+    else
+    {
+      capture.address = value->getPtr();
+      capture.size = getFFIType(type)->size;
+    }
+
+    captures.push_back(capture);
+    entry->captureConverters.push_back(value);
+    entry->captureSizes.push_back(capture.size);
+  }
+
+  entry->sampler = new FFISampler(const_cast<ffi_cif *>(&(func->callInterface)), func->funcPtr,
+                                  entry->values[0]->getPtr(), argCount ? &(entry->argValues[0]) : 0,
+                                  captures, paramInterval.getValue(), SAMPLER_CAPACITY);
+
+  if (! entry->sampler->start())
+  {
+    // TODO: error. could not create the thread.
+    return 0;
+  }
+
+  DEBUG_PRINT(dbgFlag, "Started sampler for function " << func->funcName << " every " << paramInterval.getValue() << " ms");
+
+  samplers.push_back(entry.release());
+
+  uintptr_t ptrValue = reinterpret_cast<uintptr_t>(samplers.back());
+  return static_cast<PVSSulonglong>(ptrValue);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiReadSamples(ulong samplerId, ulong sinceIndex)
+MappingVar *FFIExternHdl::ffiReadSamples(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramSampler;
+  paramSampler = *(param.args->getFirst()->evaluate(param.thread));
+
+  ULongVar paramSince;
+  paramSince = *(param.args->getNext()->evaluate(param.thread));
+
+  const SamplerEntry *entry = findSampler(paramSampler.getValue());
+  if (! entry)
+  {
+    // TODO: error. not a sampler.
+    return 0;
+  }
+
+  std::vector<char> records;
+  size_t first = 0;
+  size_t since = static_cast<size_t>(paramSince.getValue());
+  size_t next = entry->sampler->read(since, records, first);
+
+  size_t recordSize = entry->sampler->getRecordSize();
+  size_t count = records.size() / recordSize;
+
+  std::auto_ptr<DynVar> times(new DynVar(TIME_VAR));
+  std::auto_ptr<DynVar> values(new DynVar(DYNANYTYPE_VAR));
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const char *record = &records[i * recordSize];
+
+    long long timestamp;
+    memcpy(&timestamp, record, sizeof(timestamp));
+    record += sizeof(timestamp);
+
+    times->append(new TimeVar((PVSSlong) (timestamp / 1000), (short) (timestamp % 1000)));
+
+    DynVar *recordValues = new DynVar();
+    for (size_t j = 0; j < entry->captureConverters.size(); ++j)
+    {
+      Variable *value = entry->captureConverters[j]->allocateCtrlVar();
+      entry->captureConverters[j]->readValueFromRawMemory(*value, record);
+      recordValues->append(value);
+
+      record += entry->captureSizes[j];
+    }
+
+    values->append(recordValues);
+  }
+
+  MappingVar *result = new MappingVar();
+  result->setAt(new TextVar("next"),   new ULongVar(next));
+  result->setAt(new TextVar("lost"),   new ULongVar(first > since ? first - since : 0));
+  result->setAt(new TextVar("times"),  times.release());
+  result->setAt(new TextVar("values"), values.release());
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiStopSampler(ulong samplerId)
+void FFIExternHdl::ffiStopSampler(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramSampler;
+  paramSampler = *(param.args->getFirst()->evaluate(param.thread));
+
+  SamplerEntry *entry = findSampler(paramSampler.getValue());
+  if (! entry)
+  {
+    // TODO: error. not a sampler.
+    return;
+  }
+
+  samplers.erase(std::find(samplers.begin(), samplers.end(), entry));
+  delete entry;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiGetSamplerStats(ulong samplerId)
+MappingVar *FFIExternHdl::ffiGetSamplerStats(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramSampler;
+  paramSampler = *(param.args->getFirst()->evaluate(param.thread));
+
+  const SamplerEntry *entry = findSampler(paramSampler.getValue());
+  if (! entry)
+  {
+    // TODO: error. not a sampler.
+    return 0;
+  }
+
+  const FFISampler *sampler = entry->sampler;
+
+  MappingVar *stats = new MappingVar();
+  stats->setAt(new TextVar("interval"),     new UIntegerVar(sampler->getInterval()));
+  stats->setAt(new TextVar("calls"),        new ULongVar(sampler->getCallCount()));
+  stats->setAt(new TextVar("overruns"),     new ULongVar(sampler->getOverrunCount()));
+  stats->setAt(new TextVar("maxjitter"),    new ULongVar(sampler->getMaxJitter()));
+  stats->setAt(new TextVar("meanjitter"),   new ULongVar(sampler->getMeanJitter()));
+  stats->setAt(new TextVar("maxduration"),  new ULongVar(sampler->getMaxDuration()));
+  stats->setAt(new TextVar("lastduration"), new ULongVar(sampler->getLastDuration()));
+
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiStartRecording(string path)
+bool FFIExternHdl::ffiStartRecording(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  TextVar paramPath;
+  paramPath = *(param.args->getFirst()->evaluate(param.thread));
+
+  // a running recording is closed first
+  delete recorder;
+  recorder = new FFIRecorder();
+
+  if (! recorder->open(paramPath.getValue()))
+  {
+    // TODO: error. cannot create the file.
+    delete recorder;
+    recorder = 0;
+    return false;
+  }
+
+  DEBUG_PRINT(dbgFlag, "Recording calls to " << paramPath.getValue());
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiStopRecording()
+MappingVar *FFIExternHdl::ffiStopRecording(ExecuteParamRec &param)
+{
+  MappingVar *stats = new MappingVar();
+  if (! recorder)
+  {
+    return stats;
+  }
+
+  recorder->close();
+
+  stats->setAt(new TextVar("calls"), new ULongVar(recorder->getCallCount()));
+  stats->setAt(new TextVar("bytes"), new ULongVar(recorder->getByteCount()));
+  // false if a write error stopped the recording early
+  stats->setAt(new TextVar("complete"), new BitVar(! recorder->hasFailed()));
+
+  delete recorder;
+  recorder = 0;
+
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiSetProfiling(bool perfMap, bool traceLocation = false)
+bool FFIExternHdl::ffiSetProfiling(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  BitVar paramPerfMap;
+  paramPerfMap = *(param.args->getFirst()->evaluate(param.thread));
+
+  BitVar paramTraceLocation(PVSS_FALSE);
+  if (param.args->getNumberOfItems() > 1)
+  {
+    paramTraceLocation = *(param.args->getNext()->evaluate(param.thread));
+  }
+
+  traceLocations = (paramTraceLocation.getValue() != PVSS_FALSE);
+
+  if (! paramPerfMap.getValue())
+  {
+    perfMap.close();
+    return true;
+  }
+
+  if (perfMap.isOpen())
+  {
+    return true;
+  }
+
+  if (! perfMap.open())
+  {
+    // TODO: error. cannot create the map, or not supported on this platform.
+    return false;
+  }
+
+  // the functions declared so far, the later ones are added by addFunction()
+  for (unsigned int i = 0; i < functions.size(); ++i)
+  {
+    if (functions[i].function)
+    {
+      addToPerfMap((functions[i].generation << FUNCTION_SLOT_BITS) | (i + 1), functions[i].function);
+    }
+  }
+
+  DEBUG_PRINT(dbgFlag, "Writing the perf map");
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiCreateView(ulong ptr, anytype itemtype, uint count [, uint stride] )
+PVSSulonglong FFIExternHdl::ffiCreateView(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  const Variable *paramItemType = param.args->getNext()->evaluate(param.thread);
+
+  UIntegerVar paramCount;
+  paramCount = *(param.args->getNext()->evaluate(param.thread));
+
+  if (paramPtr.getValue() == 0 || ! paramItemType)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  // the item type is either a single type, or the field types of a struct
+  bool isStruct = paramItemType->isDynVar();
+  DynVar fieldTypes;
+
+  if (isStruct)
+  {
+    fieldTypes = *paramItemType;
+  }
+  else
+  {
+    IntegerVar itemType;
+    itemType = *paramItemType;
+
+    if (! isValidForRawMemoryOperation(getMemoryBaseType(itemType.getValue())))
+    {
+      // TODO: error. invalid type.
+      return 0;
+    }
+
+    fieldTypes.append(new IntegerVar(itemType.getValue()));
+  }
+
+  // the items are packed, unless a stride is given
+  size_t stride = 0;
+  bool defaultStride = (param.args->getNumberOfItems() < 4);
+  if (! defaultStride)
+  {
+    UIntegerVar paramStride;
+    paramStride = *(param.args->getNext()->evaluate(param.thread));
+    stride = paramStride.getValue();
+  }
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+
+  return addView(reinterpret_cast<const char *>(ptrValue), fieldTypes, isStruct,
+                 paramCount.getValue(), stride, defaultStride);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: anytype ffiViewGet(ulong view, uint index [, uint field] )
+Variable *FFIExternHdl::ffiViewGet(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramView;
+  paramView = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramIndex;
+  paramIndex = *(param.args->getNext()->evaluate(param.thread));
+
+  const BufferView *view = findView(paramView.getValue());
+  if (! view)
+  {
+    // TODO: error. not a view.
+    return 0;
+  }
+
+  // indices are one-based, like the items of a dyn from ffiBufferToDyn
+  size_t index = paramIndex.getValue();
+  if (index < 1 || index > view->count)
+  {
+    // TODO: error. index out of range.
+    return 0;
+  }
+
+  const char *item = view->buffer + (index - 1) * view->stride;
+
+  // a whole struct, unless a field is given
+  size_t field = 1;
+  if (param.args->getNumberOfItems() > 2)
+  {
+    UIntegerVar paramField;
+    paramField = *(param.args->getNext()->evaluate(param.thread));
+    field = paramField.getValue();
+  }
+  else if (view->isStruct)
+  {
+    return readStruct(view->layout, item);
+  }
+
+  if (field < 1 || field > view->layout.fields.size())
+  {
+    // TODO: error. field out of range.
+    return 0;
+  }
+
+  const StructField &structField = view->layout.fields[field - 1];
+
+  Variable *value = structField.converter->allocateCtrlVar();
+  if (value)
+  {
+    readValue(*structField.converter, *value, item + structField.offset, structField.size, structField.byteSwap);
+  }
+
+  return value;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiViewSlice(ulong view, uint first, uint count)
+PVSSulonglong FFIExternHdl::ffiViewSlice(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramView;
+  paramView = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramFirst;
+  paramFirst = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramCount;
+  paramCount = *(param.args->getNext()->evaluate(param.thread));
+
+  const BufferView *view = findView(paramView.getValue());
+  if (! view)
+  {
+    // TODO: error. not a view.
+    return 0;
+  }
+
+  size_t first = paramFirst.getValue();
+  size_t count = paramCount.getValue();
+  if (first < 1 || first - 1 > view->count || count > view->count - (first - 1))
+  {
+    // TODO: error. slice out of range.
+    return 0;
+  }
+
+  return addView(view->buffer + (first - 1) * view->stride, view->fieldTypes, view->isStruct,
+                 count, view->stride, false);
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: uint ffiViewFind(ulong view, uint field, anytype value [, uint start] )
+unsigned int FFIExternHdl::ffiViewFind(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramView;
+  paramView = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramField;
+  paramField = *(param.args->getNext()->evaluate(param.thread));
+
+  const Variable *paramValue = param.args->getNext()->evaluate(param.thread);
+
+  size_t start = 1;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    UIntegerVar paramStart;
+    paramStart = *(param.args->getNext()->evaluate(param.thread));
+    start = paramStart.getValue();
+  }
+
+  const BufferView *view = findView(paramView.getValue());
+  size_t field = paramField.getValue();
+  if (! view || ! paramValue || field < 1 || field > view->layout.fields.size())
+  {
+    // TODO: error. invalid view or field.
+    return 0;
+  }
+
+  const StructField &structField = view->layout.fields[field - 1];
+  if (! isValidForRawMemoryOperation(structField.type) || start < 1 || start > view->count)
+  {
+    // TODO: error. field cannot be compared, or start out of range.
+    return 0;
+  }
+
+  // convert the value once to its representation in memory, so that the
+  // items can be compared without creating Ctrl variables
+  PVSSulonglong needle = 0;
+  writeValue(*structField.converter, *paramValue, reinterpret_cast<char *>(&needle),
+             structField.size, structField.byteSwap);
+
+  const char *item = view->buffer + (start - 1) * view->stride + structField.offset;
+  size_t count = view->count - (start - 1);
+  unsigned int found = 0;
+
+  switch (structField.size)
+  {
+    case 1:
+      if (view->stride == 1)
+      {
+        size_t offset = FFIKernels::findByte(item, count, *reinterpret_cast<unsigned char *>(&needle));
+        found = (offset == FFIKernels::NOT_FOUND) ? 0 : (unsigned int) (offset + 1);
+      }
+      else
+      {
+        found = findValue<uint8_t>(item, count, view->stride, &needle);
+      }
+      break;
+    case 2: found = findValue<uint16_t>(item, count, view->stride, &needle); break;
+    case 4: found = findValue<uint32_t>(item, count, view->stride, &needle); break;
+    case 8: found = findValue<uint64_t>(item, count, view->stride, &needle); break;
+    default: break; // TODO: error. unsupported size.
+  }
+
+  return found ? (unsigned int) (found + start - 1) : 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiDestroyView(ulong view)
+void FFIExternHdl::ffiDestroyView(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramView;
+  paramView = *(param.args->getFirst()->evaluate(param.thread));
+
+  BufferView *view = findView(paramView.getValue());
+  if (! view)
+  {
+    // TODO: error. not a view.
+    return;
+  }
+
+  views.erase(std::find(views.begin(), views.end(), view));
+  delete view;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiSnapshotCreate(ulong ptr, uint bytes)
+PVSSulonglong FFIExternHdl::ffiSnapshotCreate(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 2)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  UIntegerVar paramBytes;
+  paramBytes = *(param.args->getNext()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+  size_t size = paramBytes.getValue();
+
+  if (! buffer)
+  {
+    // TODO: error. null pointer.
+    return 0;
+  }
+
+  // a snapshot of a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && size > allocation->size)
+  {
+    // TODO: error. snapshot exceeds the buffer.
+    return 0;
+  }
+
+  snapshots.push_back(new std::vector<char>(buffer, buffer + size));
+  return reinterpret_cast<uintptr_t>(snapshots.back());
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiSnapshotDiff(ulong snapshot, ulong ptr, int itemtype [, float deadband] )
+MappingVar *FFIExternHdl::ffiSnapshotDiff(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramSnapshot;
+  paramSnapshot = *(param.args->getFirst()->evaluate(param.thread));
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getNext()->evaluate(param.thread));
+
+  IntegerVar paramItemType;
+  paramItemType = *(param.args->getNext()->evaluate(param.thread));
+
+  double deadband = 0.0;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    FloatVar paramDeadband;
+    paramDeadband = *(param.args->getNext()->evaluate(param.thread));
+    deadband = paramDeadband.getValue();
+  }
+
+  // with a sink, the new values are sent there instead of being returned
+  FFISink *sink = 0;
+  if (param.args->getNumberOfItems() > 4)
+  {
+    ULongVar paramSink;
+    paramSink = *(param.args->getNext()->evaluate(param.thread));
+
+    sink = findSink(paramSink.getValue());
+    if (! sink)
+    {
+      // TODO: error. not a sink.
+      return 0;
+    }
+  }
+
+  std::vector<char> *snapshot = findSnapshot(paramSnapshot.getValue());
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  if (! snapshot || ! buffer)
+  {
+    // TODO: error. not a snapshot, or null pointer.
+    return 0;
+  }
+
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  bool byteSwap = needsByteSwap(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+  if (converter.get() == 0)
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  size_t itemSize = getFFIType(itemType)->size;
+  size_t size = snapshot->size() / itemSize * itemSize;
+  bool isReal = (itemType == CTRLFFI_FLOAT || itemType == CTRLFFI_DOUBLE);
+
+  std::auto_ptr<DynVar> indices(new DynVar(UINTEGER_VAR));
+  std::auto_ptr<DynVar> values(new DynVar());
+
+  // the kernel skips the unchanged memory, so that only the changed items
+  // are converted to Ctrl values
+  size_t offset = 0;
+  while (offset < size)
+  {
+    size_t found = FFIKernels::findMismatch(&(*snapshot)[offset], buffer + offset, size - offset);
+    if (found == FFIKernels::NOT_FOUND)
+    {
+      break;
+    }
+
+    size_t index = (offset + found) / itemSize;
+    char *oldItem = &(*snapshot)[index * itemSize];
+    const char *newItem = buffer + index * itemSize;
+    offset = (index + 1) * itemSize;
+
+    // changes within the deadband are not reported, and the snapshot keeps
+    // the old value, so that slow drifts are still noticed
+    if (isReal && deadband > 0.0)
+    {
+      double delta = readReal(itemType, newItem, byteSwap) - readReal(itemType, oldItem, byteSwap);
+      if (delta <= deadband && delta >= -deadband)
+      {
+        continue;
+      }
+    }
+
+    memcpy(oldItem, newItem, itemSize);
+
+    Variable *value = converter->allocateCtrlVar();
+    readValue(*converter, *value, newItem, itemSize, byteSwap);
+
+    indices->append(new UIntegerVar((unsigned int) index + 1));
+
+    if (sink)
+    {
+      sink->add(index, value);
+    }
+    else
+    {
+      values->append(value);
+    }
+  }
+
+  MappingVar *result = new MappingVar();
+  result->setAt(new TextVar("indices"), indices.release());
+  result->setAt(new TextVar("values"), values.release());
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiSnapshotDestroy(ulong snapshot)
+void FFIExternHdl::ffiSnapshotDestroy(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramSnapshot;
+  paramSnapshot = *(param.args->getFirst()->evaluate(param.thread));
+
+  std::vector<char> *snapshot = findSnapshot(paramSnapshot.getValue());
+  if (! snapshot)
+  {
+    // TODO: error. not a snapshot.
+    return;
+  }
+
+  snapshots.erase(std::find(snapshots.begin(), snapshots.end(), snapshot));
+  delete snapshot;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiCreatePipeline(dyn_mapping steps)
+PVSSulonglong FFIExternHdl::ffiCreatePipeline(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  const Variable *paramSteps = param.args->getFirst()->evaluate(param.thread);
+  if (! paramSteps || ! paramSteps->isDynVar())
+  {
+    // TODO: error. steps must be a dyn_mapping.
+    return 0;
+  }
+
+  const DynVar &stepList = static_cast<const DynVar &>(*paramSteps);
+  if (stepList.getNumberOfItems() == 0)
+  {
+    // TODO: error. no steps.
+    return 0;
+  }
+
+  std::auto_ptr<Pipeline> pipeline(new Pipeline());
+
+  for (unsigned int i = 1; i <= stepList.getNumberOfItems(); ++i)
+  {
+    const Variable *description = getAnyValue(stepList[i]);
+    PipelineStep *step = description ? createPipelineStep(*description, *pipeline) : 0;
+
+    if (! step)
+    {
+      // TODO: error. invalid step.
+      DEBUG_PRINT(dbgFlag, "Invalid description of pipeline step " << i);
+      return 0;
+    }
+
+    pipeline->steps.push_back(step);
+
+    for (std::vector<PipelineBinding>::const_iterator it = step->bindings.begin();
+         it != step->bindings.end(); ++it)
+    {
+      if (it->kind == PipelineBinding::BIND_INPUT && it->index >= pipeline->inputCount)
+      {
+        pipeline->inputCount = it->index + 1;
+      }
+    }
+  }
+
+  pipelines.push_back(pipeline.release());
+  return reinterpret_cast<uintptr_t>(pipelines.back());
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiRunPipeline(ulong pipeline, dyn_anytype inputs, dyn_dyn_anytype &outputs)
+bool FFIExternHdl::ffiRunPipeline(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  ULongVar paramPipeline;
+  paramPipeline = *(param.args->getFirst()->evaluate(param.thread));
+
+  const Variable *paramInputs = param.args->getNext()->evaluate(param.thread);
+  CtrlExpr *paramOutputsExpr = param.args->getNext();
+
+  Pipeline *pipeline = findPipeline(paramPipeline.getValue());
+  if (! pipeline || ! paramInputs || ! paramInputs->isDynVar())
+  {
+    // TODO: error. invalid pipeline or inputs.
+    return false;
+  }
+
+  // with a sink, the outputs are also sent there
+  FFISink *sink = 0;
+  if (param.args->getNumberOfItems() > 3)
+  {
+    ULongVar paramSink;
+    paramSink = *(param.args->getNext()->evaluate(param.thread));
+
+    sink = findSink(paramSink.getValue());
+    if (! sink)
+    {
+      // TODO: error. not a sink.
+      return false;
+    }
+  }
+
+  const DynVar &inputs = static_cast<const DynVar &>(*paramInputs);
+  if (inputs.getNumberOfItems() < pipeline->inputCount)
+  {
+    // TODO: error. too few inputs.
+    return false;
+  }
+
+  for (unsigned int i = 1; i <= pipeline->inputCount; ++i)
+  {
+    if (! inputs[i])
+    {
+      // TODO: error
+      return false;
+    }
+  }
+
+  // look up all functions first, so that a run does not stop halfway
+  // because a function was undeclared
+  size_t stepCount = pipeline->steps.size();
+  std::vector<FFIFunction *> stepFunctions(stepCount);
+
+  for (size_t s = 0; s < stepCount; ++s)
+  {
+    stepFunctions[s] = findFunction(pipeline->steps[s]->funcId);
+    if (! stepFunctions[s])
+    {
+      // TODO: error. a function of the pipeline was undeclared.
+      return false;
+    }
+  }
+
+  CharString location;
+  if (traceLocations)
+  {
+    location = param.thread->getLocation();
+  }
+  const char *callLocation = traceLocations ? (const char *) location : 0;
+
+  bool succeeded = true;
+  std::vector<bool> executed(stepCount, false);
+
+  for (size_t s = 0; s < stepCount; ++s)
+  {
+    PipelineStep &step = *pipeline->steps[s];
+    FFIFunction *func = stepFunctions[s];
+
+    // after a failed check, only the steps marked "always" run, e.g. to
+    // release what the earlier steps acquired
+    if (! succeeded && ! step.always)
+    {
+      continue;
+    }
+
+    // the values of a skipped step are still those of an earlier run, so a
+    // step using them is skipped as well, e.g. a close of a handle that was
+    // not opened in this run
+    bool boundToSkipped = false;
+    for (size_t i = 0; i < step.bindings.size(); ++i)
+    {
+      const PipelineBinding &binding = step.bindings[i];
+      if (binding.kind == PipelineBinding::BIND_STEP && ! executed[binding.index])
+      {
+        boundToSkipped = true;
+        break;
+      }
+    }
+
+    if (boundToSkipped)
+    {
+      continue;
+    }
+
+    // the values are copied in memory, only the inputs are converted
+    for (size_t i = 0; i < step.bindings.size(); ++i)
+    {
+      const PipelineBinding &binding = step.bindings[i];
+      void *address = step.valueAddresses[i + 1];
+      size_t size = step.valueSizes[i + 1];
+
+      switch (binding.kind)
+      {
+        case PipelineBinding::BIND_NONE:
+          // output-only arguments start with a zero value, like in ffiCallFunction
+          memset(address, 0, size);
+          break;
+
+        case PipelineBinding::BIND_CONSTANT:
+          memcpy(address, &binding.constant, size);
+          break;
+
+        case PipelineBinding::BIND_INPUT:
+          step.values[i + 1]->setValue(*inputs[(unsigned int) binding.index + 1]);
+          break;
+
+        case PipelineBinding::BIND_STEP:
+          memcpy(address, pipeline->steps[binding.index]->valueAddresses[binding.valueIndex], size);
+          break;
+      }
+    }
+
+    void **argValues = step.argValues.empty() ? 0 : &step.argValues[0];
+
+    long long callStart = 0;
+    if (recorder)
+    {
+      recordCall(step.funcId, func, step.argValues);
+      callStart = FFIRecorder::getTime();
+    }
+
+    DEBUG_PRINT(dbgFlag, "Calling function " << func->funcName << " in pipeline step " << (s + 1));
+
+    CTRLFFI_PROBE_CALL_ENTRY(step.funcId, (const char *) func->funcName, callLocation);
+
+    bool called = true;
+    if (func->remoteHost)
+    {
+      called = func->remoteHost->call(func->remoteFunction, step.valueAddresses[0], argValues);
+    }
+    else
+    {
+      ffi_call(&(func->callInterface), func->funcPtr, step.valueAddresses[0], argValues);
+    }
+
+    CTRLFFI_PROBE_CALL_RETURN(step.funcId, (const char *) func->funcName, callLocation, called ? 1 : 0);
+
+    if (recorder)
+    {
+      recorder->endCall(callStart, FFIRecorder::getTime() - callStart);
+    }
+
+    executed[s] = true;
+
+    if (! called)
+    {
+      // TODO: error. the host crashed and was restarted.
+      succeeded = false;
+      continue;
+    }
+
+    if (step.hasExpected && memcmp(step.valueAddresses[0], &step.expected, step.valueSizes[0]) != 0)
+    {
+      succeeded = false;
+    }
+
+    if (step.hasFailure && memcmp(step.valueAddresses[0], &step.failure, step.valueSizes[0]) == 0)
+    {
+      succeeded = false;
+    }
+  }
+
+  // the return value and the output arguments of each executed step. each
+  // output has a fixed target in the sink, also if its step was skipped.
+  DynVar outputs(DYNANYTYPE_VAR);
+  size_t target = 0;
+
+  for (size_t s = 0; s < stepCount; ++s)
+  {
+    const PipelineStep &step = *pipeline->steps[s];
+    const FFIFunction *func = stepFunctions[s];
+    DynVar *stepOutputs = new DynVar();
+
+    for (size_t i = 0; i < step.values.size(); ++i)
+    {
+      bool isOutput = (i == 0) ? (func->returnType != CTRLFFI_VOID)
+                               : ((func->argDirections[i - 1] & CTRLFFI_DIR_OUT) != 0);
+      if (! isOutput)
+      {
+        continue;
+      }
+
+      if (executed[s])
+      {
+        Variable *value = step.values[i]->allocateCtrlVar();
+        step.values[i]->getValue(*value);
+        stepOutputs->append(value);
+
+        if (sink)
+        {
+          sink->add(target, value->clone());
+        }
+      }
+
+      ++target;
+    }
+
+    outputs.append(stepOutputs);
+  }
+
+  Variable *outputsTarget = paramOutputsExpr->getTarget(param.thread);
+  if (outputsTarget)
+  {
+    *outputsTarget = outputs;
+  }
+
+  // memory returned through out slots may have been used by later steps,
+  // so it is only freed at the end of the run
+  for (size_t s = 0; s < stepCount; ++s)
+  {
+    const PipelineStep &step = *pipeline->steps[s];
+    const FFIFunction *func = stepFunctions[s];
+
+    for (size_t i = 0; executed[s] && i < func->outputDeallocators.size(); ++i)
+    {
+      if (func->outputDeallocators[i].enabled)
+      {
+        void *memory = *static_cast<void **>(step.valueAddresses[i + 1]);
+        if (memory)
+        {
+          freeOutput(func->outputDeallocators[i], memory);
+        }
+      }
+    }
+  }
+
+  return succeeded;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiDestroyPipeline(ulong pipeline)
+void FFIExternHdl::ffiDestroyPipeline(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramPipeline;
+  paramPipeline = *(param.args->getFirst()->evaluate(param.thread));
+
+  Pipeline *pipeline = findPipeline(paramPipeline.getValue());
+  if (! pipeline)
+  {
+    // TODO: error. not a pipeline.
+    return;
+  }
+
+  pipelines.erase(std::find(pipelines.begin(), pipelines.end(), pipeline));
+  delete pipeline;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiCreateSink(dyn_string dpes, bool inMemory = false)
+PVSSulonglong FFIExternHdl::ffiCreateSink(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  const Variable *paramTargets = param.args->getFirst()->evaluate(param.thread);
+  if (! paramTargets || ! paramTargets->isDynVar())
+  {
+    // TODO: error. the targets must be a dyn_string.
+    return 0;
+  }
+
+  bool inMemory = false;
+  if (param.args->getNumberOfItems() > 1)
+  {
+    BitVar paramInMemory;
+    paramInMemory = *(param.args->getNext()->evaluate(param.thread));
+    inMemory = paramInMemory.getValue();
+  }
+
+  std::auto_ptr<FFISink> sink;
+  if (inMemory)
+  {
+    sink.reset(new FFIMemorySink());
+  }
+  else
+  {
+    sink.reset(new FFIDpSink());
+  }
+
+  const DynVar &targets = static_cast<const DynVar &>(*paramTargets);
+
+  for (unsigned int i = 1; i <= targets.getNumberOfItems(); ++i)
+  {
+    TextVar name;
+    name = *(targets[i]);
+
+    if (! sink->addTarget(name.getValue()))
+    {
+      // TODO: error. datapoint element does not exist.
+      DEBUG_PRINT(dbgFlag, "Sink target " << name.getValue() << " does not exist");
+      return 0;
+    }
+  }
+
+  sinks.push_back(sink.release());
+  return reinterpret_cast<uintptr_t>(sinks.back());
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiFlushSink(ulong sink)
+bool FFIExternHdl::ffiFlushSink(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  ULongVar paramSink;
+  paramSink = *(param.args->getFirst()->evaluate(param.thread));
+
+  FFISink *sink = findSink(paramSink.getValue());
+  if (! sink)
+  {
+    // TODO: error. not a sink.
+    return false;
+  }
+
+  return sink->flush();
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: mapping ffiGetSinkStats(ulong sink)
+MappingVar *FFIExternHdl::ffiGetSinkStats(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramSink;
+  paramSink = *(param.args->getFirst()->evaluate(param.thread));
+
+  const FFISink *sink = findSink(paramSink.getValue());
+  if (! sink)
+  {
+    // TODO: error. not a sink.
+    return 0;
+  }
+
+  MappingVar *stats = new MappingVar();
+  stats->setAt(new TextVar("targets"),  new ULongVar(sink->getTargetCount()));
+  stats->setAt(new TextVar("pending"),  new ULongVar(sink->getPendingCount()));
+  stats->setAt(new TextVar("values"),   new ULongVar(sink->getValueCount()));
+  stats->setAt(new TextVar("flushes"),  new ULongVar(sink->getFlushCount()));
+  stats->setAt(new TextVar("failures"), new ULongVar(sink->getFailedCount()));
+  stats->setAt(new TextVar("dropped"),  new ULongVar(sink->getDroppedCount()));
+
+  // the stand-in shows what would have been written
+  const FFIMemorySink *memorySink = dynamic_cast<const FFIMemorySink *>(sink);
+  if (memorySink)
+  {
+    MappingVar *lastValues = new MappingVar();
+
+    for (size_t i = 0; i < memorySink->getTargetCount(); ++i)
+    {
+      const Variable *value = memorySink->getLastValue(i);
+      if (value)
+      {
+        lastValues->setAt(new TextVar(memorySink->getTargetName(i).c_str()), value->clone());
+      }
+    }
+
+    stats->setAt(new TextVar("lastvalues"), lastValues);
+  }
+
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: void ffiDestroySink(ulong sink)
+void FFIExternHdl::ffiDestroySink(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 1)
+  {
+    // TODO: error. too few arguments.
+    return;
+  }
+
+  ULongVar paramSink;
+  paramSink = *(param.args->getFirst()->evaluate(param.thread));
+
+  FFISink *sink = findSink(paramSink.getValue());
+  if (! sink)
+  {
+    // TODO: error. not a sink.
+    return;
+  }
+
+  sinks.erase(std::find(sinks.begin(), sinks.end(), sink));
+  delete sink;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: bool ffiBufferToSink(ulong ptr, int itemtype, uint itemcount, ulong sink)
+bool FFIExternHdl::ffiBufferToSink(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 4)
+  {
+    // TODO: error. too few arguments.
+    return false;
+  }
+
+  ULongVar paramPtr;
+  paramPtr = *(param.args->getFirst()->evaluate(param.thread));
+
+  IntegerVar paramItemType;
+  paramItemType = *(param.args->getNext()->evaluate(param.thread));
+
+  UIntegerVar paramItemCount;
+  paramItemCount = *(param.args->getNext()->evaluate(param.thread));
+
+  ULongVar paramSink;
+  paramSink = *(param.args->getNext()->evaluate(param.thread));
+
+  uintptr_t ptrValue = static_cast<uintptr_t>(paramPtr.getValue());
+  const char *buffer = reinterpret_cast<const char *>(ptrValue);
+
+  FFISink *sink = findSink(paramSink.getValue());
+  if (! buffer || ! sink)
+  {
+    // TODO: error. null pointer, or not a sink.
+    return false;
+  }
+
+  int itemType = getMemoryBaseType(paramItemType.getValue());
+  bool byteSwap = needsByteSwap(paramItemType.getValue());
+  if (! isValidForRawMemoryOperation(itemType))
+  {
+    // TODO: error. invalid type.
+    return false;
+  }
+
+  std::auto_ptr<FFIValue> converter(FFIValue::allocateValue(itemType));
+  if (converter.get() == 0)
+  {
+    // TODO: error. invalid type.
+    return false;
+  }
+
+  size_t itemSize = getFFIType(itemType)->size;
+  size_t itemCount = paramItemCount.getValue();
+
+  for (size_t i = 0; i < itemCount; ++i)
+  {
+    Variable *value = converter->allocateCtrlVar();
+    readValue(*converter, *value, buffer + i * itemSize, itemSize, byteSwap);
+    sink->add(i, value);
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Ctrl: ulong ffiSamplesToSink(ulong samplerId, ulong sinceIndex, ulong sink)
+PVSSulonglong FFIExternHdl::ffiSamplesToSink(ExecuteParamRec &param)
+{
+  if (param.args->getNumberOfItems() < 3)
+  {
+    // TODO: error. too few arguments.
+    return 0;
+  }
+
+  ULongVar paramSampler;
+  paramSampler = *(param.args->getFirst()->evaluate(param.thread));
+
+  ULongVar paramSince;
+  paramSince = *(param.args->getNext()->evaluate(param.thread));
+
+  ULongVar paramSink;
+  paramSink = *(param.args->getNext()->evaluate(param.thread));
+
+  const SamplerEntry *entry = findSampler(paramSampler.getValue());
+  FFISink *sink = findSink(paramSink.getValue());
+  if (! entry || ! sink)
+  {
+    // TODO: error. not a sampler, or not a sink.
+    return 0;
+  }
+
+  std::vector<char> records;
+  size_t first = 0;
+  size_t since = static_cast<size_t>(paramSince.getValue());
+  size_t next = entry->sampler->read(since, records, first);
+
+  size_t recordSize = entry->sampler->getRecordSize();
+  if (records.size() < recordSize)
+  {
+    return next;
+  }
+
+  // the values are set with the time of the flush, so only the newest
+  // sample is sent
+  const char *record = &records[records.size() - recordSize] + sizeof(long long);
+
+  for (size_t j = 0; j < entry->captureConverters.size(); ++j)
+  {
+    Variable *value = entry->captureConverters[j]->allocateCtrlVar();
+    entry->captureConverters[j]->readValueFromRawMemory(*value, record);
+    sink->add(j, value);
+
+    record += entry->captureSizes[j];
+  }
+
+  return next;
+}
+
+//------------------------------------------------------------------------------
+// helper functions:
+
+ffi_type *FFIExternHdl::getFFIType(int type)
+{
+  // TODO: error if the type is invalid.
+  return FFITypeTraits::get(type).ffiType;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::canCarryOutput(int type)
+{
+  // only the values behind CTRLFFI_<FOO>_PTR and the out slots can be
+  // changed by the function
+  return (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR) || isOutputOnly(type);
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::isOutputOnly(int type)
+{
+  return type == CTRLFFI_STRING_OUT || type == CTRLFFI_POINTER_OUT;
+}
+
+//------------------------------------------------------------------------------
+
+int FFIExternHdl::getMemoryBaseType(int type)
+{
+  if ((type & ~(CTRLFFI_TYPE_MASK | CTRLFFI_BYTEORDER_MASK)) != 0 ||
+      (type & CTRLFFI_BYTEORDER_MASK) == CTRLFFI_BYTEORDER_MASK)
+  {
+    // only one byte order, and no other flags are allowed
+    return CTRLFFI_MAX_VALUE;
+  }
+
+  return type & CTRLFFI_TYPE_MASK;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::needsByteSwap(int type)
+{
+  if (FFIKernels::isBigEndianHost())
+  {
+    return (type & CTRLFFI_BYTEORDER_MASK) == CTRLFFI_LITTLE_ENDIAN;
+  }
+
+  return (type & CTRLFFI_BYTEORDER_MASK) == CTRLFFI_BIG_ENDIAN;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::isValidForRawMemoryOperation(int type)
+{
+  return (type > CTRLFFI_FIRST_VALUE_TYPE && type < CTRLFFI_LAST_VALUE_TYPE) ||
+          type == CTRLFFI_POINTER;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::readSignature(ExecuteParamRec &param, unsigned int firstType, FFIFunction &function)
+{
+  ffi_type *returnType = &ffi_type_void;
+  ffi_type **argTypes = 0;
+  unsigned int argCount = 0;
+
+  function.returnType = CTRLFFI_VOID;
+
+  // get the return type
+  if (param.args->getNumberOfItems() > firstType)
+  {
+    IntegerVar paramReturnType;
+    paramReturnType = *(param.args->getNext()->evaluate(param.thread));
+
+    // CTRLFFI_<FOO>_PTR and the out slots cannot be used as return type.
+    if ((paramReturnType.getValue() >= CTRLFFI_FIRST_PTR &&
+         paramReturnType.getValue() <= CTRLFFI_LAST_PTR) ||
+        isOutputOnly(paramReturnType.getValue()))
+    {
+      // TODO: error. invalid type for return value.
+      return false;
+    }
+
+    returnType = getFFIType(paramReturnType.getValue());
+    if (! returnType)
+    {
+      // TODO: error
+      return false;
+    }
+
+    function.returnType = static_cast<IntegralType>(paramReturnType.getValue());
+
+    // get the argument types
+    if (param.args->getNumberOfItems() > firstType + 1)
+    {
+      argCount = param.args->getNumberOfItems() - firstType - 1;
+      function.argTypes.reserve(argCount);
+      function.argDirections.reserve(argCount);
+
+      argTypes = new ffi_type *[argCount];
+
+      for (unsigned int i = 0; i < argCount; ++i)
+      {
+        IntegerVar paramArgType;
+        paramArgType = *(param.args->getNext()->evaluate(param.thread));
+
+        // the type may be combined with a direction flag
+        int typeValue = paramArgType.getValue() & CTRLFFI_TYPE_MASK;
+        int direction = paramArgType.getValue() & CTRLFFI_DIR_MASK;
+
+        ffi_type *argType = getFFIType(typeValue);
+        if (! argType || (paramArgType.getValue() & ~(CTRLFFI_TYPE_MASK | CTRLFFI_DIR_MASK)))
+        {
+          // TODO: error
+          delete[] argTypes;
+          return false;
+        }
+
+        // by default, only parameters that can return something are written back
+        if (direction == 0)
+        {
+          direction = isOutputOnly(typeValue) ? CTRLFFI_DIR_OUT :
+                      canCarryOutput(typeValue) ? CTRLFFI_DIR_INOUT : CTRLFFI_DIR_IN;
+        }
+        else if ((direction & CTRLFFI_DIR_OUT) && ! canCarryOutput(typeValue))
+        {
+          // TODO: error. a by-value parameter cannot be an output.
+          delete[] argTypes;
+          return false;
+        }
+        else if ((direction & CTRLFFI_DIR_IN) && isOutputOnly(typeValue))
+        {
+          // TODO: error. the slot of an out parameter cannot be passed in.
+          delete[] argTypes;
+          return false;
+        }
+
+        argTypes[i] = argType;
+        function.argTypes.push_back(static_cast<IntegralType>(typeValue));
+        function.argDirections.push_back(direction);
+      }
+    }
+  }
+
+  // the cif takes the arg types array, and the function object deletes it
+  ffi_cif *cif = &(function.callInterface);
+  ffi_status res = ffi_prep_cif(cif, FFI_DEFAULT_ABI, argCount, returnType, argTypes);
+
+  return res == FFI_OK;
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int FFIExternHdl::addFunction(FFIFunction *function)
+{
+  unsigned int slot = 0;
+
+  if (! freeFunctionSlots.empty())
+  {
+    slot = freeFunctionSlots.back();
+    freeFunctionSlots.pop_back();
+    functions[slot].function = function;
+  }
+  else
+  {
+    if (functions.size() >= FUNCTION_SLOT_MASK)
+    {
+      // TODO: error. too many functions.
+      if (function->library)
+      {
+        libraries.release(function->library);
+      }
+      delete function;
+      return 0;
+    }
+
+    slot = (unsigned int) functions.size();
+
+    FunctionSlot newSlot;
+    newSlot.function = function;
+    newSlot.generation = 0;
+    functions.push_back(newSlot);
+  }
+
+  // the function id is a one-based index in the list
+  // (because zero is already used to indicate failure)
+  unsigned int funcId = (functions[slot].generation << FUNCTION_SLOT_BITS) | (slot + 1);
+
+  if (perfMap.isOpen())
+  {
+    addToPerfMap(funcId, function);
+  }
+
+  return funcId;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIExternHdl::addToPerfMap(unsigned int funcId, const FFIFunction *function)
+{
+  // functions of isolated libraries run in another process
+  if (! function->funcPtr)
+  {
+    return;
+  }
+
+  // the real size is unknown, so a page is assumed
+  const size_t NOMINAL_SIZE = 4096;
+
+  char prefix[32];
+  sprintf(prefix, "ctrlffi:%u:", funcId);
+
+  CharString name(prefix);
+  name += function->funcName;
+  perfMap.add(reinterpret_cast<const void *>(function->funcPtr), NOMINAL_SIZE, name);
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::FFIFunction *FFIExternHdl::findFunction(unsigned int funcId) const
+{
+  unsigned int slot = funcId & FUNCTION_SLOT_MASK;
+  if (slot < 1 || slot > functions.size())
+  {
+    return 0;
+  }
+
+  const FunctionSlot &entry = functions[slot - 1];
+  if ((entry.generation << FUNCTION_SLOT_BITS) != (funcId & ~FUNCTION_SLOT_MASK))
+  {
+    // the function was undeclared, and the slot may have been reused
+    return 0;
+  }
+
+  return entry.function;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::getStructLayout(DynVar &fieldTypes, StructLayout &layout)
+{
+  layout.fields.reserve(fieldTypes.getNumberOfItems());
+
+  for (unsigned int i = 1; i <= fieldTypes.getNumberOfItems(); ++i)
+  {
+    IntegerVar typeVal;
+    typeVal = *(fieldTypes[i]);
+
+    int baseType = getMemoryBaseType(typeVal.getValue());
+    if (! isValidForRawMemoryOperation(baseType))
+    {
+      // TODO: error. fields must be values in memory, not void, strings or _PTR types.
+      return false;
+    }
+
+    ffi_type *type = getFFIType(baseType);
+    if (type == 0)
+    {
+      // TODO: error. invalid type.
+      return false;
+    }
+
+    StructField field;
+    field.type = baseType;
+    field.offset = layout.size;
+    field.size = type->size;
+    field.byteSwap = needsByteSwap(typeVal.getValue());
+    field.converter = FFIValue::allocateValue(field.type);
+    layout.fields.push_back(field);
+
+    // advance to next field
+    layout.size += type->size;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+DynVar *FFIExternHdl::readStruct(const StructLayout &layout, const char *buffer)
+{
+  std::auto_ptr<DynVar> result(new DynVar());
+
+  for (std::vector<StructField>::const_iterator it = layout.fields.begin();
+       it != layout.fields.end(); ++it)
+  {
+    Variable *fieldValue = it->converter->allocateCtrlVar();
+    if (! fieldValue)
+    {
+      // TODO: error. failed to read field?
+      return 0;
+    }
+
+    readValue(*(it->converter), *fieldValue, buffer + it->offset, it->size, it->byteSwap);
+    result->append(fieldValue);
+  }
+
+  return result.release();
+}
+
+//------------------------------------------------------------------------------
+
+FFIQueue *FFIExternHdl::findQueue(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<FFIQueue *>::const_iterator it = queues.begin(); it != queues.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::SamplerEntry *FFIExternHdl::findSampler(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<SamplerEntry *>::const_iterator it = samplers.begin(); it != samplers.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+PVSSulonglong FFIExternHdl::addView(const char *buffer, const DynVar &fieldTypes, bool isStruct,
+                                    size_t count, size_t stride, bool defaultStride)
+{
+  std::auto_ptr<BufferView> view(new BufferView());
+  view->fieldTypes = fieldTypes;
+
+  if (! getStructLayout(view->fieldTypes, view->layout))
+  {
+    // TODO: error. invalid type.
+    return 0;
+  }
+
+  view->buffer = buffer;
+  view->count = count;
+  view->stride = defaultStride ? view->layout.size : stride;
+  view->isStruct = isStruct;
+
+  // a view of a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && count > 0 &&
+      (count - 1) * view->stride + view->layout.size > allocation->size)
+  {
+    // TODO: error. view exceeds the buffer.
+    return 0;
+  }
+
+  views.push_back(view.release());
+  return reinterpret_cast<uintptr_t>(views.back());
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::BufferView *FFIExternHdl::findView(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<BufferView *>::const_iterator it = views.begin(); it != views.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+std::vector<char> *FFIExternHdl::findSnapshot(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<std::vector<char> *>::const_iterator it = snapshots.begin(); it != snapshots.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::PipelineStep *FFIExternHdl::createPipelineStep(const Variable &description,
+                                                             const Pipeline &pipeline) const
+{
+  if (description.isA() != MAPPING_VAR)
+  {
+    return 0;
+  }
+
+  const MappingVar &mapping = static_cast<const MappingVar &>(description);
+
+  const Variable *funcIdVar = getAnyValue(mapping.getAt(TextVar("function")));
+  if (! funcIdVar)
+  {
+    return 0;
+  }
+
+  UIntegerVar funcId;
+  funcId = *funcIdVar;
+
+  const FFIFunction *func = findFunction(funcId.getValue());
+  if (! func)
+  {
+    return 0;
+  }
+
+  std::auto_ptr<PipelineStep> step(new PipelineStep());
+  step->funcId = funcId.getValue();
+
+  // the values are allocated once and reused by each run
+  size_t argCount = func->argTypes.size();
+
+  for (size_t i = 0; i <= argCount; ++i)
+  {
+    int type = (i == 0) ? (int) func->returnType : (int) func->argTypes[i - 1];
+
+    FFIValue *value = FFIValue::allocateValue(type);
+    if (! value)
+    {
+      return 0;
+    }
+
+    step->values.push_back(value);
+
+    void *ptr = value->getPtr();
+    if (i > 0)
+    {
+      step->argValues.push_back(ptr);
+    }
+
+    size_t size = 0;
+    step->valueAddresses.push_back(getValueAddress(type, ptr, size));
+    step->valueSizes.push_back(size);
+  }
+
+  // one binding for each argument
+  const Variable *argsVar = getAnyValue(mapping.getAt(TextVar("args")));
+  const DynVar *args = (argsVar && argsVar->isDynVar()) ? static_cast<const DynVar *>(argsVar) : 0;
+
+  if (argCount > 0 && (! args || args->getNumberOfItems() != argCount))
+  {
+    return 0;
+  }
+
+  step->bindings.resize(argCount);
+
+  for (size_t i = 0; i < argCount; ++i)
+  {
+    PipelineBinding &binding = step->bindings[i];
+
+    // output-only arguments need no value
+    if (! (func->argDirections[i] & CTRLFFI_DIR_IN))
+    {
+      continue;
+    }
+
+    const Variable *arg = getAnyValue((*args)[(unsigned int) i + 1]);
+    if (! arg)
+    {
+      return 0;
+    }
+
+    if (arg->isA() != MAPPING_VAR)
+    {
+      // a constant, converted once
+      step->values[i + 1]->setValue(*arg);
+      memcpy(&binding.constant, step->valueAddresses[i + 1], step->valueSizes[i + 1]);
+      binding.kind = PipelineBinding::BIND_CONSTANT;
+      continue;
+    }
+
+    const MappingVar &source = static_cast<const MappingVar &>(*arg);
+    const Variable *inputIndex = getAnyValue(source.getAt(TextVar("input")));
+    const Variable *stepIndex = getAnyValue(source.getAt(TextVar("step")));
+
+    if (inputIndex)
+    {
+      UIntegerVar index;
+      index = *inputIndex;
+
+      if (index.getValue() < 1)
+      {
+        return 0;
+      }
+
+      binding.kind = PipelineBinding::BIND_INPUT;
+      binding.index = index.getValue() - 1;
+    }
+    else if (stepIndex)
+    {
+      UIntegerVar index;
+      index = *stepIndex;
+
+      // the return value, unless an argument is given
+      UIntegerVar valueIndex;
+      const Variable *valueIndexVar = getAnyValue(source.getAt(TextVar("value")));
+      if (valueIndexVar)
+      {
+        valueIndex = *valueIndexVar;
+      }
+
+      // only the values of earlier steps exist when the step runs
+      if (index.getValue() < 1 || index.getValue() > pipeline.steps.size())
+      {
+        return 0;
+      }
+
+      const PipelineStep &sourceStep = *pipeline.steps[index.getValue() - 1];
+      if (valueIndex.getValue() >= sourceStep.values.size())
+      {
+        return 0;
+      }
+
+      // the value is copied in memory, so both must have the same size
+      size_t sourceSize = sourceStep.valueSizes[valueIndex.getValue()];
+      if (sourceSize == 0 || sourceSize != step->valueSizes[i + 1])
+      {
+        return 0;
+      }
+
+      binding.kind = PipelineBinding::BIND_STEP;
+      binding.index = index.getValue() - 1;
+      binding.valueIndex = valueIndex.getValue();
+    }
+    else
+    {
+      return 0;
+    }
+  }
+
+  // checks of the return value
+  const Variable *expected = getAnyValue(mapping.getAt(TextVar("expect")));
+  const Variable *failure = getAnyValue(mapping.getAt(TextVar("fail")));
+
+  if (expected || failure)
+  {
+    if (! isValidForRawMemoryOperation(func->returnType))
+    {
+      return 0;
+    }
+
+    if (expected)
+    {
+      step->values[0]->writeValueToRawMemory(*expected, &step->expected);
+      step->hasExpected = true;
+    }
+
+    if (failure)
+    {
+      step->values[0]->writeValueToRawMemory(*failure, &step->failure);
+      step->hasFailure = true;
+    }
+  }
+
+  const Variable *always = getAnyValue(mapping.getAt(TextVar("always")));
+  step->always = always && always->isTrue();
+
+  return step.release();
+}
+
+//------------------------------------------------------------------------------
+
+FFIExternHdl::Pipeline *FFIExternHdl::findPipeline(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<Pipeline *>::const_iterator it = pipelines.begin(); it != pipelines.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+FFISink *FFIExternHdl::findSink(PVSSulonglong handle) const
+{
+  uintptr_t ptrValue = static_cast<uintptr_t>(handle);
+
+  for (std::vector<FFISink *>::const_iterator it = sinks.begin(); it != sinks.end(); ++it)
+  {
+    if (reinterpret_cast<uintptr_t>(*it) == ptrValue)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void *FFIExternHdl::getValueAddress(int type, void *ptr, size_t &size)
+{
+  if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+  {
+    size = getFFIType(type - CTRLFFI_FIRST_PTR + CTRLFFI_FIRST_VALUE_TYPE)->size;
+    return *static_cast<void **>(ptr);
+  }
+
+  if (isOutputOnly(type))
+  {
+    // the slot receiving the pointer
+    size = sizeof(void *);
+    return *static_cast<void **>(ptr);
+  }
+
+  if (type == CTRLFFI_VOID || ! ptr)
+  {
+    size = 0;
+    return 0;
+  }
+
+  size = getFFIType(type)->size;
+  return ptr;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::checkMatrix(const char *buffer, size_t rows, size_t cols, size_t itemSize,
+                               bool colMajor, size_t &leadingDim) const
+{
+  // the outer dimension are the rows of a row-major matrix, and the columns
+  // of a column-major matrix
+  size_t outer = colMajor ? cols : rows;
+  size_t inner = colMajor ? rows : cols;
+
+  if (leadingDim == 0)
+  {
+    leadingDim = inner;
+  }
+  else if (leadingDim < inner)
+  {
+    return false;
+  }
+
+  // a matrix in a buffer from ffiAllocBuffer must stay inside of it
+  const FFIMemoryTracker::Allocation *allocation = memoryTracker.find(buffer);
+  if (allocation && outer > 0 && inner > 0 &&
+      ((outer - 1) * leadingDim + inner) * itemSize > allocation->size)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIExternHdl::stopSamplers(const FFIFunction *function)
+{
+  for (size_t i = samplers.size(); i > 0; --i)
+  {
+    if (samplers[i - 1]->function == function)
+    {
+      delete samplers[i - 1];
+      samplers.erase(samplers.begin() + (i - 1));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+FFIRemoteHost *FFIExternHdl::findRemoteHost(const char *libPath) const
+{
+  for (std::vector<FFIRemoteHost *>::const_iterator it = remoteHosts.begin(); it != remoteHosts.end(); ++it)
+  {
+    if ((*it)->getLibPath() == libPath)
+    {
+      return *it;
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIExternHdl::recordCall(unsigned int funcId, const FFIFunction *function, const std::vector<void *> &argValues)
+{
+  if (! recorder->hasFunction(funcId))
+  {
+    std::vector<int> argTypes(function->argTypes.begin(), function->argTypes.end());
+    recorder->addFunction(funcId, function->libName, function->funcName, function->returnType,
+                          argTypes, function->argDirections);
+  }
+
+  recorder->beginCall(funcId);
+
+  for (size_t i = 0; i < argValues.size(); ++i)
+  {
+    int type = function->argTypes[i];
+
+    if (isOutputOnly(type))
+    {
+      // the slot has no input
+      recorder->addArgument("", 0);
+    }
+    else if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+    {
+      const void *value = *static_cast<void **>(argValues[i]);
+      recorder->addArgument(value, getFFIType(type - CTRLFFI_FIRST_PTR + CTRLFFI_FIRST_VALUE_TYPE)->size);
+    }
+    else if (type == CTRLFFI_STRING)
+    {
+      const char *text = *static_cast<const char **>(argValues[i]);
+      recorder->addArgument(text, text ? strlen(text) : 0);
+    }
+    else if (type == CTRLFFI_STRING_ARRAY)
+    {
+      // the texts are recorded one after the other, with their terminators.
+      // they are copied, because a table need not be packed by ffiCallFunction.
+      const char *const *table = *static_cast<const char *const **>(argValues[i]);
+      if (! table)
+      {
+        recorder->addArgument(0, 0);
+        continue;
+      }
+
+      std::vector<char> texts;
+      for (size_t k = 0; table[k]; ++k)
+      {
+        texts.insert(texts.end(), table[k], table[k] + strlen(table[k]) + 1);
+      }
+
+      recorder->addArgument(texts.empty() ? "" : &texts[0], texts.size());
+    }
+    else
+    {
+      recorder->addArgument(argValues[i], getFFIType(type)->size);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+void FFIExternHdl::freeOutput(const OutputDeallocator &deallocator, void *memory) const
+{
+  if (deallocator.funcId == 0)
+  {
+    free(memory);
+    return;
+  }
+
+  // the deallocator might have been undeclared since. leaking is safer than guessing.
+  FFIFunction *func = findFunction(deallocator.funcId);
+  if (! func)
+  {
+    DEBUG_PRINT(dbgFlag, "Deallocator function " << deallocator.funcId << " not found, memory not freed");
+    return;
+  }
+
+  // large enough for any return type of a deallocator
+  union { ffi_arg integer; double real; void *pointer; } returnValue;
+  void *argValue = memory;
+  void *argValues[1] = { &argValue };
+
+  ffi_call(&(func->callInterface), func->funcPtr, &returnValue, argValues);
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::readAddress(int type, const char *buffer, Variable &target)
+{
+  const FFITypeTraits &traits = FFITypeTraits::get(getMemoryBaseType(type));
+  if (! traits.read)
+  {
+    return false;
+  }
+
+  if (needsByteSwap(type))
+  {
+    PVSSulonglong tmp;
+    FFIKernels::copySwapped(&tmp, buffer, traits.size);
+    traits.read(target, &tmp);
+  }
+  else
+  {
+    traits.read(target, buffer);
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIExternHdl::writeAddress(int type, char *buffer, const Variable &var)
+{
+  const FFITypeTraits &traits = FFITypeTraits::get(getMemoryBaseType(type));
+  if (! traits.write)
+  {
+    return false;
+  }
+
+  if (needsByteSwap(type))
+  {
+    PVSSulonglong tmp;
+    traits.write(var, &tmp);
+    FFIKernels::copySwapped(buffer, &tmp, traits.size);
+  }
+  else
+  {
+    traits.write(var, buffer);
+  }
+
+  return true;
 }
@@ -1,10 +1,14 @@
 #ifndef _FFIEXTERNHDL_H_
 #define _FFIEXTERNHDL_H_
 
+#include <FFILibrary.hxx>
+#include <FFIMemoryTracker.hxx>
+#include <FFIPerfMap.hxx>
 #include <FFITypes.hxx>
 #include <FFIValue.hxx>
 
 #include <BaseExternHdl.hxx>
+#include <DynVar.hxx>
 #include <SimplePtrArray.hxx>
 #include <Types.hxx>
 
@@ -14,6 +18,13 @@
 
 // forward declarations
 class Variable;
+class FFISharedMemory;
+class FFIQueue;
+class FFIRecorder;
+class FFIRemoteHost;
+class FFISampler;
+class FFISink;
+class MappingVar;
 
 //------------------------------------------------------------------------------
 
@@ -23,11 +34,20 @@ public:
   /// Function pointer type as used by libffi
   typedef void (*VoidFunction)(void);
 
+  /// Frees the memory returned through an out slot after the call
+  struct OutputDeallocator
+  {
+    /// True if the memory is freed
+    bool enabled;
+    /// Id of a declared function taking the pointer, or 0 to use free()
+    unsigned int funcId;
+  };
+
   /// Stores a function declaration
   struct FFIFunction
   {
     /// Constructor. Necessary to recognize an empty object in the dtor.
-    FFIFunction() : funcPtr(0)
+    FFIFunction() : funcPtr(0), library(0), remoteHost(0), remoteFunction(-1)
     {
       // set just enough to be able to recognize an empty cif
       callInterface.nargs = 0;
@@ -47,18 +67,212 @@ public:
 
     /// Name of the function (e.g. "memset")
     CharString funcName;
-    /// Filename of the library containing the function
+    /// Filename of the library containing the function, empty for function pointers
     CharString libName;
     /// Function pointer to call the function
     VoidFunction funcPtr;
+    /// The library containing the function, or 0 for function pointers.
+    /// Released when the function is undeclared.
+    FFILibrary *library;
+    /// The host executing the function, if its library is isolated. Not owned.
+    FFIRemoteHost *remoteHost;
+    /// Index of the function in the remote host
+    int remoteFunction;
 
     /// Return type of the function
     IntegralType returnType;
     /// List of argument types for the function
     std::vector<IntegralType> argTypes;
+    /// Direction of each argument (CTRLFFI_DIR_IN and/or CTRLFFI_DIR_OUT)
+    std::vector<int> argDirections;
+    /// Deallocator for each argument, empty if none was set
+    std::vector<OutputDeallocator> outputDeallocators;
 
     /// libffi call interface definition
     ffi_cif callInterface;
+
+    /// Returns the approximate number of heap bytes used by this declaration
+    size_t getMemoryUsage() const
+    {
+      return sizeof(*this) + funcName.len() + libName.len() +
+             argTypes.capacity() * sizeof(IntegralType) +
+             argDirections.capacity() * sizeof(int) +
+             outputDeallocators.capacity() * sizeof(OutputDeallocator) +
+             callInterface.nargs * sizeof(ffi_type *);
+    }
+  };
+
+  /// A field of a struct layout
+  struct StructField
+  {
+    /// Type of the field
+    int type;
+    /// Offset of the field from the start of the struct
+    size_t offset;
+    /// Size of the field in bytes
+    size_t size;
+    /// True if the field is stored with the other byte order than the host
+    bool byteSwap;
+    /// Converts the field from and to Ctrl, owned by the StructLayout
+    FFIValue *converter;
+  };
+
+  /// A struct layout, resolved from a dyn_int of field types
+  struct StructLayout
+  {
+    StructLayout() : size(0) { }
+
+    ~StructLayout()
+    {
+      for (std::vector<StructField>::iterator it = fields.begin(); it != fields.end(); ++it)
+      {
+        delete it->converter;
+      }
+    }
+
+    /// The fields in the order of the field types
+    std::vector<StructField> fields;
+    /// Size of the struct in bytes
+    size_t size;
+
+  private:
+    // not copyable, the converters are owned
+    StructLayout(const StructLayout &);
+    StructLayout &operator=(const StructLayout &);
+  };
+
+  /// A view created by ffiCreateView. The items are read on demand.
+  struct BufferView
+  {
+    /// Start of the first item
+    const char *buffer;
+    /// Number of items
+    size_t count;
+    /// Distance between the starts of two items in bytes
+    size_t stride;
+    /// True if the items are structs, false for a single item type
+    bool isStruct;
+    /// The field types, to create slices with the same layout
+    DynVar fieldTypes;
+    /// The layout of an item. A single item type is a struct with one field.
+    StructLayout layout;
+  };
+
+  /// A sampler started by ffiStartSampler, with the values of its call
+  struct SamplerEntry
+  {
+    SamplerEntry() : sampler(0), function(0) { }
+
+    /// Stops the sampler before its values are deleted
+    ~SamplerEntry();
+
+    /// The sampler, owned
+    FFISampler *sampler;
+    /// The sampled function
+    const FFIFunction *function;
+    /// The return value (index 0) and the arguments of the call, owned
+    std::vector<FFIValue *> values;
+    /// The addresses of the arguments as given to ffi_call()
+    std::vector<void *> argValues;
+    /// Converters for the values captured in each record, in record order
+    std::vector<const FFIValue *> captureConverters;
+    /// Sizes of the values captured in each record
+    std::vector<size_t> captureSizes;
+
+  private:
+    // not copyable, the values are owned
+    SamplerEntry(const SamplerEntry &);
+    SamplerEntry &operator=(const SamplerEntry &);
+  };
+
+  /// Where a pipeline step takes the value of an argument from
+  struct PipelineBinding
+  {
+    enum Kind
+    {
+      /// No value, for output-only arguments
+      BIND_NONE,
+      /// A constant given to ffiCreatePipeline
+      BIND_CONSTANT,
+      /// An input given to ffiRunPipeline
+      BIND_INPUT,
+      /// The return value or an argument of an earlier step
+      BIND_STEP
+    };
+
+    PipelineBinding() : kind(BIND_NONE), constant(0), index(0), valueIndex(0) { }
+
+    Kind kind;
+    /// BIND_CONSTANT: the value in memory, restored before each call
+    PVSSulonglong constant;
+    /// BIND_INPUT: zero-based index of the input, BIND_STEP: of the step
+    size_t index;
+    /// BIND_STEP: 0 for the return value, n for the n-th argument
+    size_t valueIndex;
+  };
+
+  /// A call of a pipeline created by ffiCreatePipeline
+  struct PipelineStep
+  {
+    PipelineStep() : funcId(0), hasExpected(false), expected(0), hasFailure(false), failure(0), always(false) { }
+    /// Deletes the values
+    ~PipelineStep();
+
+    /// The called function. Its id is looked up on each run, so that an
+    /// undeclared function fails the run instead of being called.
+    unsigned int funcId;
+    /// The binding of each argument
+    std::vector<PipelineBinding> bindings;
+    /// The return value (index 0) and the arguments of the call, owned
+    std::vector<FFIValue *> values;
+    /// The addresses of the arguments as given to ffi_call()
+    std::vector<void *> argValues;
+    /// The address of each value in memory, see getValueAddress(). Bindings
+    /// copy the values between these addresses.
+    std::vector<void *> valueAddresses;
+    /// The size of each value in memory, 0 if it cannot be bound
+    std::vector<size_t> valueSizes;
+    /// True if the return value must be equal to expected
+    bool hasExpected;
+    PVSSulonglong expected;
+    /// True if the return value must differ from failure
+    bool hasFailure;
+    PVSSulonglong failure;
+    /// True if the step also runs after a failed check
+    bool always;
+
+  private:
+    // not copyable, the values are owned
+    PipelineStep(const PipelineStep &);
+    PipelineStep &operator=(const PipelineStep &);
+  };
+
+  /// A pipeline created by ffiCreatePipeline
+  struct Pipeline
+  {
+    Pipeline() : inputCount(0) { }
+    /// Deletes the steps
+    ~Pipeline();
+
+    /// The steps in the order of execution, owned
+    std::vector<PipelineStep *> steps;
+    /// The number of inputs expected by ffiRunPipeline
+    size_t inputCount;
+
+  private:
+    // not copyable, the steps are owned
+    Pipeline(const Pipeline &);
+    Pipeline &operator=(const Pipeline &);
+  };
+
+  /// A slot in the list of declared functions
+  struct FunctionSlot
+  {
+    /// The declared function, or 0 if the slot is free
+    FFIFunction *function;
+    /// Incremented whenever the slot is freed, so that old ids become invalid.
+    /// A slot at the last generation is not reused.
+    unsigned int generation;
   };
 
 // boilerplate stuff
@@ -72,17 +286,31 @@ private:
 // ctrl functions
   unsigned int ffiDeclareFunction(ExecuteParamRec &param);
 
+  unsigned int ffiDeclareFunctionPointer(ExecuteParamRec &param);
+
+  PVSSulonglong ffiGetSymbolAddress(ExecuteParamRec &param);
+
+  bool ffiUndeclareFunction(ExecuteParamRec &param);
+
   bool ffiCallFunction(ExecuteParamRec &param);
 
   DynVar *ffiGetAllFunctions(ExecuteParamRec &param);
 
+  bool ffiSetOutputDeallocator(ExecuteParamRec &param);
+
   unsigned int ffiGetTypeSize(ExecuteParamRec &param);
 
   const char *ffiGetTypeName(ExecuteParamRec &param);
   
   PVSSulonglong ffiAllocBuffer(ExecuteParamRec &param);
+  PVSSulonglong ffiAllocAlignedBuffer(ExecuteParamRec &param);
   
   void ffiFreeBuffer(ExecuteParamRec &param);
+  MappingVar *ffiGetBufferInfo(ExecuteParamRec &param);
+
+  MappingVar *ffiGetMemoryStats(ExecuteParamRec &param);
+
+  void ffiSetMemoryTracking(ExecuteParamRec &param);
   
   char *ffiBufferToString(ExecuteParamRec &param);
 
@@ -90,32 +318,251 @@ private:
 
   DynVar *ffiBufferToDyn(ExecuteParamRec &param);
 
+  DynVar *ffiBufferToColumns(ExecuteParamRec &param);
+
+  DynVar *ffiBufferToDynString(ExecuteParamRec &param);
+
+  DynVar *ffiBufferToMatrix(ExecuteParamRec &param);
+
   void ffiFillBufferWithString(ExecuteParamRec &param);
 
   void ffiFillBufferWithStruct(ExecuteParamRec &param);
 
   void ffiFillBufferWithDyn(ExecuteParamRec &param);
 
+  void ffiFillBufferFromColumns(ExecuteParamRec &param);
+
+  PVSSulonglong ffiFillBufferWithDynString(ExecuteParamRec &param);
+
+  void ffiFillBufferWithMatrix(ExecuteParamRec &param);
+
+  PVSSlonglong ffiBufferFind(ExecuteParamRec &param);
+
+  PVSSlonglong ffiBufferFindByte(ExecuteParamRec &param);
+
+  unsigned int ffiBufferCrc32(ExecuteParamRec &param);
+
+  unsigned int ffiBufferCrc32C(ExecuteParamRec &param);
+
+  unsigned int ffiBufferCrc16Modbus(ExecuteParamRec &param);
+
+  PVSSulonglong ffiBufferHash(ExecuteParamRec &param);
+
+  MappingVar *ffiBufferReduce(ExecuteParamRec &param);
+
   Variable *ffiReadFromPointer(ExecuteParamRec &param);
 
+  bool ffiReadFromPointerToTarget(ExecuteParamRec &param);
+
   void ffiWriteToPointer(ExecuteParamRec &param);
 
+  PVSSulonglong ffiSharedMemoryCreate(ExecuteParamRec &param);
+
+  PVSSulonglong ffiSharedMemoryOpen(ExecuteParamRec &param);
+
+  void ffiSharedMemoryClose(ExecuteParamRec &param);
+
+  PVSSulonglong ffiQueueCreate(ExecuteParamRec &param);
+
+  void ffiQueueDestroy(ExecuteParamRec &param);
+
+  PVSSulonglong ffiQueueGetPushFunction(ExecuteParamRec &param);
+
+  DynVar *ffiQueuePopBatch(ExecuteParamRec &param);
+
+  MappingVar *ffiQueueGetStats(ExecuteParamRec &param);
+
+  bool ffiIsolateLibrary(ExecuteParamRec &param);
+
+  PVSSulonglong ffiStartSampler(ExecuteParamRec &param);
+
+  MappingVar *ffiReadSamples(ExecuteParamRec &param);
+
+  void ffiStopSampler(ExecuteParamRec &param);
+
+  MappingVar *ffiGetSamplerStats(ExecuteParamRec &param);
+
+  bool ffiStartRecording(ExecuteParamRec &param);
+
+  MappingVar *ffiStopRecording(ExecuteParamRec &param);
+
+  bool ffiSetProfiling(ExecuteParamRec &param);
+
+  PVSSulonglong ffiCreateView(ExecuteParamRec &param);
+
+  Variable *ffiViewGet(ExecuteParamRec &param);
+
+  PVSSulonglong ffiViewSlice(ExecuteParamRec &param);
+
+  unsigned int ffiViewFind(ExecuteParamRec &param);
+
+  void ffiDestroyView(ExecuteParamRec &param);
+
+  PVSSulonglong ffiSnapshotCreate(ExecuteParamRec &param);
+  MappingVar *ffiSnapshotDiff(ExecuteParamRec &param);
+  void ffiSnapshotDestroy(ExecuteParamRec &param);
+
+  PVSSulonglong ffiCreatePipeline(ExecuteParamRec &param);
+  bool ffiRunPipeline(ExecuteParamRec &param);
+  void ffiDestroyPipeline(ExecuteParamRec &param);
+
+  PVSSulonglong ffiCreateSink(ExecuteParamRec &param);
+  bool ffiFlushSink(ExecuteParamRec &param);
+  MappingVar *ffiGetSinkStats(ExecuteParamRec &param);
+  void ffiDestroySink(ExecuteParamRec &param);
+  bool ffiBufferToSink(ExecuteParamRec &param);
+  PVSSulonglong ffiSamplesToSink(ExecuteParamRec &param);
+
 // helpers
+  /// Reads the return type and the parameter types of a declaration, starting
+  /// with the argument at index firstType, and prepares the call interface.
+  /// Returns false if one of the types is invalid.
+  static bool readSignature(ExecuteParamRec &param, unsigned int firstType, FFIFunction &function);
+
+  /// Stores a new function declaration and returns its id
+  unsigned int addFunction(FFIFunction *function);
+
+  /// Returns the function with the given id, or 0 if there is none
+  FFIFunction *findFunction(unsigned int funcId) const;
+
   /// Returns the ffi_type struct to be used for an IntegralType
   static ffi_type *getFFIType(int type);
 
+  /// Returns true if a parameter of the given type can return a value to Ctrl
+  static bool canCarryOutput(int type);
+
+  /// Returns true if a parameter of the given type receives a value, but
+  /// cannot pass one (CTRLFFI_STRING_OUT, CTRLFFI_POINTER_OUT)
+  static bool isOutputOnly(int type);
+
+  /// Returns the IntegralType of a type combined with byte order flags,
+  /// or CTRLFFI_MAX_VALUE if other flags are set
+  static int getMemoryBaseType(int type);
+
+  /// Returns true if the value of a type combined with byte order flags is
+  /// stored in memory with the other byte order than the host
+  static bool needsByteSwap(int type);
+
   /// Returns true if the given type is valid for readAddress and writeAddress
   static bool isValidForRawMemoryOperation(int type);
 
-  /// Reads from a pointer to a new Ctrl var
-  static Variable *readAddress(int type, const char *buffer);
+  /// Resolves a dyn_int of field types into a layout.
+  /// Returns false if one of the types is not valid for a struct field.
+  static bool getStructLayout(DynVar &fieldTypes, StructLayout &layout);
+
+  /// Reads a struct into a new dyn
+  static DynVar *readStruct(const StructLayout &layout, const char *buffer);
 
-  /// Writes from a Ctrl var to a pointer
-  static void writeAddress(int type, char *buffer, const Variable &var);
+  /// Returns the queue for a handle from ffiQueueCreate, or 0 if there is none
+  FFIQueue *findQueue(PVSSulonglong handle) const;
+
+  /// Returns the sampler for a handle from ffiStartSampler, or 0 if there is none
+  SamplerEntry *findSampler(PVSSulonglong handle) const;
+
+  /// Creates a view and adds it to the list. Returns its handle, or 0 if the
+  /// field types are invalid or the items do not fit into a tracked buffer.
+  PVSSulonglong addView(const char *buffer, const DynVar &fieldTypes, bool isStruct,
+                        size_t count, size_t stride, bool defaultStride);
+
+  /// Returns the view for a handle from ffiCreateView, or 0 if there is none
+  BufferView *findView(PVSSulonglong handle) const;
+
+  /// Returns the snapshot for a handle from ffiSnapshotCreate, or 0 if there is none
+  std::vector<char> *findSnapshot(PVSSulonglong handle) const;
+
+  /// Creates a step of a pipeline from its description. The steps before
+  /// it are needed to check the bindings. Returns 0 if the description is invalid.
+  PipelineStep *createPipelineStep(const Variable &description, const Pipeline &pipeline) const;
+
+  /// Returns the pipeline for a handle from ffiCreatePipeline, or 0 if there is none
+  Pipeline *findPipeline(PVSSulonglong handle) const;
+
+  /// Returns the address of the value in memory for the storage of an
+  /// argument or return value, as returned by FFIValue::getPtr(). For _PTR
+  /// types and out slots, this is the value the pointer points to. Sets size
+  /// to the size of the value, or to 0 if it has none (FFI_VOID).
+  static void *getValueAddress(int type, void *ptr, size_t &size);
+
+  /// Checks the layout of a matrix with the leading dimension in items, and
+  /// sets it to the default if it is 0. Returns false if it is too small, or
+  /// if the matrix exceeds a buffer from ffiAllocBuffer.
+  bool checkMatrix(const char *buffer, size_t rows, size_t cols, size_t itemSize,
+                   bool colMajor, size_t &leadingDim) const;
+
+  /// Returns the sink for a handle from ffiCreateSink, or 0 if there is none
+  FFISink *findSink(PVSSulonglong handle) const;
+
+  /// Stops and deletes all samplers of a function
+  void stopSamplers(const FFIFunction *function);
+
+  /// Returns the host of an isolated library, or 0 if the library is not isolated
+  FFIRemoteHost *findRemoteHost(const char *libPath) const;
+
+  /// Adds the function to the perf map, if it is open and the code of the
+  /// function is not part of a mapped file
+  void addToPerfMap(unsigned int funcId, const FFIFunction *function);
+
+  /// Writes the declaration of the function if necessary, and starts a call
+  /// record with the inputs of the arguments
+  void recordCall(unsigned int funcId, const FFIFunction *function, const std::vector<void *> &argValues);
+
+  /// Frees memory returned through an out slot with its deallocator
+  void freeOutput(const OutputDeallocator &deallocator, void *memory) const;
+
+  /// Reads from a pointer into a Ctrl var of any type, without allocations.
+  /// Returns false if the type has no value in memory.
+  static bool readAddress(int type, const char *buffer, Variable &target);
+
+  /// Writes from a Ctrl var to a pointer, without allocations.
+  /// Returns false if the type has no value in memory.
+  static bool writeAddress(int type, char *buffer, const Variable &var);
 
 // members
-  /// List of the declared functions
-  SimplePtrArray<FFIFunction> functions;
+  /// List of the declared functions. The lower bits of a function id are
+  /// the one-based index in this list, the upper bits the slot generation.
+  std::vector<FunctionSlot> functions;
+
+  /// Indices of the free slots in the function list
+  std::vector<unsigned int> freeFunctionSlots;
+
+  /// The libraries used by declared functions
+  FFILibraryCache libraries;
+
+  /// The live buffers allocated by ffiAllocBuffer
+  FFIMemoryTracker memoryTracker;
+
+  /// List of the shared memory regions mapped by ffiSharedMemoryCreate/Open
+  std::vector<FFISharedMemory *> sharedMemories;
+
+  /// List of the queues created by ffiQueueCreate
+  std::vector<FFIQueue *> queues;
+
+  /// The hosts of the libraries isolated by ffiIsolateLibrary
+  std::vector<FFIRemoteHost *> remoteHosts;
+
+  /// List of the samplers started by ffiStartSampler
+  std::vector<SamplerEntry *> samplers;
+
+  /// List of the views created by ffiCreateView
+  std::vector<BufferView *> views;
+
+  /// List of the copies of memory taken by ffiSnapshotCreate
+  std::vector<std::vector<char> *> snapshots;
+
+  /// List of the pipelines created by ffiCreatePipeline
+  std::vector<Pipeline *> pipelines;
+
+  /// List of the sinks created by ffiCreateSink
+  std::vector<FFISink *> sinks;
+
+  /// The log written by ffiStartRecording, or 0 if calls are not recorded
+  FFIRecorder *recorder;
+
+  /// The map of the function addresses for perf, opened by ffiSetProfiling
+  FFIPerfMap perfMap;
+
+  /// True if the probes get the location of the calling script
+  bool traceLocations;
 
   /// The number of the CTRLFFI -dbg flag
   static PVSSshort dbgFlag;
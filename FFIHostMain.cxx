@@ -0,0 +1,270 @@
+// CtrlFFIHost: executes the functions of an isolated library for CtrlFFI.
+//
+// Usage: CtrlFFIHost <shared memory name>
+//
+// The host is started by FFIRemoteHost and talks to it through the
+// FFIHostChannel in the given shared memory region. See FFIHostProtocol.hxx.
+
+#include <FFIHostProtocol.hxx>
+#include <FFISharedMemory.hxx>
+
+#include <cstring>
+#include <vector>
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/prctl.h>
+
+/// A function declared by CtrlFFI
+struct HostFunction
+{
+  void (*funcPtr)();
+  int returnType;
+  std::vector<int> argTypes;
+  std::vector<ffi_type *> ffiArgTypes;
+  ffi_cif callInterface;
+};
+
+/// Stores the return value of ffi_call(), which is at least as large as ffi_arg
+union HostReturnValue
+{
+  ffi_arg integer;
+  unsigned long long uint64;
+  double floating;
+  void *pointer;
+};
+
+//------------------------------------------------------------------------------
+
+/// Handles HOST_DECLARE. Returns the index of the new function, or -1.
+static int declareFunction(FFIHostChannel *channel, std::vector<HostFunction *> &functions)
+{
+  const char *data = channel->data;
+  const char *end = data + channel->dataSize;
+
+  const char *libPath = data;
+  const char *funcName = libPath + strlen(libPath) + 1;
+  data = funcName + strlen(funcName) + 1;
+
+  int header[2];
+  if (data + sizeof(header) > end)
+  {
+    return -1;
+  }
+
+  memcpy(header, data, sizeof(header));
+  data += sizeof(header);
+
+  if (header[1] < 0 || data + header[1] * sizeof(int) > end)
+  {
+    return -1;
+  }
+
+  HostFunction *function = new HostFunction();
+  function->returnType = header[0];
+  function->argTypes.resize(header[1]);
+  function->ffiArgTypes.resize(header[1]);
+
+  if (header[1])
+  {
+    memcpy(&function->argTypes[0], data, header[1] * sizeof(int));
+  }
+
+  for (int i = 0; i < header[1]; ++i)
+  {
+    function->ffiArgTypes[i] = isValidForHost(function->argTypes[i]) ? getHostFFIType(function->argTypes[i]) : 0;
+    if (! function->ffiArgTypes[i] || function->argTypes[i] == CTRLFFI_VOID)
+    {
+      delete function;
+      return -1;
+    }
+  }
+
+  ffi_type *returnType = isValidForHost(function->returnType) ? getHostFFIType(function->returnType) : 0;
+
+  // the handle is kept until the host exits, dlopen() counts the references
+  void *library = dlopen(libPath, RTLD_NOW | RTLD_LOCAL);
+  void *symbol = library ? dlsym(library, funcName) : 0;
+
+  if (! returnType || ! symbol ||
+      ffi_prep_cif(&function->callInterface, FFI_DEFAULT_ABI, header[1], returnType,
+                   header[1] ? &function->ffiArgTypes[0] : 0) != FFI_OK)
+  {
+    delete function;
+    return -1;
+  }
+
+  function->funcPtr = reinterpret_cast<void (*)()>(symbol);
+  functions.push_back(function);
+
+  return (int) functions.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+
+/// Handles HOST_CALL. Returns 0 on success, -1 on failure.
+static int callFunction(FFIHostChannel *channel, const std::vector<HostFunction *> &functions)
+{
+  if (channel->function < 0 || channel->function >= (int) functions.size())
+  {
+    return -1;
+  }
+
+  const HostFunction *function = functions[channel->function];
+  size_t argCount = function->argTypes.size();
+  char *data = channel->data;
+  size_t dataSize = channel->dataSize;
+
+  if ((1 + argCount) * HOST_SLOT_SIZE > dataSize)
+  {
+    return -1;
+  }
+
+  // libffi wants the address of each argument. for pointers and strings,
+  // that is the address of the pointer.
+  std::vector<void *> pointers(argCount);
+  std::vector<void *> argValues(argCount);
+
+  for (size_t i = 0; i < argCount; ++i)
+  {
+    int type = function->argTypes[i];
+    char *slot = data + (i + 1) * HOST_SLOT_SIZE;
+
+    if (type == CTRLFFI_STRING)
+    {
+      unsigned long long offset;
+      memcpy(&offset, slot, sizeof(offset));
+
+      if (offset != HOST_NULL_STRING && offset >= dataSize)
+      {
+        return -1;
+      }
+
+      pointers[i] = (offset == HOST_NULL_STRING) ? 0 : data + offset;
+      argValues[i] = &pointers[i];
+    }
+    else if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+    {
+      pointers[i] = slot;
+      argValues[i] = &pointers[i];
+    }
+    else
+    {
+      argValues[i] = slot;
+    }
+  }
+
+  HostReturnValue returnValue;
+  memset(&returnValue, 0, sizeof(returnValue));
+
+  ffi_call(const_cast<ffi_cif *>(&function->callInterface), function->funcPtr,
+           &returnValue, argCount ? &argValues[0] : 0);
+
+  // store the result in the return value slot
+  int returnType = function->returnType;
+
+  if (returnType == CTRLFFI_STRING)
+  {
+    // copy the text behind the arguments, and truncate it if it does not fit
+    unsigned long long offset = HOST_NULL_STRING;
+    const char *text = static_cast<const char *>(returnValue.pointer);
+
+    if (text && dataSize < HOST_DATA_SIZE)
+    {
+      size_t length = strlen(text);
+      if (length > HOST_DATA_SIZE - dataSize - 1)
+      {
+        length = HOST_DATA_SIZE - dataSize - 1;
+      }
+
+      memcpy(data + dataSize, text, length);
+      data[dataSize + length] = 0;
+      offset = dataSize;
+    }
+
+    memcpy(data, &offset, sizeof(offset));
+  }
+  else if (returnType != CTRLFFI_VOID)
+  {
+    // libffi widens integral return values to ffi_arg
+    size_t size = getHostValueSize(returnType);
+    ffi_type *ffiType = getHostFFIType(returnType);
+
+    if (ffiType->type != FFI_TYPE_FLOAT && ffiType->type != FFI_TYPE_DOUBLE &&
+        ffiType->type != FFI_TYPE_POINTER && size < sizeof(ffi_arg))
+    {
+      unsigned char value8 = (unsigned char) returnValue.integer;
+      unsigned short value16 = (unsigned short) returnValue.integer;
+      unsigned int value32 = (unsigned int) returnValue.integer;
+
+      switch (size)
+      {
+        case 1: memcpy(data, &value8, 1); break;
+        case 2: memcpy(data, &value16, 2); break;
+        case 4: memcpy(data, &value32, 4); break;
+        default: return -1;
+      }
+    }
+    else
+    {
+      memcpy(data, &returnValue, size);
+    }
+  }
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    return 2;
+  }
+
+  // do not outlive CtrlFFI, e.g. if the manager crashed itself
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+  FFISharedMemory *sharedMemory = FFISharedMemory::open(argv[1]);
+  if (! sharedMemory || sharedMemory->getSize() < sizeof(FFIHostChannel))
+  {
+    return 1;
+  }
+
+  FFIHostChannel *channel = static_cast<FFIHostChannel *>(sharedMemory->getAddress());
+  std::vector<HostFunction *> functions;
+
+  hostSetState(channel, HOST_IDLE);
+
+  while (true)
+  {
+    int state = channel->state;
+    while (state != HOST_REQUEST)
+    {
+      // the timeout only limits the sleep, CtrlFFI wakes us up
+      state = hostWaitWhile(channel, state, 1000);
+    }
+
+    switch (channel->command)
+    {
+      case HOST_DECLARE:
+        channel->status = declareFunction(channel, functions);
+        break;
+
+      case HOST_CALL:
+        channel->status = callFunction(channel, functions);
+        break;
+
+      case HOST_SHUTDOWN:
+        delete sharedMemory;
+        return 0;
+
+      default:
+        channel->status = -1;
+        break;
+    }
+
+    hostSetState(channel, HOST_RESPONSE);
+  }
+}
@@ -0,0 +1,185 @@
+#ifndef _FFIHOSTPROTOCOL_H_
+#define _FFIHOSTPROTOCOL_H_
+
+#include <FFITypes.hxx>
+
+#include <ffi.h>
+
+#include <stddef.h>
+
+#ifndef _WIN32
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Protocol between CtrlFFI and the CtrlFFIHost helper process, which loads an
+// isolated library and executes its functions.
+//
+// Both processes map an FFIHostChannel in shared memory. CtrlFFI writes a
+// request, sets the state to HOST_REQUEST and wakes up the host. The host
+// executes it, writes the response and sets the state to HOST_RESPONSE.
+// Waiting is done with futexes on the state word.
+//
+// The data of a call starts with one 8 byte slot for the return value and
+// one for each argument:
+//  - scalars are stored at the start of their slot
+//  - _PTR types store the value they point to, and receive the new value
+//  - FFI_POINTER is passed through unchanged, so it only works for opaque handles
+//  - FFI_STRING stores the offset of the string in the data area, or
+//    HOST_NULL_STRING. Returned strings are copied into the data area as well.
+
+/// Values of FFIHostChannel::state
+enum FFIHostState
+{
+  /// Set by CtrlFFI before the host is started, until the host mapped the channel
+  HOST_STARTING = 0,
+  HOST_IDLE,
+  HOST_REQUEST,
+  HOST_RESPONSE
+};
+
+/// Values of FFIHostChannel::command
+enum FFIHostCommand
+{
+  /// Declare a function. data: library path, function name (both
+  /// null-terminated), return type, arg count, arg types (all int32)
+  HOST_DECLARE = 1,
+  /// Call a function. function: index from HOST_DECLARE, data: the slots
+  HOST_CALL,
+  /// Stop the host process
+  HOST_SHUTDOWN
+};
+
+/// Size of one argument slot
+static const size_t HOST_SLOT_SIZE = 8;
+
+/// Offset that marks a null string
+static const unsigned long long HOST_NULL_STRING = ~0ULL;
+
+/// Size of the data area of the channel
+static const size_t HOST_DATA_SIZE = 1024 * 1024;
+
+/// The shared memory layout used by CtrlFFI and CtrlFFIHost
+struct FFIHostChannel
+{
+  /// FFIHostState, also used as futex word
+  volatile int state;
+  /// FFIHostCommand of the current request
+  int command;
+  /// Function index of the current call
+  int function;
+  /// Result of the request. 0 or a function index on success, -1 on failure.
+  int status;
+  /// Number of used bytes in data
+  unsigned int dataSize;
+  /// Arguments and results. 8 byte alignment for the slots.
+  union
+  {
+    unsigned long long align;
+    char data[HOST_DATA_SIZE];
+  };
+};
+
+/// Returns true if the type can be used with an isolated library
+inline bool isValidForHost(int type)
+{
+  return (type > CTRLFFI_FIRST_VALUE_TYPE && type < CTRLFFI_LAST_VALUE_TYPE) ||
+         (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR) ||
+         type == CTRLFFI_POINTER || type == CTRLFFI_VOID || type == CTRLFFI_STRING;
+}
+
+/// Returns the ffi_type for a type that is valid for the host
+inline ffi_type *getHostFFIType(int type)
+{
+  if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+  {
+    return &ffi_type_pointer;
+  }
+
+  switch (type)
+  {
+    case CTRLFFI_UCHAR:   return &ffi_type_uchar;
+    case CTRLFFI_CHAR:    return &ffi_type_schar;
+    case CTRLFFI_USHORT:  return &ffi_type_ushort;
+    case CTRLFFI_SHORT:   return &ffi_type_sshort;
+    case CTRLFFI_UINT:    return &ffi_type_uint;
+    case CTRLFFI_INT:     return &ffi_type_sint;
+    case CTRLFFI_ULONG:   return &ffi_type_ulong;
+    case CTRLFFI_LONG:    return &ffi_type_slong;
+    case CTRLFFI_FLOAT:   return &ffi_type_float;
+    case CTRLFFI_DOUBLE:  return &ffi_type_double;
+    case CTRLFFI_UINT8:   return &ffi_type_uint8;
+    case CTRLFFI_INT8:    return &ffi_type_sint8;
+    case CTRLFFI_UINT16:  return &ffi_type_uint16;
+    case CTRLFFI_INT16:   return &ffi_type_sint16;
+    case CTRLFFI_UINT32:  return &ffi_type_uint32;
+    case CTRLFFI_INT32:   return &ffi_type_sint32;
+    case CTRLFFI_UINT64:  return &ffi_type_uint64;
+    case CTRLFFI_INT64:   return &ffi_type_sint64;
+    case CTRLFFI_STRING:  // fall through
+    case CTRLFFI_POINTER: return &ffi_type_pointer;
+    case CTRLFFI_VOID:    return &ffi_type_void;
+    default: break;
+  }
+
+  return 0;
+}
+
+/// Returns the number of bytes stored in the slot of a type
+inline size_t getHostValueSize(int type)
+{
+  if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+  {
+    // the value behind the pointer
+    return getHostFFIType(type - CTRLFFI_FIRST_PTR + CTRLFFI_FIRST_VALUE_TYPE)->size;
+  }
+
+  if (type == CTRLFFI_VOID)
+  {
+    return 0;
+  }
+
+  return getHostFFIType(type)->size;
+}
+
+#ifndef _WIN32
+
+/// Number of polls of the state before a process goes to sleep. Keeps the
+/// latency of short calls low without burning a core while idle.
+static const int HOST_SPIN_COUNT = 2000;
+
+/// Waits until the state is not oldState anymore, or the timeout (in ms) expired.
+/// Returns the current state.
+inline int hostWaitWhile(FFIHostChannel *channel, int oldState, int timeoutMs)
+{
+  for (int i = 0; i < HOST_SPIN_COUNT; ++i)
+  {
+    int state = __atomic_load_n(&channel->state, __ATOMIC_ACQUIRE);
+    if (state != oldState)
+    {
+      return state;
+    }
+  }
+
+  struct timespec timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+
+  // FUTEX_WAIT returns immediately if the state changed in the meantime
+  syscall(SYS_futex, &channel->state, FUTEX_WAIT, oldState, &timeout, 0, 0);
+
+  return __atomic_load_n(&channel->state, __ATOMIC_ACQUIRE);
+}
+
+/// Sets the state and wakes up the other process
+inline void hostSetState(FFIHostChannel *channel, int newState)
+{
+  __atomic_store_n(&channel->state, newState, __ATOMIC_RELEASE);
+  syscall(SYS_futex, &channel->state, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+#endif
+
+#endif // _FFIHOSTPROTOCOL_H_
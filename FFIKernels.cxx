@@ -0,0 +1,1002 @@
+#include <FFIKernels.hxx>
+
+#include <FFITypes.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CTRLFFI_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <nmmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CTRLFFI_TARGET(name)
+#else
+#define CTRLFFI_TARGET(name) __attribute__((target(name)))
+#endif
+
+const size_t FFIKernels::NOT_FOUND;
+
+//------------------------------------------------------------------------------
+// CPU feature detection
+
+#ifdef CTRLFFI_X86
+
+/// Returns the ecx (index 0) or edx (index 1) register of cpuid leaf 1
+static unsigned int getCpuFeatures(int index)
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (unsigned int) info[index ? 3 : 2];
+#else
+  unsigned int eax = 1, ebx, ecx = 0, edx;
+  __asm__ __volatile__("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  return index ? edx : ecx;
+#endif
+}
+
+bool FFIKernels::hasSSE2()
+{
+  static const bool supported = (getCpuFeatures(1) & (1u << 26)) != 0;
+  return supported;
+}
+
+bool FFIKernels::hasSSSE3()
+{
+  static const bool supported = (getCpuFeatures(0) & (1u << 9)) != 0;
+  return supported;
+}
+
+bool FFIKernels::hasSSE42()
+{
+  static const bool supported = (getCpuFeatures(0) & (1u << 20)) != 0;
+  return supported;
+}
+
+#else
+
+bool FFIKernels::hasSSE2() { return false; }
+bool FFIKernels::hasSSSE3() { return false; }
+bool FFIKernels::hasSSE42() { return false; }
+
+#endif // CTRLFFI_X86
+
+//------------------------------------------------------------------------------
+// byte swapping
+
+/// Portable version of swapBytes for one item size
+template <size_t Size>
+static void swapBytesScalar(unsigned char *data, size_t count)
+{
+  for (size_t i = 0; i < count; ++i, data += Size)
+  {
+    for (size_t j = 0; j < Size / 2; ++j)
+    {
+      unsigned char tmp = data[j];
+      data[j] = data[Size - 1 - j];
+      data[Size - 1 - j] = tmp;
+    }
+  }
+}
+
+#ifdef CTRLFFI_X86
+
+/// SSSE3 version of swapBytes, reverses the items in 16 byte blocks with a
+/// single shuffle each. The remaining items are swapped by the scalar version.
+template <size_t Size>
+CTRLFFI_TARGET("ssse3")
+static void swapBytesSSSE3(unsigned char *data, size_t count)
+{
+  // shuffle mask, which reverses the bytes within each item
+  unsigned char maskBytes[16];
+  for (size_t i = 0; i < 16; ++i)
+  {
+    maskBytes[i] = (unsigned char) ((i / Size) * Size + (Size - 1 - i % Size));
+  }
+
+  const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(maskBytes));
+  const size_t itemsPerBlock = 16 / Size;
+
+  size_t blocks = count / itemsPerBlock;
+  for (size_t i = 0; i < blocks; ++i, data += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(data), _mm_shuffle_epi8(block, mask));
+  }
+
+  swapBytesScalar<Size>(data, count - blocks * itemsPerBlock);
+}
+
+#endif // CTRLFFI_X86
+
+/// Selects the best version of swapBytes for one item size
+template <size_t Size>
+static void swapBytesDispatch(unsigned char *data, size_t count)
+{
+#ifdef CTRLFFI_X86
+  if (FFIKernels::hasSSSE3())
+  {
+    swapBytesSSSE3<Size>(data, count);
+    return;
+  }
+#endif
+
+  swapBytesScalar<Size>(data, count);
+}
+
+void FFIKernels::swapBytes(void *data, size_t itemSize, size_t count)
+{
+  unsigned char *bytes = static_cast<unsigned char *>(data);
+
+  switch (itemSize)
+  {
+    case 2: swapBytesDispatch<2>(bytes, count); break;
+    case 4: swapBytesDispatch<4>(bytes, count); break;
+    case 8: swapBytesDispatch<8>(bytes, count); break;
+    default: break;
+  }
+}
+
+//------------------------------------------------------------------------------
+// transposition
+
+/// Edge length of the blocks of transpose() in items. A block of 8 byte items
+/// from src and the block it is written to take 16 KiB, half of a typical L1 cache.
+static const size_t TRANSPOSE_BLOCK = 32;
+
+/// Transposes one block. Items are copied with memcpy, since the matrices
+/// do not need to be aligned. For a constant size, this is a single move.
+template <size_t Size>
+static void transposeBlock(unsigned char *dest, size_t destStride, const unsigned char *src, size_t srcStride,
+                           size_t rows, size_t cols, size_t itemSize)
+{
+  const size_t size = Size ? Size : itemSize;
+
+  // the rows of dest are written sequentially, the columns of src are read
+  // from the few cache lines of the block
+  for (size_t c = 0; c < cols; ++c)
+  {
+    unsigned char *to = dest + c * destStride * size;
+    const unsigned char *from = src + c * size;
+
+    for (size_t r = 0; r < rows; ++r)
+    {
+      memcpy(to + r * size, from + r * srcStride * size, size);
+    }
+  }
+}
+
+template <size_t Size>
+static void transposeBlocked(unsigned char *dest, size_t destStride, const unsigned char *src, size_t srcStride,
+                             size_t rows, size_t cols, size_t itemSize)
+{
+  const size_t size = Size ? Size : itemSize;
+
+  for (size_t r = 0; r < rows; r += TRANSPOSE_BLOCK)
+  {
+    size_t blockRows = (rows - r < TRANSPOSE_BLOCK) ? rows - r : TRANSPOSE_BLOCK;
+
+    for (size_t c = 0; c < cols; c += TRANSPOSE_BLOCK)
+    {
+      size_t blockCols = (cols - c < TRANSPOSE_BLOCK) ? cols - c : TRANSPOSE_BLOCK;
+
+      transposeBlock<Size>(dest + (c * destStride + r) * size, destStride,
+                           src + (r * srcStride + c) * size, srcStride,
+                           blockRows, blockCols, itemSize);
+    }
+  }
+}
+
+void FFIKernels::transpose(void *dest, size_t destStride, const void *src, size_t srcStride,
+                           size_t rows, size_t cols, size_t itemSize)
+{
+  unsigned char *to = static_cast<unsigned char *>(dest);
+  const unsigned char *from = static_cast<const unsigned char *>(src);
+
+  switch (itemSize)
+  {
+    case 1:  transposeBlocked<1>(to, destStride, from, srcStride, rows, cols, itemSize); break;
+    case 2:  transposeBlocked<2>(to, destStride, from, srcStride, rows, cols, itemSize); break;
+    case 4:  transposeBlocked<4>(to, destStride, from, srcStride, rows, cols, itemSize); break;
+    case 8:  transposeBlocked<8>(to, destStride, from, srcStride, rows, cols, itemSize); break;
+    default: transposeBlocked<0>(to, destStride, from, srcStride, rows, cols, itemSize); break;
+  }
+}
+
+//------------------------------------------------------------------------------
+// searching
+
+#ifdef CTRLFFI_X86
+
+/// Returns the index of the lowest set bit. mask must not be zero.
+static unsigned int lowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned int) index;
+#else
+  return (unsigned int) __builtin_ctz(mask);
+#endif
+}
+
+/// SSE2 version of findByte, compares 16 bytes at once
+CTRLFFI_TARGET("sse2")
+static size_t findByteSSE2(const unsigned char *data, size_t size, unsigned char value)
+{
+  const __m128i needle = _mm_set1_epi8((char) value);
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+
+    if (mask)
+    {
+      return i + lowestBit(mask);
+    }
+  }
+
+  const void *found = memchr(data + i, value, size - i);
+  return found ? static_cast<const unsigned char *>(found) - data : FFIKernels::NOT_FOUND;
+}
+
+/// SSE2 version of find. Compares the first and the last byte of the
+/// pattern at 16 positions at once, and only checks the positions where
+/// both match completely.
+CTRLFFI_TARGET("sse2")
+static size_t findSSE2(const unsigned char *data, size_t size, const unsigned char *pattern, size_t patternSize)
+{
+  const __m128i first = _mm_set1_epi8((char) pattern[0]);
+  const __m128i last = _mm_set1_epi8((char) pattern[patternSize - 1]);
+
+  // number of possible start positions
+  size_t positions = size - patternSize + 1;
+
+  size_t i = 0;
+  for (; i + 16 <= positions; i += 16)
+  {
+    __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + patternSize - 1));
+
+    unsigned int mask = (unsigned int) _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+
+    while (mask)
+    {
+      unsigned int bit = lowestBit(mask);
+      if (memcmp(data + i + bit + 1, pattern + 1, patternSize - 2) == 0)
+      {
+        return i + bit;
+      }
+
+      mask &= mask - 1;
+    }
+  }
+
+  for (; i < positions; ++i)
+  {
+    if (data[i] == pattern[0] && memcmp(data + i, pattern, patternSize) == 0)
+    {
+      return i;
+    }
+  }
+
+  return FFIKernels::NOT_FOUND;
+}
+
+/// SSE2 version of findMismatch. Compares 64 bytes per iteration, and
+/// only locates the difference in a block where one was found.
+CTRLFFI_TARGET("sse2")
+static size_t findMismatchSSE2(const unsigned char *a, const unsigned char *b, size_t size)
+{
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64)
+  {
+    __m128i equal0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    __m128i equal1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 16)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 16)));
+    __m128i equal2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 32)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 32)));
+    __m128i equal3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i + 48)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 48)));
+
+    __m128i equal = _mm_and_si128(_mm_and_si128(equal0, equal1), _mm_and_si128(equal2, equal3));
+    if (_mm_movemask_epi8(equal) != 0xffff)
+    {
+      break;
+    }
+  }
+
+  for (; i + 16 <= size; i += 16)
+  {
+    __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    unsigned int mask = ~(unsigned int) _mm_movemask_epi8(equal) & 0xffff;
+
+    if (mask)
+    {
+      return i + lowestBit(mask);
+    }
+  }
+
+  for (; i < size; ++i)
+  {
+    if (a[i] != b[i])
+    {
+      return i;
+    }
+  }
+
+  return FFIKernels::NOT_FOUND;
+}
+
+#endif // CTRLFFI_X86
+
+size_t FFIKernels::findMismatch(const void *a, const void *b, size_t size)
+{
+  const unsigned char *bytesA = static_cast<const unsigned char *>(a);
+  const unsigned char *bytesB = static_cast<const unsigned char *>(b);
+
+#ifdef CTRLFFI_X86
+  if (hasSSE2())
+  {
+    return findMismatchSSE2(bytesA, bytesB, size);
+  }
+#endif
+
+  // compare 8 bytes at once, then locate the difference bytewise
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    unsigned long long wordA, wordB;
+    memcpy(&wordA, bytesA + i, 8);
+    memcpy(&wordB, bytesB + i, 8);
+
+    if (wordA != wordB)
+    {
+      break;
+    }
+  }
+
+  for (; i < size; ++i)
+  {
+    if (bytesA[i] != bytesB[i])
+    {
+      return i;
+    }
+  }
+
+  return NOT_FOUND;
+}
+
+size_t FFIKernels::findByte(const void *data, size_t size, unsigned char value)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+#ifdef CTRLFFI_X86
+  if (hasSSE2())
+  {
+    return findByteSSE2(bytes, size, value);
+  }
+#endif
+
+  const void *found = memchr(bytes, value, size);
+  return found ? static_cast<const unsigned char *>(found) - bytes : NOT_FOUND;
+}
+
+size_t FFIKernels::find(const void *data, size_t size, const void *pattern, size_t patternSize)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  const unsigned char *patternBytes = static_cast<const unsigned char *>(pattern);
+
+  if (patternSize == 0)
+  {
+    return 0;
+  }
+
+  if (patternSize > size)
+  {
+    return NOT_FOUND;
+  }
+
+  if (patternSize == 1)
+  {
+    return findByte(data, size, patternBytes[0]);
+  }
+
+#ifdef CTRLFFI_X86
+  if (hasSSE2())
+  {
+    return findSSE2(bytes, size, patternBytes, patternSize);
+  }
+#endif
+
+  // memchr for the first byte, then compare the rest
+  size_t positions = size - patternSize + 1;
+  for (size_t i = 0; i < positions; ++i)
+  {
+    const void *found = memchr(bytes + i, patternBytes[0], positions - i);
+    if (! found)
+    {
+      break;
+    }
+
+    i = static_cast<const unsigned char *>(found) - bytes;
+    if (memcmp(bytes + i + 1, patternBytes + 1, patternSize - 1) == 0)
+    {
+      return i;
+    }
+  }
+
+  return NOT_FOUND;
+}
+
+//------------------------------------------------------------------------------
+// checksums
+
+/// Lookup tables for the table driven CRC versions. Slicing-by-8 for the
+/// 32 bit CRCs: table[k][b] is the CRC of byte b followed by k zero bytes.
+struct CrcTables
+{
+  CrcTables()
+  {
+    fill(crc32, 0xEDB88320u);
+    fill(crc32c, 0x82F63B78u);
+
+    for (unsigned int b = 0; b < 256; ++b)
+    {
+      unsigned int crc = b;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001u : (crc >> 1);
+      }
+
+      crc16Modbus[b] = (unsigned short) crc;
+    }
+  }
+
+  static void fill(unsigned int table[8][256], unsigned int polynomial)
+  {
+    for (unsigned int b = 0; b < 256; ++b)
+    {
+      unsigned int crc = b;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+        crc = (crc & 1) ? (crc >> 1) ^ polynomial : (crc >> 1);
+      }
+
+      table[0][b] = crc;
+    }
+
+    for (int k = 1; k < 8; ++k)
+    {
+      for (unsigned int b = 0; b < 256; ++b)
+      {
+        table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+      }
+    }
+  }
+
+  unsigned int crc32[8][256];
+  unsigned int crc32c[8][256];
+  unsigned short crc16Modbus[256];
+};
+
+static const CrcTables crcTables;
+
+/// Portable slicing-by-8 CRC-32, processes 8 bytes per step
+static unsigned int crc32Scalar(const unsigned int table[8][256], const unsigned char *data, size_t size)
+{
+  unsigned int crc = 0xFFFFFFFFu;
+
+  for (; size >= 8; size -= 8, data += 8)
+  {
+    // independent of the host byte order
+    unsigned int low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24));
+
+    crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+          table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+          table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+  }
+
+  for (; size > 0; --size, ++data)
+  {
+    crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xff];
+  }
+
+  return crc ^ 0xFFFFFFFFu;
+}
+
+#ifdef CTRLFFI_X86
+
+/// SSE4.2 version of crc32c, with the crc32 instruction
+CTRLFFI_TARGET("sse4.2")
+static unsigned int crc32cSSE42(const unsigned char *data, size_t size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+  unsigned long long crc = 0xFFFFFFFFu;
+
+  for (; size >= 8; size -= 8, data += 8)
+  {
+    unsigned long long value;
+    memcpy(&value, data, sizeof(value));
+    crc = _mm_crc32_u64(crc, value);
+  }
+#else
+  unsigned int crc = 0xFFFFFFFFu;
+
+  for (; size >= 4; size -= 4, data += 4)
+  {
+    unsigned int value;
+    memcpy(&value, data, sizeof(value));
+    crc = _mm_crc32_u32(crc, value);
+  }
+#endif
+
+  unsigned int crc32 = (unsigned int) crc;
+  for (; size > 0; --size, ++data)
+  {
+    crc32 = _mm_crc32_u8(crc32, *data);
+  }
+
+  return crc32 ^ 0xFFFFFFFFu;
+}
+
+#endif // CTRLFFI_X86
+
+unsigned int FFIKernels::crc32(const void *data, size_t size)
+{
+  return crc32Scalar(crcTables.crc32, static_cast<const unsigned char *>(data), size);
+}
+
+unsigned int FFIKernels::crc32c(const void *data, size_t size)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+#ifdef CTRLFFI_X86
+  if (hasSSE42())
+  {
+    return crc32cSSE42(bytes, size);
+  }
+#endif
+
+  return crc32Scalar(crcTables.crc32c, bytes, size);
+}
+
+unsigned short FFIKernels::crc16Modbus(const void *data, size_t size)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  unsigned int crc = 0xFFFF;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    crc = (crc >> 8) ^ crcTables.crc16Modbus[(crc ^ bytes[i]) & 0xff];
+  }
+
+  return (unsigned short) crc;
+}
+
+//------------------------------------------------------------------------------
+// hashing
+
+static const unsigned long long XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const unsigned long long XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const unsigned long long XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static unsigned long long rotateLeft(unsigned long long value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+/// Reads 8 bytes in little-endian byte order
+static unsigned long long readLE64(const unsigned char *data)
+{
+  unsigned long long value;
+  if (FFIKernels::isBigEndianHost())
+  {
+    FFIKernels::copySwapped(&value, data, sizeof(value));
+  }
+  else
+  {
+    memcpy(&value, data, sizeof(value));
+  }
+
+  return value;
+}
+
+/// Reads 4 bytes in little-endian byte order
+static unsigned long long readLE32(const unsigned char *data)
+{
+  return (unsigned long long) data[0] | ((unsigned long long) data[1] << 8) |
+         ((unsigned long long) data[2] << 16) | ((unsigned long long) data[3] << 24);
+}
+
+static unsigned long long xxhRound(unsigned long long acc, unsigned long long input)
+{
+  acc += input * XXH_PRIME64_2;
+  acc = rotateLeft(acc, 31);
+  return acc * XXH_PRIME64_1;
+}
+
+static unsigned long long xxhMergeRound(unsigned long long acc, unsigned long long value)
+{
+  acc ^= xxhRound(0, value);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+unsigned long long FFIKernels::hash64(const void *data, size_t size, unsigned long long seed)
+{
+  // the four independent lanes of the main loop keep the pipeline busy, so
+  // the compiler does a good job without explicit SIMD
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  const unsigned char *end = bytes + size;
+  unsigned long long hash;
+
+  if (size >= 32)
+  {
+    unsigned long long v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    unsigned long long v2 = seed + XXH_PRIME64_2;
+    unsigned long long v3 = seed;
+    unsigned long long v4 = seed - XXH_PRIME64_1;
+
+    for (; bytes + 32 <= end; bytes += 32)
+    {
+      v1 = xxhRound(v1, readLE64(bytes));
+      v2 = xxhRound(v2, readLE64(bytes + 8));
+      v3 = xxhRound(v3, readLE64(bytes + 16));
+      v4 = xxhRound(v4, readLE64(bytes + 24));
+    }
+
+    hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+    hash = xxhMergeRound(hash, v1);
+    hash = xxhMergeRound(hash, v2);
+    hash = xxhMergeRound(hash, v3);
+    hash = xxhMergeRound(hash, v4);
+  }
+  else
+  {
+    hash = seed + XXH_PRIME64_5;
+  }
+
+  hash += (unsigned long long) size;
+
+  for (; bytes + 8 <= end; bytes += 8)
+  {
+    hash ^= xxhRound(0, readLE64(bytes));
+    hash = rotateLeft(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+
+  if (bytes + 4 <= end)
+  {
+    hash ^= readLE32(bytes) * XXH_PRIME64_1;
+    hash = rotateLeft(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    bytes += 4;
+  }
+
+  for (; bytes < end; ++bytes)
+  {
+    hash ^= *bytes * XXH_PRIME64_5;
+    hash = rotateLeft(hash, 11) * XXH_PRIME64_1;
+  }
+
+  // final mix
+  hash ^= hash >> 33;
+  hash *= XXH_PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= XXH_PRIME64_3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+//------------------------------------------------------------------------------
+// reduction
+
+/// Number of items that are converted and reduced at once. The doubles of a
+/// block take 2 KiB, so they stay in the L1 cache for the second pass of
+/// the variance.
+static const size_t REDUCE_BLOCK = 256;
+
+/// Aggregates of a block of doubles
+struct BlockReduction
+{
+  double sum;
+  double min;
+  double max;
+  size_t above;
+  size_t below;
+};
+
+/// Converts n items of type T, which are stride bytes apart, to doubles
+template <typename T>
+static void loadBlock(const unsigned char *data, size_t stride, size_t n, bool byteSwap, double *values)
+{
+  T value;
+
+  if (byteSwap)
+  {
+    for (size_t i = 0; i < n; ++i, data += stride)
+    {
+      FFIKernels::copySwapped(&value, data, sizeof(T));
+      values[i] = (double) value;
+    }
+  }
+  else if (stride == sizeof(T))
+  {
+    // a constant stride, which the compiler can vectorize
+    for (size_t i = 0; i < n; ++i)
+    {
+      memcpy(&value, data + i * sizeof(T), sizeof(T));
+      values[i] = (double) value;
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < n; ++i, data += stride)
+    {
+      memcpy(&value, data, sizeof(T));
+      values[i] = (double) value;
+    }
+  }
+}
+
+typedef void (*LoadBlockFunction)(const unsigned char *data, size_t stride, size_t n, bool byteSwap, double *values);
+
+/// Returns the conversion of a numeric IntegralType, or 0 for other types
+static LoadBlockFunction getLoadBlock(int type)
+{
+  switch (type)
+  {
+    case CTRLFFI_UCHAR:  return &loadBlock<unsigned char>;
+    case CTRLFFI_CHAR:   return &loadBlock<char>;
+    case CTRLFFI_USHORT: return &loadBlock<unsigned short>;
+    case CTRLFFI_SHORT:  return &loadBlock<short>;
+    case CTRLFFI_UINT:   return &loadBlock<unsigned int>;
+    case CTRLFFI_INT:    return &loadBlock<int>;
+    case CTRLFFI_ULONG:  return &loadBlock<unsigned long>;
+    case CTRLFFI_LONG:   return &loadBlock<long>;
+    case CTRLFFI_FLOAT:  return &loadBlock<float>;
+    case CTRLFFI_DOUBLE: return &loadBlock<double>;
+    case CTRLFFI_UINT8:  return &loadBlock<uint8_t>;
+    case CTRLFFI_INT8:   return &loadBlock<int8_t>;
+    case CTRLFFI_UINT16: return &loadBlock<uint16_t>;
+    case CTRLFFI_INT16:  return &loadBlock<int16_t>;
+    case CTRLFFI_UINT32: return &loadBlock<uint32_t>;
+    case CTRLFFI_INT32:  return &loadBlock<int32_t>;
+    case CTRLFFI_UINT64: return &loadBlock<uint64_t>;
+    case CTRLFFI_INT64:  return &loadBlock<int64_t>;
+    default:             return 0;
+  }
+}
+
+static void reduceBlockScalar(const double *values, size_t n, double above, double below, BlockReduction &block)
+{
+  double sum = 0;
+  double min = HUGE_VAL;
+  double max = -HUGE_VAL;
+  size_t countAbove = 0;
+  size_t countBelow = 0;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    double value = values[i];
+    sum += value;
+
+    // comparisons with NaN are false, so NaNs are ignored
+    min = (value < min) ? value : min;
+    max = (value > max) ? value : max;
+    countAbove += (value > above) ? 1 : 0;
+    countBelow += (value < below) ? 1 : 0;
+  }
+
+  block.sum = sum;
+  block.min = min;
+  block.max = max;
+  block.above = countAbove;
+  block.below = countBelow;
+}
+
+static double squaredDeviationsScalar(const double *values, size_t n, double mean)
+{
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i)
+  {
+    double deviation = values[i] - mean;
+    sum += deviation * deviation;
+  }
+
+  return sum;
+}
+
+#ifdef CTRLFFI_X86
+
+/// SSE2 version of reduceBlockScalar, with two accumulators per aggregate
+CTRLFFI_TARGET("sse2")
+static void reduceBlockSSE2(const double *values, size_t n, double above, double below, BlockReduction &block)
+{
+  __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+  __m128d min0 = _mm_set1_pd(HUGE_VAL), min1 = min0;
+  __m128d max0 = _mm_set1_pd(-HUGE_VAL), max1 = max0;
+  __m128i countAbove = _mm_setzero_si128(), countBelow = _mm_setzero_si128();
+  const __m128d aboveThreshold = _mm_set1_pd(above);
+  const __m128d belowThreshold = _mm_set1_pd(below);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128d value0 = _mm_loadu_pd(values + i);
+    __m128d value1 = _mm_loadu_pd(values + i + 2);
+
+    sum0 = _mm_add_pd(sum0, value0);
+    sum1 = _mm_add_pd(sum1, value1);
+
+    // min and max return the second operand if one is NaN, so NaNs are ignored
+    min0 = _mm_min_pd(value0, min0);
+    min1 = _mm_min_pd(value1, min1);
+    max0 = _mm_max_pd(value0, max0);
+    max1 = _mm_max_pd(value1, max1);
+
+    // the comparisons give -1 in each matching lane
+    countAbove = _mm_sub_epi64(countAbove, _mm_castpd_si128(_mm_cmpgt_pd(value0, aboveThreshold)));
+    countAbove = _mm_sub_epi64(countAbove, _mm_castpd_si128(_mm_cmpgt_pd(value1, aboveThreshold)));
+    countBelow = _mm_sub_epi64(countBelow, _mm_castpd_si128(_mm_cmplt_pd(value0, belowThreshold)));
+    countBelow = _mm_sub_epi64(countBelow, _mm_castpd_si128(_mm_cmplt_pd(value1, belowThreshold)));
+  }
+
+  double sums[2], mins[2], maxs[2];
+  long long aboves[2], belows[2];
+  _mm_storeu_pd(sums, _mm_add_pd(sum0, sum1));
+  _mm_storeu_pd(mins, _mm_min_pd(min0, min1));
+  _mm_storeu_pd(maxs, _mm_max_pd(max0, max1));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(aboves), countAbove);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(belows), countBelow);
+
+  BlockReduction tail;
+  reduceBlockScalar(values + i, n - i, above, below, tail);
+
+  block.sum = sums[0] + sums[1] + tail.sum;
+  block.min = std::min(std::min(mins[0], mins[1]), tail.min);
+  block.max = std::max(std::max(maxs[0], maxs[1]), tail.max);
+  block.above = (size_t) (aboves[0] + aboves[1]) + tail.above;
+  block.below = (size_t) (belows[0] + belows[1]) + tail.below;
+}
+
+CTRLFFI_TARGET("sse2")
+static double squaredDeviationsSSE2(const double *values, size_t n, double mean)
+{
+  __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+  const __m128d means = _mm_set1_pd(mean);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128d deviation0 = _mm_sub_pd(_mm_loadu_pd(values + i), means);
+    __m128d deviation1 = _mm_sub_pd(_mm_loadu_pd(values + i + 2), means);
+    sum0 = _mm_add_pd(sum0, _mm_mul_pd(deviation0, deviation0));
+    sum1 = _mm_add_pd(sum1, _mm_mul_pd(deviation1, deviation1));
+  }
+
+  double sums[2];
+  _mm_storeu_pd(sums, _mm_add_pd(sum0, sum1));
+
+  return sums[0] + sums[1] + squaredDeviationsScalar(values + i, n - i, mean);
+}
+
+#endif // CTRLFFI_X86
+
+/// Returns the index of the first of n values equal to value, or NOT_FOUND
+static size_t findDouble(const double *values, size_t n, double value)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (values[i] == value)
+    {
+      return i;
+    }
+  }
+
+  return FFIKernels::NOT_FOUND;
+}
+
+bool FFIKernels::reduce(const void *data, size_t count, size_t stride, int type, bool byteSwap,
+                        double above, double below, bool variance, Reduction &result)
+{
+  LoadBlockFunction load = getLoadBlock(type);
+  if (! load)
+  {
+    return false;
+  }
+
+  void (*reduceBlock)(const double *, size_t, double, double, BlockReduction &) = &reduceBlockScalar;
+  double (*squaredDeviations)(const double *, size_t, double) = &squaredDeviationsScalar;
+
+#ifdef CTRLFFI_X86
+  if (hasSSE2())
+  {
+    reduceBlock = &reduceBlockSSE2;
+    squaredDeviations = &squaredDeviationsSSE2;
+  }
+#endif
+
+  result.sum = 0;
+  result.squaredDeviations = 0;
+  result.minIndex = NOT_FOUND;
+  result.maxIndex = NOT_FOUND;
+  result.above = 0;
+  result.below = 0;
+
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  double values[REDUCE_BLOCK];
+  double min = HUGE_VAL;
+  double max = -HUGE_VAL;
+  double mean = 0;
+
+  for (size_t first = 0; first < count; first += REDUCE_BLOCK)
+  {
+    size_t n = std::min(count - first, REDUCE_BLOCK);
+    load(bytes + first * stride, stride, n, byteSwap, values);
+
+    BlockReduction block;
+    reduceBlock(values, n, above, below, block);
+
+    result.sum += block.sum;
+    result.above += block.above;
+    result.below += block.below;
+
+    // the index is only searched if the block has a new minimum or maximum.
+    // before the first one was found, the block may contain infinite values.
+    if (block.min < min || result.minIndex == NOT_FOUND)
+    {
+      size_t index = findDouble(values, n, block.min);
+      if (index != NOT_FOUND)
+      {
+        min = block.min;
+        result.minIndex = first + index;
+      }
+    }
+
+    if (block.max > max || result.maxIndex == NOT_FOUND)
+    {
+      size_t index = findDouble(values, n, block.max);
+      if (index != NOT_FOUND)
+      {
+        max = block.max;
+        result.maxIndex = first + index;
+      }
+    }
+
+    // combine the squared deviations from the mean of each block, which is
+    // more accurate than the sum of the squares
+    if (variance)
+    {
+      double blockMean = block.sum / n;
+      double blockDeviations = squaredDeviations(values, n, blockMean);
+
+      if (first == 0)
+      {
+        mean = blockMean;
+        result.squaredDeviations = blockDeviations;
+      }
+      else
+      {
+        double delta = blockMean - mean;
+        double weight = (double) n / (double) (first + n);
+        mean += delta * weight;
+        result.squaredDeviations += blockDeviations + delta * delta * (double) first * weight;
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,126 @@
+#ifndef _FFIKERNELS_H_
+#define _FFIKERNELS_H_
+
+#include <cstddef>
+
+/// Aggregates of ffiBufferReduce
+enum ReduceOps
+{
+  CTRLFFI_REDUCE_SUM = 0x1,
+  CTRLFFI_REDUCE_MIN = 0x2,
+  CTRLFFI_REDUCE_MAX = 0x4,
+  CTRLFFI_REDUCE_MEAN = 0x8,
+  // population variance
+  CTRLFFI_REDUCE_VARIANCE = 0x10,
+  // one-based index of the first smallest and largest item
+  CTRLFFI_REDUCE_ARGMIN = 0x20,
+  CTRLFFI_REDUCE_ARGMAX = 0x40,
+  // number of items above and below a threshold
+  CTRLFFI_REDUCE_ABOVE = 0x80,
+  CTRLFFI_REDUCE_BELOW = 0x100,
+
+  CTRLFFI_REDUCE_ALL = 0x1ff
+};
+
+/**
+ * Bulk operations on native memory.
+ *
+ * Where the CPU supports it, the kernels use SIMD instructions, which are
+ * selected at runtime. All kernels also have a portable scalar version.
+ */
+class FFIKernels
+{
+public:
+  /// Returns true if the host stores values in big-endian byte order
+  static bool isBigEndianHost()
+  {
+    const unsigned short value = 1;
+    return *reinterpret_cast<const unsigned char *>(&value) == 0;
+  }
+
+  /// Reverses the byte order of count items with itemSize bytes each, in place.
+  /// Item sizes other than 2, 4 and 8 are left unchanged.
+  static void swapBytes(void *data, size_t itemSize, size_t count);
+
+  /// Copies a single item with reversed byte order. Source and destination
+  /// do not need to be aligned.
+  static void copySwapped(void *dest, const void *src, size_t itemSize)
+  {
+    const unsigned char *from = static_cast<const unsigned char *>(src);
+    unsigned char *to = static_cast<unsigned char *>(dest);
+
+    for (size_t i = 0; i < itemSize; ++i)
+    {
+      to[i] = from[itemSize - 1 - i];
+    }
+  }
+
+  /// Copies a matrix of rows x cols items with itemSize bytes each, and
+  /// transposes it: item (r, c) of src is written to item (c, r) of dest.
+  /// The strides are the distances between the rows of src and of dest in
+  /// items, i.e. the leading dimensions. The matrix is copied in blocks that
+  /// fit into the L1 cache, so that large matrices do not thrash the cache.
+  static void transpose(void *dest, size_t destStride, const void *src, size_t srcStride,
+                        size_t rows, size_t cols, size_t itemSize);
+
+  /// Aggregates computed by reduce()
+  struct Reduction
+  {
+    /// Sum of the items
+    double sum;
+    /// Sum of the squared deviations from the mean, only if requested
+    double squaredDeviations;
+    /// Index of the first smallest and of the first largest item, or
+    /// NOT_FOUND if there are no items other than NaNs
+    size_t minIndex;
+    size_t maxIndex;
+    /// Number of items above the upper and below the lower threshold
+    size_t above;
+    size_t below;
+  };
+
+  /// Computes the aggregates of count numeric items of an IntegralType, which
+  /// are stride bytes apart. The items are converted to doubles in blocks, and
+  /// each block is reduced with SIMD instructions where available. NaNs are
+  /// ignored by the minimum, the maximum and the counts. Returns false if the
+  /// type is not numeric.
+  static bool reduce(const void *data, size_t count, size_t stride, int type, bool byteSwap,
+                     double above, double below, bool variance, Reduction &result);
+
+  /// Returned by the search kernels if nothing was found
+  static const size_t NOT_FOUND = ~(size_t) 0;
+
+  /// Returns the offset of the first byte with the given value, or NOT_FOUND
+  static size_t findByte(const void *data, size_t size, unsigned char value);
+
+  /// Returns the offset of the first occurrence of pattern, or NOT_FOUND.
+  /// An empty pattern is found at offset 0.
+  static size_t find(const void *data, size_t size, const void *pattern, size_t patternSize);
+
+  /// Returns the offset of the first byte which differs between a and b,
+  /// or NOT_FOUND if both blocks are equal
+  static size_t findMismatch(const void *a, const void *b, size_t size);
+
+  /// CRC-32 as used by zlib, Ethernet and PNG (reflected polynomial 0xEDB88320)
+  static unsigned int crc32(const void *data, size_t size);
+
+  /// CRC-32C (Castagnoli, reflected polynomial 0x82F63B78), as used by iSCSI and ext4
+  static unsigned int crc32c(const void *data, size_t size);
+
+  /// CRC-16 as used by Modbus RTU (reflected polynomial 0xA001, initial value 0xFFFF)
+  static unsigned short crc16Modbus(const void *data, size_t size);
+
+  /// XXH64 hash, a fast non-cryptographic hash
+  static unsigned long long hash64(const void *data, size_t size, unsigned long long seed);
+
+  /// Returns true if the CPU supports SSE2
+  static bool hasSSE2();
+
+  /// Returns true if the CPU supports SSSE3
+  static bool hasSSSE3();
+
+  /// Returns true if the CPU supports SSE4.2, including the crc32 instruction
+  static bool hasSSE42();
+};
+
+#endif // _FFIKERNELS_H_
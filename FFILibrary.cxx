@@ -0,0 +1,128 @@
+#include <FFILibrary.hxx>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+FFILibraryCache::~FFILibraryCache()
+{
+  for (std::vector<FFILibrary *>::iterator it = libraries.begin(); it != libraries.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+FFILibrary *FFILibraryCache::acquire(const char *path)
+{
+  for (std::vector<FFILibrary *>::iterator it = libraries.begin(); it != libraries.end(); ++it)
+  {
+    if ((*it)->path == path)
+    {
+      ++((*it)->refCount);
+      return *it;
+    }
+  }
+
+#ifdef _WIN32
+  void *handle = LoadLibraryA(path);
+#else
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+
+  if (! handle)
+  {
+    return 0;
+  }
+
+  FFILibrary *library = new FFILibrary();
+  library->path = path;
+  library->handle = handle;
+  library->refCount = 1;
+  library->pinned = false;
+
+  libraries.push_back(library);
+  return library;
+}
+
+//------------------------------------------------------------------------------
+
+void FFILibraryCache::release(FFILibrary *library)
+{
+  if (! library || --(library->refCount) > 0)
+  {
+    return;
+  }
+
+  for (std::vector<FFILibrary *>::iterator it = libraries.begin(); it != libraries.end(); ++it)
+  {
+    if (*it == library)
+    {
+      libraries.erase(it);
+      break;
+    }
+  }
+
+#ifdef _WIN32
+  FreeLibrary(static_cast<HMODULE>(library->handle));
+#else
+  dlclose(library->handle);
+#endif
+
+  delete library;
+}
+
+//------------------------------------------------------------------------------
+
+void *FFILibraryCache::getSymbol(const FFILibrary *library, const char *name)
+{
+#ifdef _WIN32
+  return reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(library->handle), name));
+#else
+  return dlsym(library->handle, name);
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void *FFILibraryCache::pinSymbol(const char *path, const char *name)
+{
+  FFILibrary *library = acquire(path);
+  if (! library)
+  {
+    return 0;
+  }
+
+  void *address = 0;
+
+  std::map<std::string, void *>::const_iterator it = library->symbols.find(name);
+  if (it != library->symbols.end())
+  {
+    address = it->second;
+  }
+  else
+  {
+    address = getSymbol(library, name);
+    if (address)
+    {
+      library->symbols[name] = address;
+    }
+  }
+
+  // keep the reference of the first found symbol, drop all others
+  if (address && ! library->pinned)
+  {
+    library->pinned = true;
+  }
+  else
+  {
+    release(library);
+  }
+
+  return address;
+}
@@ -0,0 +1,70 @@
+#ifndef _FFILIBRARY_H_
+#define _FFILIBRARY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+/// A shared library loaded by CtrlFFI
+struct FFILibrary
+{
+  /// Path of the library, as given by the user
+  std::string path;
+  /// OS handle of the loaded library (from dlopen() or LoadLibrary())
+  void *handle;
+  /// Number of users (e.g. declared functions) of the library
+  unsigned int refCount;
+  /// True if the library holds a reference to itself, because the address of
+  /// one of its symbols was handed out
+  bool pinned;
+  /// Addresses of the symbols looked up with FFILibraryCache::pinSymbol()
+  std::map<std::string, void *> symbols;
+};
+
+/**
+ * Loads shared libraries and keeps them loaded as long as they are in use.
+ *
+ * Each acquire() must be balanced with a release(). When the last user
+ * releases a library, it is unloaded.
+ */
+class FFILibraryCache
+{
+public:
+  FFILibraryCache() { }
+
+  /// Forgets all libraries. Libraries still in use are not unloaded,
+  /// they stay in the process until it exits.
+  ~FFILibraryCache();
+
+  /// Returns the library with the given path, and loads it if necessary.
+  /// Returns 0 if the library could not be loaded.
+  FFILibrary *acquire(const char *path);
+
+  /// Releases one reference to the library, and unloads it if it was the last one
+  void release(FFILibrary *library);
+
+  /// Returns the address of a symbol in the library, or 0 if it was not found
+  static void *getSymbol(const FFILibrary *library, const char *name);
+
+  /// Returns the address of a symbol (e.g. an exported variable) in the library
+  /// with the given path, and loads it if necessary. Once a symbol was found,
+  /// the library is never unloaded, so that the address stays valid.
+  /// Returns 0 if the library or the symbol was not found.
+  void *pinSymbol(const char *path, const char *name);
+
+  /// Returns the number of loaded libraries
+  size_t getCount() const { return libraries.size(); }
+
+  /// Returns a loaded library by index
+  const FFILibrary *getAt(size_t index) const { return libraries.at(index); }
+
+private:
+  // not copyable
+  FFILibraryCache(const FFILibraryCache &);
+  FFILibraryCache &operator=(const FFILibraryCache &);
+
+  /// The loaded libraries
+  std::vector<FFILibrary *> libraries;
+};
+
+#endif // _FFILIBRARY_H_
@@ -0,0 +1,329 @@
+#include <FFIMemoryTracker.hxx>
+
+#include <algorithm>
+#include <ctime>
+
+/// Base 2 logarithm of the initial number of entries in the hash table
+static const unsigned int INITIAL_TABLE_BITS = 8;
+
+/// Number of freed addresses remembered for double free detection
+static const size_t RECENT_FREES = 256;
+
+//------------------------------------------------------------------------------
+
+/// Orders allocations by age, oldest first
+static bool isOlder(const FFIMemoryTracker::Allocation &a, const FFIMemoryTracker::Allocation &b)
+{
+  return a.serial < b.serial;
+}
+
+//------------------------------------------------------------------------------
+
+FFIMemoryTracker::FFIMemoryTracker()
+  : enabled(false),
+    tableBits(0),
+    recentFreeIndex(0),
+    liveBytes(0),
+    peakBytes(0),
+    liveCount(0),
+    allocCount(0),
+    freeCount(0),
+    doubleFreeCount(0),
+    foreignFreeCount(0)
+{
+  setEnabled(true);
+}
+
+//------------------------------------------------------------------------------
+
+void FFIMemoryTracker::setEnabled(bool enable)
+{
+  enabled = enable;
+
+  Allocation empty = Allocation();
+  tableBits = enable ? INITIAL_TABLE_BITS : 0;
+  table.assign(enable ? ((size_t) 1 << tableBits) : 0, empty);
+  recentFrees.assign(enable ? RECENT_FREES : 0, 0);
+  recentFreeIndex = 0;
+
+  strings.clear();
+  stringIndex.clear();
+  tagStats.clear();
+
+  liveBytes = peakBytes = liveCount = 0;
+  allocCount = freeCount = doubleFreeCount = foreignFreeCount = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIMemoryTracker::add(const void *address, size_t size, const char *tag, const char *location)
+{
+  if (! enabled || ! address)
+  {
+    return;
+  }
+
+  // keep the load factor below 1/2, so that the probe sequences stay short
+  if ((liveCount + 1) * 2 > table.size())
+  {
+    grow();
+  }
+
+  uintptr_t key = reinterpret_cast<uintptr_t>(address);
+
+  // malloc reuses freed addresses at once, so a new buffer at a recently
+  // freed address must not be taken for a double free later
+  std::replace(recentFrees.begin(), recentFrees.end(), key, (uintptr_t) 0);
+
+  Allocation &entry = table[findIndex(key)];
+
+  if (entry.address == key)
+  {
+    // freed by a native library and allocated again. forget the old one.
+    TagStats &oldTag = getTag(entry.tag);
+    --oldTag.count;
+    oldTag.bytes -= entry.size;
+    liveBytes -= entry.size;
+    --liveCount;
+  }
+
+  entry.address = key;
+  entry.size = size;
+  entry.serial = allocCount++;
+  entry.time = (long long) time(0);
+  entry.tag = intern(tag ? tag : "");
+  entry.location = intern(location ? location : "");
+
+  TagStats &tagEntry = getTag(entry.tag);
+  ++tagEntry.count;
+  tagEntry.bytes += size;
+
+  liveBytes += size;
+  ++liveCount;
+  peakBytes = std::max(peakBytes, liveBytes);
+}
+
+//------------------------------------------------------------------------------
+
+FFIMemoryTracker::FreeResult FFIMemoryTracker::remove(const void *address)
+{
+  if (! enabled || ! address)
+  {
+    return FREE_OK;
+  }
+
+  uintptr_t key = reinterpret_cast<uintptr_t>(address);
+  size_t index = findIndex(key);
+
+  if (table[index].address != key)
+  {
+    if (std::find(recentFrees.begin(), recentFrees.end(), key) != recentFrees.end())
+    {
+      ++doubleFreeCount;
+      return FREE_DOUBLE;
+    }
+
+    ++foreignFreeCount;
+    return FREE_FOREIGN;
+  }
+
+  TagStats &tagEntry = getTag(table[index].tag);
+  --tagEntry.count;
+  tagEntry.bytes -= table[index].size;
+
+  liveBytes -= table[index].size;
+  --liveCount;
+  ++freeCount;
+
+  recentFrees[recentFreeIndex] = key;
+  recentFreeIndex = (recentFreeIndex + 1) % recentFrees.size();
+
+  // backward shift deletion: move up following entries of the probe
+  // sequence, so that no tombstones are needed
+  size_t mask = table.size() - 1;
+  size_t hole = index;
+
+  for (size_t next = (hole + 1) & mask; table[next].address; next = (next + 1) & mask)
+  {
+    size_t ideal = getHomeIndex(table[next].address);
+
+    // move the entry if the hole lies between its ideal position and its
+    // current position (cyclically)
+    if (((next - ideal) & mask) >= ((next - hole) & mask))
+    {
+      table[hole] = table[next];
+      hole = next;
+    }
+  }
+
+  table[hole] = Allocation();
+
+  return FREE_OK;
+}
+
+//------------------------------------------------------------------------------
+
+const FFIMemoryTracker::Allocation *FFIMemoryTracker::find(const void *address) const
+{
+  if (! enabled || ! address)
+  {
+    return 0;
+  }
+
+  uintptr_t key = reinterpret_cast<uintptr_t>(address);
+  const Allocation &entry = table[findIndex(key)];
+
+  return (entry.address == key) ? &entry : 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIMemoryTracker::addBacking(const void *address, const FFIAlignedMemory::Backing &backing)
+{
+  backings[reinterpret_cast<uintptr_t>(address)] = backing;
+}
+
+const FFIAlignedMemory::Backing *FFIMemoryTracker::findBacking(const void *address) const
+{
+  std::map<uintptr_t, FFIAlignedMemory::Backing>::const_iterator it =
+    backings.find(reinterpret_cast<uintptr_t>(address));
+
+  return (it != backings.end()) ? &(it->second) : 0;
+}
+
+bool FFIMemoryTracker::removeBacking(const void *address, FFIAlignedMemory::Backing &backing)
+{
+  std::map<uintptr_t, FFIAlignedMemory::Backing>::iterator it =
+    backings.find(reinterpret_cast<uintptr_t>(address));
+
+  if (it == backings.end())
+  {
+    return false;
+  }
+
+  backing = it->second;
+  backings.erase(it);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIMemoryTracker::getOldest(size_t n, std::vector<Allocation> &result) const
+{
+  result.clear();
+  result.reserve(liveCount);
+
+  for (std::vector<Allocation>::const_iterator it = table.begin(); it != table.end(); ++it)
+  {
+    if (it->address)
+    {
+      result.push_back(*it);
+    }
+  }
+
+  n = std::min(n, result.size());
+  std::partial_sort(result.begin(), result.begin() + n, result.end(), isOlder);
+  result.resize(n);
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIMemoryTracker::getOverhead() const
+{
+  size_t overhead = table.capacity() * sizeof(Allocation) +
+                    recentFrees.capacity() * sizeof(uintptr_t) +
+                    tagStats.capacity() * sizeof(TagStats);
+
+  // a map node has about three pointers and a color besides the key and the value
+  overhead += backings.size() * (sizeof(uintptr_t) + sizeof(FFIAlignedMemory::Backing) + 4 * sizeof(void *));
+
+  // each string is stored twice, in the table and as key of the index
+  for (std::vector<std::string>::const_iterator it = strings.begin(); it != strings.end(); ++it)
+  {
+    overhead += 2 * (sizeof(std::string) + it->capacity()) + sizeof(unsigned int);
+  }
+
+  return overhead;
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIMemoryTracker::getHomeIndex(uintptr_t address) const
+{
+  // malloc aligns to at least 16 bytes, so the lowest bits carry no
+  // information. fibonacci hashing spreads the rest over the table, and its
+  // best mixed bits are the highest ones of the product.
+  unsigned long long product = (unsigned long long) (address >> 4) * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (product >> (64 - tableBits));
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIMemoryTracker::findIndex(uintptr_t address) const
+{
+  size_t mask = table.size() - 1;
+  size_t index = getHomeIndex(address);
+
+  while (table[index].address && table[index].address != address)
+  {
+    index = (index + 1) & mask;
+  }
+
+  return index;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIMemoryTracker::grow()
+{
+  std::vector<Allocation> oldTable(table.size() * 2, Allocation());
+  oldTable.swap(table);
+  ++tableBits;
+
+  for (std::vector<Allocation>::const_iterator it = oldTable.begin(); it != oldTable.end(); ++it)
+  {
+    if (it->address)
+    {
+      table[findIndex(it->address)] = *it;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+unsigned int FFIMemoryTracker::intern(const char *text)
+{
+  std::map<std::string, unsigned int>::const_iterator it = stringIndex.find(text);
+  if (it != stringIndex.end())
+  {
+    return it->second;
+  }
+
+  unsigned int index = (unsigned int) strings.size();
+  strings.push_back(text);
+  stringIndex[text] = index;
+
+  return index;
+}
+
+//------------------------------------------------------------------------------
+
+FFIMemoryTracker::TagStats &FFIMemoryTracker::getTag(unsigned int tag)
+{
+  // there are only a few tags, so a linear search is fine
+  for (std::vector<TagStats>::iterator it = tagStats.begin(); it != tagStats.end(); ++it)
+  {
+    if (it->tag == tag)
+    {
+      return *it;
+    }
+  }
+
+  TagStats newTag;
+  newTag.tag = tag;
+  newTag.count = 0;
+  newTag.bytes = 0;
+  tagStats.push_back(newTag);
+
+  return tagStats.back();
+}
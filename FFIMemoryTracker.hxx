@@ -0,0 +1,179 @@
+#ifndef _FFIMEMORYTRACKER_H_
+#define _FFIMEMORYTRACKER_H_
+
+#include <FFIAlignedMemory.hxx>
+#include <FFITypes.hxx>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Keeps track of the native buffers allocated for Ctrl scripts.
+ *
+ * Each live allocation is stored in an open addressing hash table with its
+ * size, a tag, the script location that allocated it and its allocation time.
+ * Tags and locations are stored once in a string table, so that an entry
+ * only needs 40 bytes.
+ *
+ * Recently freed addresses are remembered to tell double frees apart from
+ * frees of memory that was not allocated here.
+ *
+ * Buffers from FFIAlignedMemory are registered with their backing, which is
+ * needed to free them. These are kept while tracking is disabled.
+ */
+class FFIMemoryTracker
+{
+public:
+  /// Result of remove()
+  enum FreeResult
+  {
+    /// The address was a live allocation
+    FREE_OK,
+    /// The address was freed recently and not allocated here again since.
+    /// This is only a suspicion, since a native library may have received
+    /// the same address from malloc in the meantime.
+    FREE_DOUBLE,
+    /// The address is unknown, e.g. memory allocated by a native library
+    FREE_FOREIGN
+  };
+
+  /// A live allocation
+  struct Allocation
+  {
+    /// Address of the buffer, 0 for an unused table entry
+    uintptr_t address;
+    /// Size of the buffer in bytes
+    size_t size;
+    /// Increasing number of the allocation, to find the oldest ones
+    unsigned long long serial;
+    /// Time of the allocation, in seconds since the epoch
+    long long time;
+    /// Index of the tag in the string table
+    unsigned int tag;
+    /// Index of the script location in the string table
+    unsigned int location;
+  };
+
+  /// Live allocations of a tag
+  struct TagStats
+  {
+    /// Index of the tag in the string table
+    unsigned int tag;
+    /// Number of live allocations
+    size_t count;
+    /// Number of live bytes
+    size_t bytes;
+  };
+
+  FFIMemoryTracker();
+
+  /// Enables or disables tracking. Disabling forgets all allocations.
+  void setEnabled(bool enable);
+
+  /// Returns true if allocations are tracked
+  bool isEnabled() const { return enabled; }
+
+  /// Records a new allocation
+  void add(const void *address, size_t size, const char *tag, const char *location);
+
+  /// Removes an allocation before it is freed. Returns how the address was
+  /// known. Only FREE_OK means that the buffer can safely be freed, but a
+  /// foreign or suspected double freed address might still be a buffer of a
+  /// native library.
+  FreeResult remove(const void *address);
+
+  /// Returns the live allocation at the address, or 0 if there is none
+  const Allocation *find(const void *address) const;
+
+  /// Registers the backing of a buffer from FFIAlignedMemory
+  void addBacking(const void *address, const FFIAlignedMemory::Backing &backing);
+
+  /// Returns the backing of a buffer from FFIAlignedMemory, or 0 if the
+  /// buffer was not allocated there
+  const FFIAlignedMemory::Backing *findBacking(const void *address) const;
+
+  /// Unregisters the backing of a buffer before it is released. Returns false
+  /// if the buffer was not allocated by FFIAlignedMemory.
+  bool removeBacking(const void *address, FFIAlignedMemory::Backing &backing);
+
+  /// Returns a string of the string table
+  const std::string &getString(unsigned int index) const { return strings[index]; }
+
+  /// Returns the live allocations per tag
+  const std::vector<TagStats> &getTagStats() const { return tagStats; }
+
+  /// Returns the n oldest live allocations, oldest first
+  void getOldest(size_t n, std::vector<Allocation> &result) const;
+
+  /// Returns the number of bytes in live allocations
+  size_t getLiveBytes() const { return liveBytes; }
+
+  /// Returns the highest number of bytes in live allocations at the same time
+  size_t getPeakBytes() const { return peakBytes; }
+
+  /// Returns the number of live allocations
+  size_t getLiveCount() const { return liveCount; }
+
+  /// Returns the number of allocations since tracking was enabled
+  unsigned long long getAllocCount() const { return allocCount; }
+
+  /// Returns the number of successful frees since tracking was enabled
+  unsigned long long getFreeCount() const { return freeCount; }
+
+  /// Returns the number of detected double frees
+  unsigned long long getDoubleFreeCount() const { return doubleFreeCount; }
+
+  /// Returns the number of frees of unknown addresses
+  unsigned long long getForeignFreeCount() const { return foreignFreeCount; }
+
+  /// Returns the number of bytes used for tracking
+  size_t getOverhead() const;
+
+private:
+  /// Returns the index where the address would be stored without collisions
+  size_t getHomeIndex(uintptr_t address) const;
+
+  /// Returns the index of the table entry for the address, or of the free
+  /// entry where it would be inserted
+  size_t findIndex(uintptr_t address) const;
+
+  /// Doubles the size of the table
+  void grow();
+
+  /// Returns the index of a string in the string table, adding it if necessary
+  unsigned int intern(const char *text);
+
+  /// Returns the stats of a tag, adding them if necessary
+  TagStats &getTag(unsigned int tag);
+
+  /// True if allocations are tracked
+  bool enabled;
+  /// The hash table. The size is always a power of two.
+  std::vector<Allocation> table;
+  /// Base 2 logarithm of the table size
+  unsigned int tableBits;
+  /// Table of tags and locations
+  std::vector<std::string> strings;
+  /// Index of each string in the string table
+  std::map<std::string, unsigned int> stringIndex;
+  /// Live allocations per tag
+  std::vector<TagStats> tagStats;
+  /// Ring buffer of recently freed addresses
+  std::vector<uintptr_t> recentFrees;
+  /// Next index to use in recentFrees
+  size_t recentFreeIndex;
+  /// Backing of the live buffers from FFIAlignedMemory, by address
+  std::map<uintptr_t, FFIAlignedMemory::Backing> backings;
+
+  size_t liveBytes;
+  size_t peakBytes;
+  size_t liveCount;
+  unsigned long long allocCount;
+  unsigned long long freeCount;
+  unsigned long long doubleFreeCount;
+  unsigned long long foreignFreeCount;
+};
+
+#endif // _FFIMEMORYTRACKER_H_
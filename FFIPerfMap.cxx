@@ -0,0 +1,78 @@
+#include <FFIPerfMap.hxx>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+FFIPerfMap::FFIPerfMap()
+  : file(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+FFIPerfMap::~FFIPerfMap()
+{
+  close();
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIPerfMap::open()
+{
+#ifdef _WIN32
+  return false;
+#else
+  if (file)
+  {
+    return true;
+  }
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long) getpid());
+
+  file = fopen(path, "a");
+  return file != 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void FFIPerfMap::close()
+{
+  if (file)
+  {
+    fclose(file);
+    file = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIPerfMap::add(const void *address, size_t size, const char *name)
+{
+#ifdef _WIN32
+  return false;
+#else
+  if (! file || ! address)
+  {
+    return false;
+  }
+
+  // perf only uses the map for anonymous memory
+  Dl_info info;
+  if (dladdr(address, &info) && info.dli_fname)
+  {
+    return false;
+  }
+
+  fprintf(file, "%lx %lx %s\n", (unsigned long) address, (unsigned long) size, name);
+
+  // perf may read the map while the process is running
+  fflush(file);
+  return true;
+#endif
+}
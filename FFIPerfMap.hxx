@@ -0,0 +1,44 @@
+#ifndef _FFIPERFMAP_H_
+#define _FFIPERFMAP_H_
+
+#include <cstddef>
+#include <cstdio>
+
+/**
+ * Writes /tmp/perf-<pid>.map, which perf uses to name code outside of
+ * any mapped file, e.g. code generated at runtime by a native library.
+ *
+ * Each line contains the start address, the size and the name of a
+ * function, in the format "<hex start> <hex size> <name>". Only Linux is
+ * supported.
+ */
+class FFIPerfMap
+{
+public:
+  FFIPerfMap();
+
+  /// Closes the map
+  ~FFIPerfMap();
+
+  /// Opens the map of this process for appending. Returns false on failure.
+  bool open();
+
+  /// Closes the map. The file is kept, so that perf can still use it.
+  void close();
+
+  /// Returns false if the map is closed
+  bool isOpen() const { return file != 0; }
+
+  /// Adds a function, unless it is part of a mapped file, where perf finds
+  /// its symbols itself. Returns true if the function was added.
+  bool add(const void *address, size_t size, const char *name);
+
+private:
+  // not copyable
+  FFIPerfMap(const FFIPerfMap &);
+  FFIPerfMap &operator=(const FFIPerfMap &);
+
+  FILE *file;
+};
+
+#endif // _FFIPERFMAP_H_
@@ -0,0 +1,36 @@
+#ifndef _FFIPROBES_H_
+#define _FFIPROBES_H_
+
+// Static tracepoints (USDT) for tools like perf, bpftrace and SystemTap.
+//
+// The probes are compiled in if <sys/sdt.h> is available (systemtap-sdt-dev
+// on Debian, systemtap-sdt-devel on Red Hat), unless CTRLFFI_NO_USDT is
+// defined. A probe is a single nop while no tracer is attached.
+//
+// Provider "ctrlffi":
+//   call_entry(uint funcId, char *name, char *location)
+//   call_return(uint funcId, char *name, char *location, int completed)
+//   The location of the Ctrl script is only given after
+//   ffiSetProfiling(..., true), otherwise it is a null pointer.
+//   completed is 0 if the host of an isolated library crashed.
+
+#if defined(__linux__) && ! defined(CTRLFFI_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CTRLFFI_USDT 1
+#endif
+#endif
+
+#ifdef CTRLFFI_USDT
+#define CTRLFFI_PROBE_CALL_ENTRY(funcId, name, location) \
+  DTRACE_PROBE3(ctrlffi, call_entry, funcId, name, location)
+#define CTRLFFI_PROBE_CALL_RETURN(funcId, name, location, completed) \
+  DTRACE_PROBE4(ctrlffi, call_return, funcId, name, location, completed)
+#else
+#define CTRLFFI_PROBE_CALL_ENTRY(funcId, name, location) \
+  ((void) (funcId), (void) (name), (void) (location))
+#define CTRLFFI_PROBE_CALL_RETURN(funcId, name, location, completed) \
+  ((void) (funcId), (void) (name), (void) (location), (void) (completed))
+#endif
+
+#endif // _FFIPROBES_H_
@@ -0,0 +1,158 @@
+#include <FFIQueue.hxx>
+#include <FFIAtomic.hxx>
+
+#include <cstdlib>
+#include <cstring>
+
+// Implementation of a bounded queue as described by Dmitry Vyukov: every slot
+// has a sequence number, which tells whether the slot is free for the producer
+// at a given position, or ready for the consumer.
+
+//------------------------------------------------------------------------------
+
+FFIQueue *FFIQueue::create(size_t itemSize, size_t capacity)
+{
+  if (itemSize == 0 || capacity == 0 || capacity > (((size_t) 1) << 30))
+  {
+    return 0;
+  }
+
+  // round up to a power of two, so that positions can be mapped with a mask
+  size_t slots = 1;
+  while (slots < capacity)
+  {
+    slots <<= 1;
+  }
+
+  FFIQueue *queue = new FFIQueue();
+  queue->itemSize = itemSize;
+  queue->mask = slots - 1;
+  queue->sequences = static_cast<volatile size_t *>(malloc(slots * sizeof(size_t)));
+  queue->items = static_cast<char *>(malloc(slots * itemSize));
+  queue->pushPos = 0;
+  queue->drops = 0;
+  queue->highWater = 0;
+  queue->popPos = 0;
+
+  if (! queue->sequences || ! queue->items)
+  {
+    delete queue;
+    return 0;
+  }
+
+  for (size_t i = 0; i < slots; ++i)
+  {
+    queue->sequences[i] = i;
+  }
+
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+
+FFIQueue::~FFIQueue()
+{
+  free(const_cast<size_t *>(sequences));
+  free(items);
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIQueue::push(const void *item)
+{
+  size_t pos = FFIAtomic::load(&pushPos);
+
+  for (;;)
+  {
+    size_t seq = FFIAtomic::load(&sequences[pos & mask]);
+    ptrdiff_t diff = (ptrdiff_t) seq - (ptrdiff_t) pos;
+
+    if (diff == 0)
+    {
+      // the slot is free, try to claim it
+      if (FFIAtomic::compareExchange(&pushPos, pos, pos + 1))
+      {
+        break;
+      }
+
+      pos = FFIAtomic::load(&pushPos);
+    }
+    else if (diff < 0)
+    {
+      // the slot still holds an item from the previous round, queue is full
+      FFIAtomic::fetchAdd(&drops, 1);
+      return false;
+    }
+    else
+    {
+      // another producer claimed the slot, try again with the current position
+      pos = FFIAtomic::load(&pushPos);
+    }
+  }
+
+  memcpy(items + (pos & mask) * itemSize, item, itemSize);
+
+  // publish the item to the consumer
+  FFIAtomic::store(&sequences[pos & mask], pos + 1);
+
+  // the consumer may already have popped this item and more, then the
+  // difference would wrap around
+  size_t popped = FFIAtomic::load(&popPos);
+  if (popped <= pos + 1)
+  {
+    FFIAtomic::storeMax(&highWater, pos + 1 - popped);
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIQueue::pop(void *item)
+{
+  size_t pos = popPos;
+
+  if (FFIAtomic::load(&sequences[pos & mask]) != pos + 1)
+  {
+    // nothing published in this slot yet
+    return false;
+  }
+
+  memcpy(item, items + (pos & mask) * itemSize, itemSize);
+
+  // free the slot for the next round of producers
+  FFIAtomic::store(&sequences[pos & mask], pos + mask + 1);
+  FFIAtomic::store(&popPos, pos + 1);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIQueue::getDepth() const
+{
+  size_t popped = FFIAtomic::load(&popPos);
+  size_t pushed = FFIAtomic::load(&pushPos);
+
+  // pushPos may have been claimed but not yet published, so this is an upper bound
+  return (pushed > popped) ? (pushed - popped) : 0;
+}
+
+size_t FFIQueue::getHighWaterMark() const { return FFIAtomic::load(&highWater); }
+
+size_t FFIQueue::getPushCount() const { return FFIAtomic::load(&pushPos); }
+
+size_t FFIQueue::getPopCount() const { return FFIAtomic::load(&popPos); }
+
+size_t FFIQueue::getDropCount() const { return FFIAtomic::load(&drops); }
+
+//------------------------------------------------------------------------------
+
+extern "C" int ffiQueuePush(void *queue, const void *item)
+{
+  if (! queue || ! item)
+  {
+    return 0;
+  }
+
+  return static_cast<FFIQueue *>(queue)->push(item) ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#ifndef _FFIQUEUE_H_
+#define _FFIQUEUE_H_
+
+#include <cstddef>
+
+/**
+ * A bounded lock-free queue with fixed-size items.
+ *
+ * Any number of native threads may push items through the C function
+ * ffiQueuePush(), while exactly one consumer (the Ctrl thread) pops them.
+ * If the queue is full, the pushed item is dropped and counted.
+ */
+class FFIQueue
+{
+public:
+  /// Creates a queue. The capacity is rounded up to a power of two.
+  /// Returns 0 if the parameters are invalid or the memory is not available.
+  static FFIQueue *create(size_t itemSize, size_t capacity);
+
+  ~FFIQueue();
+
+  /// Copies an item into the queue. Returns false if the queue is full.
+  /// Safe to be called from multiple threads at the same time.
+  bool push(const void *item);
+
+  /// Copies the oldest item to the given buffer. Returns false if the queue is empty.
+  /// Must only be called from a single thread.
+  bool pop(void *item);
+
+  /// Size of one item in bytes
+  size_t getItemSize() const { return itemSize; }
+
+  /// Maximum number of items in the queue
+  size_t getCapacity() const { return mask + 1; }
+
+  /// Current number of items in the queue
+  size_t getDepth() const;
+
+  /// Highest number of items that were in the queue at the same time
+  size_t getHighWaterMark() const;
+
+  /// Number of items that were pushed successfully
+  size_t getPushCount() const;
+
+  /// Number of items that were popped
+  size_t getPopCount() const;
+
+  /// Number of items that were dropped because the queue was full
+  size_t getDropCount() const;
+
+private:
+  FFIQueue() { }
+
+  // not copyable
+  FFIQueue(const FFIQueue &);
+  FFIQueue &operator=(const FFIQueue &);
+
+  /// Padding to keep the producer and consumer positions on separate cache lines
+  enum { CACHE_LINE = 64 };
+
+  /// Size of one item in bytes
+  size_t itemSize;
+  /// capacity - 1, used to map a position to a slot
+  size_t mask;
+  /// Sequence number per slot, tells producers and the consumer whether a slot is free
+  volatile size_t *sequences;
+  /// Item storage, capacity * itemSize bytes
+  char *items;
+
+  char padding1[CACHE_LINE];
+  /// Next position to be written by a producer
+  volatile size_t pushPos;
+  /// Number of dropped items
+  volatile size_t drops;
+  /// Highest observed depth
+  volatile size_t highWater;
+
+  char padding2[CACHE_LINE];
+  /// Next position to be read by the consumer
+  volatile size_t popPos;
+};
+
+/// Pushes an item into a FFIQueue. Returns 1 on success, 0 if the queue was full.
+/// This is the function handed to native libraries as a callback.
+extern "C" int ffiQueuePush(void *queue, const void *item);
+
+#endif // _FFIQUEUE_H_
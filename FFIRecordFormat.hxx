@@ -0,0 +1,110 @@
+#ifndef _FFIRECORDFORMAT_H_
+#define _FFIRECORDFORMAT_H_
+
+#include <FFITypes.hxx>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Binary log of the calls made with ffiCallFunction, written by
+// ffiStartRecording and read by tools/ffireplay.
+//
+// The file starts with an FFIRecordHeader. Records follow, each starting
+// with a one byte FFIRecordKind. All values are stored in host byte order,
+// strings as a uint16 length followed by the bytes without terminator.
+//
+// RECORD_FUNCTION, written before the first call of a function:
+//   uint32 funcId, string library, string name, int32 returnType,
+//   uint32 argCount, argCount times (int32 type, int32 direction)
+//   The library is empty for functions declared by address.
+//
+// RECORD_CALL:
+//   uint32 funcId, uint64 start (ns since the start of the recording),
+//   uint64 duration (ns), then for each argument its input:
+//   uint32 size (RECORD_NULL for a null pointer), size bytes
+//   - scalars store their value
+//   - _PTR types store the value they point to
+//   - FFI_STRING stores the text without terminator
+//   - FFI_STRING_ARRAY stores the texts, each with its terminator
+//   - FFI_POINTER stores the pointer itself, the memory behind it is unknown
+//   - out slots (FFI_STRING_OUT, FFI_POINTER_OUT) store nothing
+
+/// Kinds of records
+enum FFIRecordKind
+{
+  RECORD_FUNCTION = 1,
+  RECORD_CALL
+};
+
+/// Magic bytes at the start of a log
+static const char RECORD_MAGIC[8] = { 'C', 'T', 'R', 'L', 'F', 'F', 'I', 'R' };
+
+/// Version of the format
+static const unsigned int RECORD_VERSION = 1;
+
+/// Size of an argument that marks a null pointer
+static const unsigned int RECORD_NULL = ~0u;
+
+/// Start of a log
+struct FFIRecordHeader
+{
+  char magic[8];
+  unsigned int version;
+  /// sizeof(void *) of the recording process
+  unsigned int pointerSize;
+  /// 1 if the recording process is big endian
+  unsigned int bigEndian;
+  unsigned int reserved;
+};
+
+/// Appends a value to a record
+template <typename T>
+inline void appendRecordValue(std::vector<char> &record, const T &value)
+{
+  const char *bytes = reinterpret_cast<const char *>(&value);
+  record.insert(record.end(), bytes, bytes + sizeof(T));
+}
+
+/// Appends a string to a record
+inline void appendRecordString(std::vector<char> &record, const char *text)
+{
+  size_t length = strlen(text);
+  if (length > 0xffff)
+  {
+    length = 0xffff;
+  }
+
+  appendRecordValue(record, (unsigned short) length);
+  record.insert(record.end(), text, text + length);
+}
+
+/// Reads a value from a log. Returns false at the end of the data.
+template <typename T>
+inline bool readRecordValue(const char *&pos, const char *end, T &value)
+{
+  if ((size_t) (end - pos) < sizeof(T))
+  {
+    return false;
+  }
+
+  memcpy(&value, pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+/// Reads a string from a log. Returns false at the end of the data.
+inline bool readRecordString(const char *&pos, const char *end, std::string &text)
+{
+  unsigned short length;
+  if (! readRecordValue(pos, end, length) || (size_t) (end - pos) < length)
+  {
+    return false;
+  }
+
+  text.assign(pos, length);
+  pos += length;
+  return true;
+}
+
+#endif // _FFIRECORDFORMAT_H_
@@ -0,0 +1,189 @@
+#include <FFIRecorder.hxx>
+
+#include <FFIKernels.hxx>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/// The buffer is written to the file when it is larger than this
+static const size_t FLUSH_SIZE = 256 * 1024;
+
+/// Offset of the start time in a call record, after the kind and the function id
+static const size_t CALL_TIME_OFFSET = 1 + sizeof(unsigned int);
+
+//------------------------------------------------------------------------------
+
+FFIRecorder::FFIRecorder()
+  : file(0),
+    failed(false),
+    callOffset(0),
+    startTime(0),
+    callCount(0),
+    writtenBytes(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+FFIRecorder::~FFIRecorder()
+{
+  close();
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIRecorder::open(const char *path)
+{
+  close();
+
+  file = fopen(path, "wb");
+  if (! file)
+  {
+    return false;
+  }
+
+  buffer.clear();
+  buffer.reserve(FLUSH_SIZE + 64 * 1024);
+  functions.clear();
+  failed = false;
+  callCount = 0;
+  writtenBytes = 0;
+  startTime = getTime();
+
+  FFIRecordHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+  header.version = RECORD_VERSION;
+  header.pointerSize = sizeof(void *);
+  header.bigEndian = FFIKernels::isBigEndianHost() ? 1 : 0;
+
+  appendRecordValue(buffer, header);
+  flush();
+
+  return ! failed;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::close()
+{
+  if (! file)
+  {
+    return;
+  }
+
+  flush();
+
+  if (fclose(file) != 0)
+  {
+    failed = true;
+  }
+
+  file = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::addFunction(unsigned int funcId, const char *library, const char *name, int returnType,
+                              const std::vector<int> &argTypes, const std::vector<int> &argDirections)
+{
+  buffer.push_back((char) RECORD_FUNCTION);
+  appendRecordValue(buffer, funcId);
+  appendRecordString(buffer, library);
+  appendRecordString(buffer, name);
+  appendRecordValue(buffer, returnType);
+  appendRecordValue(buffer, (unsigned int) argTypes.size());
+
+  for (size_t i = 0; i < argTypes.size(); ++i)
+  {
+    appendRecordValue(buffer, argTypes[i]);
+    appendRecordValue(buffer, argDirections[i]);
+  }
+
+  functions.insert(funcId);
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::beginCall(unsigned int funcId)
+{
+  callOffset = buffer.size();
+
+  buffer.push_back((char) RECORD_CALL);
+  appendRecordValue(buffer, funcId);
+
+  // start and duration are filled in by endCall()
+  appendRecordValue(buffer, 0LL);
+  appendRecordValue(buffer, 0LL);
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::addArgument(const void *data, size_t size)
+{
+  if (! data)
+  {
+    appendRecordValue(buffer, RECORD_NULL);
+    return;
+  }
+
+  const char *bytes = static_cast<const char *>(data);
+  appendRecordValue(buffer, (unsigned int) size);
+  buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::endCall(long long start, long long duration)
+{
+  start -= startTime;
+  memcpy(&buffer[callOffset + CALL_TIME_OFFSET], &start, sizeof(start));
+  memcpy(&buffer[callOffset + CALL_TIME_OFFSET + sizeof(start)], &duration, sizeof(duration));
+
+  ++callCount;
+
+  if (buffer.size() >= FLUSH_SIZE)
+  {
+    flush();
+  }
+}
+
+//------------------------------------------------------------------------------
+
+long long FFIRecorder::getTime()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (long long) (counter.QuadPart / frequency.QuadPart * 1000000000 +
+                      counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRecorder::flush()
+{
+  // after an error, nothing is written, so that the log has no holes
+  if (! failed && ! buffer.empty())
+  {
+    if (fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size())
+    {
+      writtenBytes += buffer.size();
+    }
+    else
+    {
+      failed = true;
+    }
+  }
+
+  buffer.clear();
+}
@@ -0,0 +1,89 @@
+#ifndef _FFIRECORDER_H_
+#define _FFIRECORDER_H_
+
+#include <FFIRecordFormat.hxx>
+
+#include <cstdio>
+#include <set>
+#include <vector>
+
+/**
+ * Writes the calls made with ffiCallFunction to a binary log, see
+ * FFIRecordFormat.hxx. The log can be replayed with tools/ffireplay.
+ *
+ * Records are collected in a buffer and written in large blocks, so that
+ * recording adds little more than a copy of the arguments to each call.
+ */
+class FFIRecorder
+{
+public:
+  FFIRecorder();
+
+  /// Closes the log
+  ~FFIRecorder();
+
+  /// Creates the log file and writes its header. Returns false on failure.
+  bool open(const char *path);
+
+  /// Writes all buffered records and closes the log
+  void close();
+
+  /// Returns false if the log is closed
+  bool isOpen() const { return file != 0; }
+
+  /// Returns true if writing failed. The following records are dropped.
+  bool hasFailed() const { return failed; }
+
+  /// Returns true if the declaration of the function was already written
+  bool hasFunction(unsigned int funcId) const { return functions.count(funcId) != 0; }
+
+  /// Writes the declaration of a function
+  void addFunction(unsigned int funcId, const char *library, const char *name, int returnType,
+                   const std::vector<int> &argTypes, const std::vector<int> &argDirections);
+
+  /// Starts a call record. The arguments follow with addArgument().
+  void beginCall(unsigned int funcId);
+
+  /// Adds the input of an argument to the current call. A null data pointer
+  /// marks a null pointer argument.
+  void addArgument(const void *data, size_t size);
+
+  /// Finishes the current call record
+  void endCall(long long start, long long duration);
+
+  /// Returns a monotonic time in nanoseconds
+  static long long getTime();
+
+  /// Returns the time when the log was opened, as returned by getTime()
+  long long getStartTime() const { return startTime; }
+
+  /// Returns the number of recorded calls
+  unsigned long long getCallCount() const { return callCount; }
+
+  /// Returns the number of bytes written so far, including the buffer
+  unsigned long long getByteCount() const { return writtenBytes + buffer.size(); }
+
+private:
+  // not copyable
+  FFIRecorder(const FFIRecorder &);
+  FFIRecorder &operator=(const FFIRecorder &);
+
+  /// Writes the buffer to the file
+  void flush();
+
+  FILE *file;
+  /// True after a write error
+  bool failed;
+  /// Records not written yet
+  std::vector<char> buffer;
+  /// Offset of the current call record in the buffer
+  size_t callOffset;
+  /// Functions whose declaration was written
+  std::set<unsigned int> functions;
+
+  long long startTime;
+  unsigned long long callCount;
+  unsigned long long writtenBytes;
+};
+
+#endif // _FFIRECORDER_H_
@@ -0,0 +1,426 @@
+#include <FFIRemoteHost.hxx>
+
+#include <FFIHostProtocol.hxx>
+#include <FFISharedMemory.hxx>
+
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+/// Time in ms between two checks whether the host is still alive
+static const int HOST_ALIVE_CHECK_INTERVAL = 100;
+
+/// Time in ms the host may take to start up
+static const int HOST_STARTUP_TIMEOUT = 5000;
+
+//------------------------------------------------------------------------------
+
+FFIRemoteHost::FFIRemoteHost(const std::string &libPath, const std::string &hostExecutable,
+                             int callTimeout)
+  : libPath(libPath),
+    hostExecutable(hostExecutable),
+    callTimeout(callTimeout),
+    sharedMemory(0),
+    channel(0),
+    pid(0),
+    restartCount(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+FFIRemoteHost::~FFIRemoteHost()
+{
+  stop();
+}
+
+//------------------------------------------------------------------------------
+
+int FFIRemoteHost::declare(const std::string &funcName, int returnType, const std::vector<int> &argTypes)
+{
+  if (! isValidForHost(returnType) || (returnType > CTRLFFI_FIRST_PTR && returnType < CTRLFFI_LAST_PTR))
+  {
+    return -1;
+  }
+
+  for (size_t i = 0; i < argTypes.size(); ++i)
+  {
+    if (! isValidForHost(argTypes[i]) || argTypes[i] == CTRLFFI_VOID)
+    {
+      return -1;
+    }
+  }
+
+  if (! pid && ! start())
+  {
+    return -1;
+  }
+
+  Declaration declaration;
+  declaration.funcName = funcName;
+  declaration.returnType = returnType;
+  declaration.argTypes = argTypes;
+
+  int function = sendDeclaration(declaration);
+  if (function < 0)
+  {
+    return -1;
+  }
+
+  // the host numbers the functions in the order they were declared
+  declarations.push_back(declaration);
+  return function;
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+bool FFIRemoteHost::call(int, void *, void **)
+{
+  // TODO: isolated libraries are not supported on Windows yet
+  return false;
+}
+
+bool FFIRemoteHost::start()
+{
+  return false;
+}
+
+void FFIRemoteHost::stop()
+{
+}
+
+int FFIRemoteHost::sendDeclaration(const Declaration &)
+{
+  return -1;
+}
+
+bool FFIRemoteHost::transact()
+{
+  return false;
+}
+
+bool FFIRemoteHost::hasExited() const
+{
+  return true;
+}
+
+#else
+
+bool FFIRemoteHost::call(int function, void *returnValue, void **argValues)
+{
+  if (function < 0 || function >= (int) declarations.size())
+  {
+    return false;
+  }
+
+  // the host is restarted after a crash, but a failed restart is retried here
+  if (! pid && ! start())
+  {
+    return false;
+  }
+
+  const Declaration &declaration = declarations[function];
+  size_t argCount = declaration.argTypes.size();
+  size_t dataSize = (1 + argCount) * HOST_SLOT_SIZE;
+  char *data = channel->data;
+
+  // the return value slot is written by the host
+  memset(data, 0, HOST_SLOT_SIZE);
+
+  for (size_t i = 0; i < argCount; ++i)
+  {
+    int type = declaration.argTypes[i];
+    char *slot = data + (i + 1) * HOST_SLOT_SIZE;
+    memset(slot, 0, HOST_SLOT_SIZE);
+
+    if (type == CTRLFFI_STRING)
+    {
+      const char *text = *static_cast<char **>(argValues[i]);
+      unsigned long long offset = HOST_NULL_STRING;
+
+      if (text)
+      {
+        size_t length = strlen(text) + 1;
+        if (length > HOST_DATA_SIZE - dataSize)
+        {
+          // TODO: error. arguments too large.
+          return false;
+        }
+
+        memcpy(data + dataSize, text, length);
+        offset = dataSize;
+        dataSize += length;
+      }
+
+      memcpy(slot, &offset, sizeof(offset));
+    }
+    else if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+    {
+      // pass the value behind the pointer
+      memcpy(slot, *static_cast<void **>(argValues[i]), getHostValueSize(type));
+    }
+    else
+    {
+      memcpy(slot, argValues[i], getHostValueSize(type));
+    }
+  }
+
+  channel->command = HOST_CALL;
+  channel->function = function;
+  channel->dataSize = (unsigned int) dataSize;
+
+  if (! transact())
+  {
+    // the host crashed or hung. start a new one for the next calls.
+    ++restartCount;
+    start();
+    return false;
+  }
+
+  if (channel->status != 0)
+  {
+    return false;
+  }
+
+  // copy back the results
+  if (declaration.returnType == CTRLFFI_STRING)
+  {
+    unsigned long long offset;
+    memcpy(&offset, data, sizeof(offset));
+
+    // the text stays valid in the channel until the next request
+    *static_cast<char **>(returnValue) = (offset == HOST_NULL_STRING) ? 0 : data + offset;
+  }
+  else if (returnValue)
+  {
+    memcpy(returnValue, data, getHostValueSize(declaration.returnType));
+  }
+
+  for (size_t i = 0; i < argCount; ++i)
+  {
+    int type = declaration.argTypes[i];
+    if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+    {
+      memcpy(*static_cast<void **>(argValues[i]), data + (i + 1) * HOST_SLOT_SIZE, getHostValueSize(type));
+    }
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIRemoteHost::start()
+{
+  static unsigned int hostCounter = 0;
+
+  char name[64];
+  snprintf(name, sizeof(name), "ctrlffi-host-%d-%u", (int) getpid(), hostCounter++);
+
+  sharedMemory = FFISharedMemory::create(name, sizeof(FFIHostChannel));
+  if (! sharedMemory)
+  {
+    return false;
+  }
+
+  channel = static_cast<FFIHostChannel *>(sharedMemory->getAddress());
+  channel->state = HOST_STARTING;
+
+  // posix_spawn instead of fork(), which is not safe in a multithreaded process
+  std::string shmName = sharedMemory->getName();
+  char *argv[] = { const_cast<char *>(hostExecutable.c_str()), const_cast<char *>(shmName.c_str()), 0 };
+
+  pid_t newPid = 0;
+  if (posix_spawnp(&newPid, hostExecutable.c_str(), 0, 0, argv, environ) != 0)
+  {
+    stop();
+    return false;
+  }
+
+  pid = newPid;
+
+  // wait until the host mapped the channel. the name is not needed afterwards.
+  int waited = 0;
+  while (hostWaitWhile(channel, HOST_STARTING, HOST_ALIVE_CHECK_INTERVAL) == HOST_STARTING)
+  {
+    if (hasExited())
+    {
+      // the host exited, e.g. the executable or the library was not found
+      pid = 0;
+      stop();
+      return false;
+    }
+
+    waited += HOST_ALIVE_CHECK_INTERVAL;
+    if (waited >= HOST_STARTUP_TIMEOUT)
+    {
+      stop();
+      return false;
+    }
+  }
+
+  sharedMemory->unlink();
+
+  // declare the functions again after a restart
+  for (size_t i = 0; i < declarations.size(); ++i)
+  {
+    if (sendDeclaration(declarations[i]) != (int) i)
+    {
+      stop();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIRemoteHost::stop()
+{
+  if (pid)
+  {
+    if (channel->state == HOST_IDLE || channel->state == HOST_RESPONSE)
+    {
+      channel->command = HOST_SHUTDOWN;
+      hostSetState(channel, HOST_REQUEST);
+    }
+    else
+    {
+      kill(pid, SIGKILL);
+    }
+
+    // wait a bit for a clean shutdown, but do not hang on a stuck host
+    for (int i = 0; i < 10 && ! hasExited(); ++i)
+    {
+      usleep(10000);
+    }
+
+    if (! hasExited())
+    {
+      kill(pid, SIGKILL);
+      waitpid(pid, 0, 0);
+    }
+
+    pid = 0;
+  }
+
+  if (sharedMemory)
+  {
+    // the name is still there if the host did not start
+    if (channel->state == HOST_STARTING)
+    {
+      sharedMemory->unlink();
+    }
+
+    delete sharedMemory;
+    sharedMemory = 0;
+    channel = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+int FFIRemoteHost::sendDeclaration(const Declaration &declaration)
+{
+  size_t argCount = declaration.argTypes.size();
+  size_t dataSize = libPath.size() + 1 + declaration.funcName.size() + 1 + (2 + argCount) * sizeof(int);
+
+  if (dataSize > HOST_DATA_SIZE)
+  {
+    return -1;
+  }
+
+  char *data = channel->data;
+  memcpy(data, libPath.c_str(), libPath.size() + 1);
+  data += libPath.size() + 1;
+  memcpy(data, declaration.funcName.c_str(), declaration.funcName.size() + 1);
+  data += declaration.funcName.size() + 1;
+
+  int header[2] = { declaration.returnType, (int) argCount };
+  memcpy(data, header, sizeof(header));
+  data += sizeof(header);
+
+  if (argCount)
+  {
+    memcpy(data, &declaration.argTypes[0], argCount * sizeof(int));
+  }
+
+  channel->command = HOST_DECLARE;
+  channel->dataSize = (unsigned int) dataSize;
+
+  if (! transact())
+  {
+    return -1;
+  }
+
+  return channel->status;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIRemoteHost::transact()
+{
+  hostSetState(channel, HOST_REQUEST);
+
+  int waited = 0;
+  while (hostWaitWhile(channel, HOST_REQUEST, HOST_ALIVE_CHECK_INTERVAL) != HOST_RESPONSE)
+  {
+    if (hasExited())
+    {
+      // the host crashed
+      pid = 0;
+      stop();
+      return false;
+    }
+
+    waited += HOST_ALIVE_CHECK_INTERVAL;
+    if (callTimeout > 0 && waited >= callTimeout)
+    {
+      // the host hangs, e.g. in a deadlock of the library. it is still busy
+      // with the request, so stop() kills it.
+      stop();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIRemoteHost::hasExited() const
+{
+  pid_t result = waitpid(pid, 0, WNOHANG);
+  if (result == 0)
+  {
+    return false;
+  }
+
+  if (result == -1 && errno == ECHILD)
+  {
+    // the status was collected elsewhere, e.g. because the manager ignores
+    // SIGCHLD. whether the process is still there is checked by its id.
+    return kill(pid, 0) != 0 && errno == ESRCH;
+  }
+
+  if (result == -1 && errno == EINTR)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+#endif
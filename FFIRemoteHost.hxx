@@ -0,0 +1,95 @@
+#ifndef _FFIREMOTEHOST_H_
+#define _FFIREMOTEHOST_H_
+
+#include <string>
+#include <vector>
+
+// forward declarations
+class FFISharedMemory;
+struct FFIHostChannel;
+
+/**
+ * Executes the functions of one library in a CtrlFFIHost helper process.
+ *
+ * If the library crashes the helper, the current call fails, and the helper
+ * is restarted with all functions declared again. Only supported on Linux.
+ */
+class FFIRemoteHost
+{
+public:
+  /// Default time in ms a request may take before the helper is killed
+  static const int DEFAULT_CALL_TIMEOUT = 30000;
+
+  /// Creates the host for a library. The helper is started on the first declaration.
+  /// A request that takes longer than callTimeout ms (0 for no limit) kills the helper.
+  FFIRemoteHost(const std::string &libPath, const std::string &hostExecutable,
+                int callTimeout = DEFAULT_CALL_TIMEOUT);
+
+  /// Stops the helper process
+  ~FFIRemoteHost();
+
+  /// Returns the path of the isolated library
+  const std::string &getLibPath() const { return libPath; }
+
+  /// Declares a function in the helper.
+  /// Returns the index of the function, or -1 on failure.
+  int declare(const std::string &funcName, int returnType, const std::vector<int> &argTypes);
+
+  /// Calls a declared function with the same arguments as ffi_call().
+  /// Returns false if the call could not be executed, e.g. the helper crashed or hung.
+  bool call(int function, void *returnValue, void **argValues);
+
+  /// Returns the number of times the helper had to be restarted after a crash or a timeout
+  unsigned int getRestartCount() const { return restartCount; }
+
+  /// Returns the process id of the helper, or 0 if it is not running
+  int getProcessId() const { return pid; }
+
+private:
+  // not copyable
+  FFIRemoteHost(const FFIRemoteHost &);
+  FFIRemoteHost &operator=(const FFIRemoteHost &);
+
+  /// A function declared in the helper, kept to declare it again after a restart
+  struct Declaration
+  {
+    std::string funcName;
+    int returnType;
+    std::vector<int> argTypes;
+  };
+
+  /// Starts the helper process and declares all known functions
+  bool start();
+
+  /// Stops the helper process
+  void stop();
+
+  /// Sends a declaration to the helper. Returns the status of the request.
+  int sendDeclaration(const Declaration &declaration);
+
+  /// Sends the current request and waits for the response.
+  /// Returns false if the helper died, or was killed after the timeout.
+  bool transact();
+
+  /// Returns true if the helper process has terminated
+  bool hasExited() const;
+
+  /// Path of the isolated library
+  std::string libPath;
+  /// Path of the CtrlFFIHost executable
+  std::string hostExecutable;
+  /// Time in ms a request may take, 0 for no limit
+  int callTimeout;
+  /// Shared memory with the channel
+  FFISharedMemory *sharedMemory;
+  /// The channel in the shared memory
+  FFIHostChannel *channel;
+  /// Process id of the helper, 0 if not running
+  int pid;
+  /// Number of restarts after crashes and timeouts
+  unsigned int restartCount;
+  /// All functions declared in the helper, by index
+  std::vector<Declaration> declarations;
+};
+
+#endif // _FFIREMOTEHOST_H_
@@ -0,0 +1,294 @@
+#include <FFISampler.hxx>
+
+#include <FFIAtomic.hxx>
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+/// Longest sleep of the thread, so that it notices a stop request quickly
+static const long long MAX_SLEEP_US = 100000;
+
+//------------------------------------------------------------------------------
+
+/// Returns a monotonic time in microseconds
+static long long getMonotonicTime()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (long long) (counter.QuadPart / frequency.QuadPart * 1000000 +
+                      counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+/// Sleeps until the given monotonic time, or at most MAX_SLEEP_US
+static void sleepUntil(long long time)
+{
+  long long now = getMonotonicTime();
+  if (time - now > MAX_SLEEP_US)
+  {
+    time = now + MAX_SLEEP_US;
+  }
+
+#ifdef _WIN32
+  if (time > now)
+  {
+    Sleep((DWORD) ((time - now) / 1000));
+  }
+#else
+  struct timespec wakeup;
+  wakeup.tv_sec = (time_t) (time / 1000000);
+  wakeup.tv_nsec = (long) (time % 1000000) * 1000;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, 0);
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+FFISampler::FFISampler(ffi_cif *cif, VoidFunction funcPtr, void *returnValue, void **argValues,
+                       const std::vector<Capture> &captures, unsigned int intervalMs, size_t capacity)
+  : cif(cif),
+    funcPtr(funcPtr),
+    returnValue(returnValue),
+    argValues(argValues),
+    captures(captures),
+    intervalMs(intervalMs ? intervalMs : 1),
+    recordSize(sizeof(long long)),
+    capacity(1),
+    head(0),
+    stopRequested(0),
+    running(false),
+    thread(),
+    callCount(0),
+    overrunCount(0),
+    maxJitter(0),
+    jitterSum(0),
+    maxDuration(0),
+    lastDuration(0)
+{
+  for (std::vector<Capture>::const_iterator it = captures.begin(); it != captures.end(); ++it)
+  {
+    recordSize += it->size;
+  }
+
+  // a power of two, so that the indices can wrap around
+  while (this->capacity < capacity)
+  {
+    this->capacity *= 2;
+  }
+
+  buffer.resize(this->capacity * recordSize);
+}
+
+//------------------------------------------------------------------------------
+
+FFISampler::~FFISampler()
+{
+  stop();
+}
+
+//------------------------------------------------------------------------------
+
+bool FFISampler::start()
+{
+  if (running)
+  {
+    return true;
+  }
+
+  FFIAtomic::store(&stopRequested, 0);
+
+#ifdef _WIN32
+  thread = CreateThread(0, 0, threadMain, this, 0, 0);
+  running = (thread != 0);
+#else
+  running = (pthread_create(&thread, 0, threadMain, this) == 0);
+#endif
+
+  return running;
+}
+
+//------------------------------------------------------------------------------
+
+void FFISampler::stop()
+{
+  if (! running)
+  {
+    return;
+  }
+
+  FFIAtomic::store(&stopRequested, 1);
+
+#ifdef _WIN32
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+  thread = 0;
+#else
+  pthread_join(thread, 0);
+#endif
+
+  running = false;
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFISampler::read(size_t since, std::vector<char> &records, size_t &first) const
+{
+  size_t end = FFIAtomic::load(&head);
+
+  first = since;
+  if (end - first > capacity || first > end)
+  {
+    first = (end > capacity) ? end - capacity : 0;
+  }
+
+  records.resize((end - first) * recordSize);
+  for (size_t i = first; i < end; ++i)
+  {
+    memcpy(&records[(i - first) * recordSize], &buffer[(i & (capacity - 1)) * recordSize], recordSize);
+  }
+
+  // the thread may have overwritten the oldest records while they were
+  // copied, including the one it is writing right now. drop those.
+  size_t newHead = FFIAtomic::load(&head);
+  size_t validFirst = (newHead + 1 > capacity) ? newHead + 1 - capacity : 0;
+
+  if (validFirst > first)
+  {
+    size_t dropped = (validFirst < end ? validFirst : end) - first;
+    records.erase(records.begin(), records.begin() + dropped * recordSize);
+    first += dropped;
+  }
+
+  return end;
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFISampler::getCallCount() const
+{
+  return FFIAtomic::load(&callCount);
+}
+
+size_t FFISampler::getOverrunCount() const
+{
+  return FFIAtomic::load(&overrunCount);
+}
+
+size_t FFISampler::getMaxJitter() const
+{
+  return FFIAtomic::load(&maxJitter);
+}
+
+size_t FFISampler::getMeanJitter() const
+{
+  size_t calls = FFIAtomic::load(&callCount);
+  return calls ? FFIAtomic::load(&jitterSum) / calls : 0;
+}
+
+size_t FFISampler::getMaxDuration() const
+{
+  return FFIAtomic::load(&maxDuration);
+}
+
+size_t FFISampler::getLastDuration() const
+{
+  return FFIAtomic::load(&lastDuration);
+}
+
+//------------------------------------------------------------------------------
+
+long long FFISampler::getTimestamp()
+{
+#ifdef _WIN32
+  // FILETIME counts 100 ns intervals since 1601
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  unsigned long long ticks = ((unsigned long long) now.dwHighDateTime << 32) | now.dwLowDateTime;
+  return (long long) (ticks / 10000 - 11644473600000ULL);
+#else
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return (long long) now.tv_sec * 1000 + now.tv_usec / 1000;
+#endif
+}
+
+//------------------------------------------------------------------------------
+
+void FFISampler::run()
+{
+  long long interval = (long long) intervalMs * 1000;
+  long long next = getMonotonicTime();
+
+  while (! FFIAtomic::load(&stopRequested))
+  {
+    long long now = getMonotonicTime();
+    if (now < next)
+    {
+      sleepUntil(next);
+      continue;
+    }
+
+    size_t jitter = (size_t) (now - next);
+
+    ffi_call(cif, funcPtr, returnValue, argValues);
+
+    long long done = getMonotonicTime();
+
+    // write the record, then publish it
+    size_t index = FFIAtomic::load(&head);
+    char *record = &buffer[(index & (capacity - 1)) * recordSize];
+
+    long long timestamp = getTimestamp();
+    memcpy(record, &timestamp, sizeof(timestamp));
+    record += sizeof(timestamp);
+
+    for (std::vector<Capture>::const_iterator it = captures.begin(); it != captures.end(); ++it)
+    {
+      memcpy(record, it->address, it->size);
+      record += it->size;
+    }
+
+    FFIAtomic::store(&head, index + 1);
+
+    // statistics
+    size_t duration = (size_t) (done - now);
+    FFIAtomic::store(&lastDuration, duration);
+    FFIAtomic::storeMax(&maxDuration, duration);
+    FFIAtomic::storeMax(&maxJitter, jitter);
+    FFIAtomic::fetchAdd(&jitterSum, jitter);
+    FFIAtomic::fetchAdd(&callCount, 1);
+
+    // keep the schedule. calls which would start too late are skipped.
+    next += interval;
+    if (done >= next)
+    {
+      long long skipped = (done - next) / interval + 1;
+      FFIAtomic::fetchAdd(&overrunCount, (size_t) skipped);
+      next += skipped * interval;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef _WIN32
+unsigned long __stdcall FFISampler::threadMain(void *sampler)
+#else
+void *FFISampler::threadMain(void *sampler)
+#endif
+{
+  static_cast<FFISampler *>(sampler)->run();
+  return 0;
+}
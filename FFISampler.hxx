@@ -0,0 +1,131 @@
+#ifndef _FFISAMPLER_H_
+#define _FFISAMPLER_H_
+
+#include <ffi.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Calls a function periodically on a native thread, and keeps the results
+ * in a ring buffer.
+ *
+ * After each call, the sampler copies a list of memory regions (the return
+ * value and the output parameters) into a record, together with a
+ * timestamp. The records can be read from another thread while the sampler
+ * is running. If they are not read fast enough, the oldest ones are lost.
+ */
+class FFISampler
+{
+public:
+  /// Function pointer type as used by libffi
+  typedef void (*VoidFunction)(void);
+
+  /// A memory region that is copied into the record after each call
+  struct Capture
+  {
+    const void *address;
+    size_t size;
+  };
+
+  /// Creates a sampler for a prepared call. The call interface and all
+  /// values must stay valid until the sampler is deleted.
+  FFISampler(ffi_cif *cif, VoidFunction funcPtr, void *returnValue, void **argValues,
+             const std::vector<Capture> &captures, unsigned int intervalMs, size_t capacity);
+
+  /// Stops the thread
+  ~FFISampler();
+
+  /// Starts the thread. Returns false if it could not be created.
+  bool start();
+
+  /// Stops the thread and waits until it ended
+  void stop();
+
+  /// Copies the records from index since (or the oldest one that is still
+  /// available) up to the newest one into records. The index of the first
+  /// copied record is stored in first. Returns the index after the last record.
+  size_t read(size_t since, std::vector<char> &records, size_t &first) const;
+
+  /// Returns the size of a record: the timestamp, followed by the captures
+  size_t getRecordSize() const { return recordSize; }
+
+  /// Returns the interval between two calls in milliseconds
+  unsigned int getInterval() const { return intervalMs; }
+
+  /// Returns the number of calls so far
+  size_t getCallCount() const;
+
+  /// Returns the number of calls that were skipped, because the previous
+  /// call took longer than the interval
+  size_t getOverrunCount() const;
+
+  /// Returns the highest delay of a call after its scheduled time in microseconds
+  size_t getMaxJitter() const;
+
+  /// Returns the average delay of a call after its scheduled time in microseconds
+  size_t getMeanJitter() const;
+
+  /// Returns the longest duration of a call in microseconds
+  size_t getMaxDuration() const;
+
+  /// Returns the duration of the last call in microseconds
+  size_t getLastDuration() const;
+
+  /// Returns the current time in milliseconds since the epoch, as stored in the records
+  static long long getTimestamp();
+
+private:
+  // not copyable
+  FFISampler(const FFISampler &);
+  FFISampler &operator=(const FFISampler &);
+
+  /// Entry point of the thread
+  void run();
+
+#ifdef _WIN32
+  static unsigned long __stdcall threadMain(void *sampler);
+#else
+  static void *threadMain(void *sampler);
+#endif
+
+  /// The call
+  ffi_cif *cif;
+  VoidFunction funcPtr;
+  void *returnValue;
+  void **argValues;
+  std::vector<Capture> captures;
+
+  unsigned int intervalMs;
+  size_t recordSize;
+  /// Number of records in the ring buffer, a power of two
+  size_t capacity;
+  /// The ring buffer
+  std::vector<char> buffer;
+  /// Number of records written so far. The newest one has the index head - 1.
+  volatile size_t head;
+
+  /// Set to stop the thread
+  volatile size_t stopRequested;
+  /// True while the thread is running
+  bool running;
+#ifdef _WIN32
+  void *thread;
+#else
+  pthread_t thread;
+#endif
+
+  // statistics, written by the thread
+  volatile size_t callCount;
+  volatile size_t overrunCount;
+  volatile size_t maxJitter;
+  volatile size_t jitterSum;
+  volatile size_t maxDuration;
+  volatile size_t lastDuration;
+};
+
+#endif // _FFISAMPLER_H_
@@ -0,0 +1,185 @@
+#include <FFISharedMemory.hxx>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//------------------------------------------------------------------------------
+
+FFISharedMemory *FFISharedMemory::create(const char *name, size_t size)
+{
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  return map(name, size, true);
+}
+
+//------------------------------------------------------------------------------
+
+FFISharedMemory *FFISharedMemory::open(const char *name)
+{
+  return map(name, 0, false);
+}
+
+//------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+FFISharedMemory *FFISharedMemory::map(const char *name, size_t size, bool create)
+{
+  if (! name || ! *name)
+  {
+    return 0;
+  }
+
+  HANDLE mapping = 0;
+  if (create)
+  {
+    unsigned long long size64 = size;
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE,
+                                 (DWORD) (size64 >> 32), (DWORD) size64, name);
+  }
+  else
+  {
+    mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+  }
+
+  if (! mapping)
+  {
+    return 0;
+  }
+
+  void *address = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (! address)
+  {
+    CloseHandle(mapping);
+    return 0;
+  }
+
+  // the size of an opened mapping is not known, so take the size of the view
+  if (size == 0)
+  {
+    MEMORY_BASIC_INFORMATION info;
+    if (VirtualQuery(address, &info, sizeof(info)) == 0)
+    {
+      UnmapViewOfFile(address);
+      CloseHandle(mapping);
+      return 0;
+    }
+
+    size = info.RegionSize;
+  }
+
+  FFISharedMemory *result = new FFISharedMemory();
+  result->name = name;
+  result->address = address;
+  result->size = size;
+  result->handle = mapping;
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+FFISharedMemory::~FFISharedMemory()
+{
+  UnmapViewOfFile(address);
+  CloseHandle(static_cast<HANDLE>(handle));
+}
+
+//------------------------------------------------------------------------------
+
+void FFISharedMemory::unlink()
+{
+  // nothing to do, the mapping disappears with its last handle
+}
+
+#else // _WIN32
+
+FFISharedMemory *FFISharedMemory::map(const char *name, size_t size, bool create)
+{
+  if (! name || ! *name)
+  {
+    return 0;
+  }
+
+  // POSIX requires the name to start with a slash
+  std::string shmName(name);
+  if (shmName[0] != '/')
+  {
+    shmName.insert(0, 1, '/');
+  }
+
+  int fd = shm_open(shmName.c_str(), create ? (O_RDWR | O_CREAT) : O_RDWR, 0660);
+  if (fd < 0)
+  {
+    return 0;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    ::close(fd);
+    return 0;
+  }
+
+  if (create)
+  {
+    // an existing region is only grown. shrinking it would give SIGBUS to
+    // other processes that mapped the rest of it.
+    if (static_cast<size_t>(info.st_size) < size &&
+        ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+      ::close(fd);
+      return 0;
+    }
+  }
+  else
+  {
+    if (info.st_size <= 0)
+    {
+      ::close(fd);
+      return 0;
+    }
+
+    size = static_cast<size_t>(info.st_size);
+  }
+
+  void *address = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  // the mapping stays valid without the descriptor
+  ::close(fd);
+
+  if (address == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  FFISharedMemory *result = new FFISharedMemory();
+  result->name = shmName;
+  result->address = address;
+  result->size = size;
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+FFISharedMemory::~FFISharedMemory()
+{
+  munmap(address, size);
+}
+
+//------------------------------------------------------------------------------
+
+void FFISharedMemory::unlink()
+{
+  shm_unlink(name.c_str());
+}
+
+#endif // _WIN32
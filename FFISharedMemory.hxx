@@ -0,0 +1,63 @@
+#ifndef _FFISHAREDMEMORY_H_
+#define _FFISHAREDMEMORY_H_
+
+#include <string>
+#include <cstddef>
+
+/**
+ * A named shared memory region, mapped into the address space of this process.
+ *
+ * On Linux, the region is backed by shm_open() and mmap(), on Windows by a
+ * pagefile backed file mapping. The mapping is released when the object is
+ * deleted, but the region itself lives on until it is unlinked (Linux) or
+ * until the last process closed it (Windows).
+ */
+class FFISharedMemory
+{
+public:
+  /// Creates a region with the given size, or maps an existing one, which is
+  /// grown if it is smaller but never shrunk.
+  /// Returns 0 on failure.
+  static FFISharedMemory *create(const char *name, size_t size);
+
+  /// Opens an existing region with its current size. Returns 0 on failure.
+  static FFISharedMemory *open(const char *name);
+
+  /// Unmaps the region from this process
+  ~FFISharedMemory();
+
+  /// Removes the name of the region, so that it cannot be opened anymore.
+  /// Processes which already mapped the region can continue to use it.
+  void unlink();
+
+  /// Returns the address of the mapping in this process
+  void *getAddress() const { return address; }
+
+  /// Returns the size of the mapping in bytes
+  size_t getSize() const { return size; }
+
+  /// Returns the name of the region
+  const std::string &getName() const { return name; }
+
+private:
+  FFISharedMemory() : address(0), size(0), handle(0) { }
+
+  // not copyable
+  FFISharedMemory(const FFISharedMemory &);
+  FFISharedMemory &operator=(const FFISharedMemory &);
+
+  /// Opens or creates a region. If size is zero, the current size is used.
+  static FFISharedMemory *map(const char *name, size_t size, bool create);
+
+  /// Name of the region, as given to shm_open() or CreateFileMapping()
+  std::string name;
+  /// Address of the mapping
+  void *address;
+  /// Size of the mapping in bytes
+  size_t size;
+  /// Handle of the file mapping. Only used on Windows, on Linux the file
+  /// descriptor is closed as soon as the region is mapped.
+  void *handle;
+};
+
+#endif // _FFISHAREDMEMORY_H_
@@ -0,0 +1,133 @@
+#include <FFISink.hxx>
+
+#include <DpIdValueList.hxx>
+#include <Manager.hxx>
+#include <Variable.hxx>
+
+//------------------------------------------------------------------------------
+
+FFISink::FFISink()
+  : valueCount(0),
+    flushCount(0),
+    failedCount(0),
+    droppedCount(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+FFISink::~FFISink()
+{
+  clear();
+}
+
+//------------------------------------------------------------------------------
+
+void FFISink::add(size_t target, Variable *value)
+{
+  if (target >= targets.size())
+  {
+    delete value;
+    ++droppedCount;
+    return;
+  }
+
+  pending.push_back(std::make_pair(target, value));
+}
+
+//------------------------------------------------------------------------------
+
+bool FFISink::flush()
+{
+  if (pending.empty())
+  {
+    return true;
+  }
+
+  bool sent = send(pending);
+  if (sent)
+  {
+    valueCount += pending.size();
+    ++flushCount;
+  }
+  else
+  {
+    ++failedCount;
+  }
+
+  clear();
+  return sent;
+}
+
+//------------------------------------------------------------------------------
+
+void FFISink::clear()
+{
+  for (ValueList::iterator it = pending.begin(); it != pending.end(); ++it)
+  {
+    delete it->second;
+  }
+
+  pending.clear();
+}
+
+//------------------------------------------------------------------------------
+
+FFIMemorySink::~FFIMemorySink()
+{
+  for (std::vector<Variable *>::iterator it = lastValues.begin(); it != lastValues.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIMemorySink::addTarget(const char *name)
+{
+  targets.push_back(name);
+  lastValues.push_back(0);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIMemorySink::send(const ValueList &values)
+{
+  for (ValueList::const_iterator it = values.begin(); it != values.end(); ++it)
+  {
+    delete lastValues[it->first];
+    lastValues[it->first] = it->second->clone();
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIDpSink::addTarget(const char *name)
+{
+  DpIdentifier id;
+  if (! Manager::getId(name, id))
+  {
+    return false;
+  }
+
+  targets.push_back(name);
+  ids.push_back(id);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+bool FFIDpSink::send(const ValueList &values)
+{
+  DpIdValueList list;
+
+  for (ValueList::const_iterator it = values.begin(); it != values.end(); ++it)
+  {
+    list.appendItem(ids[it->first], *(it->second));
+  }
+
+  return Manager::dpSet(list) == PVSS_TRUE;
+}
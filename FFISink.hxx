@@ -0,0 +1,137 @@
+#ifndef _FFISINK_H_
+#define _FFISINK_H_
+
+#include <DpIdentifier.hxx>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// forward declarations
+class Variable;
+
+/**
+ * Sends values from the extension to datapoint elements, without a round
+ * trip through Ctrl.
+ *
+ * The targets are added when the sink is created, and the values are
+ * addressed by the zero-based index of their target. Values are queued by
+ * add() and sent together by flush(), so that the values of one cycle
+ * result in one message. Derived classes implement the sending.
+ */
+class FFISink
+{
+public:
+  FFISink();
+
+  /// Deletes the queued values without sending them
+  virtual ~FFISink();
+
+  /// Adds a target. Returns false if the name cannot be resolved.
+  virtual bool addTarget(const char *name) = 0;
+
+  /// Returns the number of targets
+  size_t getTargetCount() const { return targets.size(); }
+
+  /// Returns the name of a target
+  const std::string &getTargetName(size_t target) const { return targets[target]; }
+
+  /// Queues a value for a target and takes ownership of it. Values for
+  /// targets which do not exist are dropped and counted.
+  void add(size_t target, Variable *value);
+
+  /// Sends the queued values in one batch. Returns false if sending failed.
+  /// The values are removed in any case, so that the queue cannot grow
+  /// while the receiver is not available.
+  bool flush();
+
+  /// Returns the number of queued values
+  size_t getPendingCount() const { return pending.size(); }
+
+  /// Returns the number of values sent successfully
+  unsigned long long getValueCount() const { return valueCount; }
+
+  /// Returns the number of batches sent successfully
+  unsigned long long getFlushCount() const { return flushCount; }
+
+  /// Returns the number of batches which could not be sent
+  unsigned long long getFailedCount() const { return failedCount; }
+
+  /// Returns the number of values dropped because their target does not exist
+  unsigned long long getDroppedCount() const { return droppedCount; }
+
+protected:
+  /// Values with the index of their target
+  typedef std::vector<std::pair<size_t, Variable *> > ValueList;
+
+  /// Sends the values. Returns false on failure.
+  virtual bool send(const ValueList &values) = 0;
+
+  /// Names of the targets
+  std::vector<std::string> targets;
+
+private:
+  // not copyable, the queued values are owned
+  FFISink(const FFISink &);
+  FFISink &operator=(const FFISink &);
+
+  /// Deletes the queued values
+  void clear();
+
+  ValueList pending;
+
+  unsigned long long valueCount;
+  unsigned long long flushCount;
+  unsigned long long failedCount;
+  unsigned long long droppedCount;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A sink which keeps the last value sent to each target, instead of
+ * writing datapoints. Any name is accepted as target.
+ *
+ * Used to test and benchmark the code feeding a sink without a project.
+ */
+class FFIMemorySink : public FFISink
+{
+public:
+  /// Deletes the stored values
+  virtual ~FFIMemorySink();
+
+  virtual bool addTarget(const char *name);
+
+  /// Returns the last value sent to a target, or 0 if there was none
+  const Variable *getLastValue(size_t target) const { return lastValues[target]; }
+
+protected:
+  virtual bool send(const ValueList &values);
+
+private:
+  /// The last value of each target, owned
+  std::vector<Variable *> lastValues;
+};
+
+//------------------------------------------------------------------------------
+
+/**
+ * A sink which writes datapoint elements with one dpSet per batch,
+ * like a dpSet() with all values in Ctrl.
+ */
+class FFIDpSink : public FFISink
+{
+public:
+  /// Resolves the name of a datapoint element. Returns false if it does not exist.
+  virtual bool addTarget(const char *name);
+
+protected:
+  virtual bool send(const ValueList &values);
+
+private:
+  /// The identifier of each target
+  std::vector<DpIdentifier> ids;
+};
+
+#endif // _FFISINK_H_
@@ -0,0 +1,88 @@
+#include <FFIStringArray.hxx>
+
+#include <DynVar.hxx>
+#include <TextVar.hxx>
+
+#include <cstring>
+
+//------------------------------------------------------------------------------
+
+/// Returns the text of an item. Items of other types are converted to the
+/// given TextVar, strings are used directly.
+static const char *getText(const Variable *item, TextVar &converted)
+{
+  if (item && item->isA() == TEXT_VAR)
+  {
+    return static_cast<const TextVar *>(item)->getValue();
+  }
+
+  if (item)
+  {
+    converted = *item;
+  }
+
+  return converted.getValue();
+}
+
+//------------------------------------------------------------------------------
+
+size_t FFIStringArray::getPackedSize(const DynVar &texts)
+{
+  unsigned int count = texts.getNumberOfItems();
+
+  // the table with its terminator
+  size_t size = (count + 1) * sizeof(char *);
+
+  for (unsigned int i = 1; i <= count; ++i)
+  {
+    TextVar converted;
+    size += strlen(getText(texts[i], converted)) + 1;
+  }
+
+  return size;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIStringArray::pack(const DynVar &texts, char *buffer)
+{
+  unsigned int count = texts.getNumberOfItems();
+
+  const char **table = reinterpret_cast<const char **>(buffer);
+  char *data = buffer + (count + 1) * sizeof(char *);
+
+  for (unsigned int i = 1; i <= count; ++i)
+  {
+    TextVar converted;
+    const char *text = getText(texts[i], converted);
+
+    size_t length = strlen(text) + 1;
+    memcpy(data, text, length);
+
+    table[i - 1] = data;
+    data += length;
+  }
+
+  table[count] = 0;
+}
+
+//------------------------------------------------------------------------------
+
+void FFIStringArray::unpack(const char *const *table, size_t count, DynVar &texts)
+{
+  for (size_t i = 0; i < count; ++i)
+  {
+    const char *text = table[i];
+    if (! text)
+    {
+      if (count == NULL_TERMINATED)
+      {
+        break;
+      }
+
+      text = "";
+    }
+
+    texts.append(new TextVar(text));
+  }
+}
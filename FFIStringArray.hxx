@@ -0,0 +1,36 @@
+#ifndef _FFISTRINGARRAY_H_
+#define _FFISTRINGARRAY_H_
+
+#include <cstddef>
+
+// forward declarations
+class DynVar;
+
+/**
+ * Conversions between a dyn_string and a C array of strings (char **).
+ *
+ * A packed array is a single block of memory: the table of the string
+ * pointers, terminated by a null pointer, followed by the texts. It can be
+ * released with a single free(), and passed as "const char *argv[]" with or
+ * without a count.
+ */
+class FFIStringArray
+{
+public:
+  /// The count for unpack() of an array terminated by a null pointer
+  static const size_t NULL_TERMINATED = (size_t) -1;
+
+  /// Returns the number of bytes needed to pack the texts
+  static size_t getPackedSize(const DynVar &texts);
+
+  /// Packs the texts into a buffer of getPackedSize() bytes, which must be
+  /// aligned for pointers. Items that are not strings are converted.
+  static void pack(const DynVar &texts, char *buffer);
+
+  /// Appends count strings of a table to the texts, or all strings up to the
+  /// first null pointer if count is NULL_TERMINATED. Null pointers within a
+  /// counted table give empty strings.
+  static void unpack(const char *const *table, size_t count, DynVar &texts);
+};
+
+#endif // _FFISTRINGARRAY_H_
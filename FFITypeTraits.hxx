@@ -0,0 +1,60 @@
+#ifndef _FFITYPETRAITS_H_
+#define _FFITYPETRAITS_H_
+
+#include <FFITypes.hxx>
+
+#include <Variable.hxx>
+
+#include <ffi.h>
+
+#include <cstddef>
+
+// forward declarations
+class FFIValue;
+
+/**
+ * Properties of an IntegralType, in a table with one entry per type that is
+ * built at compile time from the C type and the Ctrl type of each value.
+ *
+ * The conversions between raw memory and Ctrl are stateless functions, so a
+ * typed load or store needs no FFIValue. The markers of the type ranges and
+ * invalid types have an entry with all members 0.
+ */
+struct FFITypeTraits
+{
+  typedef void (*ReadFunction)(Variable &var, const void *rawMemory);
+  typedef void (*WriteFunction)(const Variable &var, void *rawMemory);
+  typedef Variable *(*AllocateCtrlVarFunction)();
+  typedef FFIValue *(*AllocateValueFunction)();
+
+  /// Name of the global Ctrl constant, e.g. "FFI_INT"
+  const char *name;
+
+  /// The type used by libffi for arguments and return values
+  ffi_type *ffiType;
+
+  /// Type of the Ctrl variables of the values, NO_VAR for FFI_VOID
+  VariableType ctrlType;
+
+  /// Number of bytes read and written by read and write
+  size_t size;
+
+  /// Converts a value in raw memory into a variable of any type, or 0 if the
+  /// type has no value in memory (e.g. FFI_STRING). For _PTR types, this is
+  /// the value the pointer points to. The memory need not be aligned.
+  ReadFunction read;
+
+  /// Converts a variable of any type to a value in raw memory, or 0
+  WriteFunction write;
+
+  /// Returns a new variable of ctrlType, or 0 for FFI_VOID
+  AllocateCtrlVarFunction allocateCtrlVar;
+
+  /// Returns a new storage for an argument or a return value
+  AllocateValueFunction allocateValue;
+
+  /// Returns the traits of an IntegralType without flags
+  static const FFITypeTraits &get(int type);
+};
+
+#endif // _FFITYPETRAITS_H_
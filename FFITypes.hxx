@@ -70,9 +70,37 @@ enum IntegralType
   CTRLFFI_POINTER,
   CTRLFFI_VOID,
   CTRLFFI_STRING,
+  // output-only parameters receiving a pointer from the function (char **,
+  // handle_t **). the slot lives in the call frame and is dereferenced after the call.
+  CTRLFFI_STRING_OUT,
+  CTRLFFI_POINTER_OUT,
+  // a read-only array of strings (const char **), converted from a dyn_string,
+  // or to a dyn_string if it is terminated by a null pointer
+  CTRLFFI_STRING_ARRAY,
 
   // this value terminates the enum. it must always be the last one.
   CTRLFFI_MAX_VALUE
 };
 
+/// Flags that can be combined with an IntegralType,
+/// e.g. CTRLFFI_INT_PTR | CTRLFFI_DIR_OUT
+enum TypeFlags
+{
+  // the bits of a combined type that hold the IntegralType
+  CTRLFFI_TYPE_MASK = 0xff,
+
+  // direction of the parameter. input parameters are converted from their
+  // Ctrl variable before the call, output parameters are written back after it.
+  CTRLFFI_DIR_IN = 0x100,
+  CTRLFFI_DIR_OUT = 0x200,
+  CTRLFFI_DIR_INOUT = CTRLFFI_DIR_IN | CTRLFFI_DIR_OUT,
+  CTRLFFI_DIR_MASK = CTRLFFI_DIR_INOUT,
+
+  // byte order of a value in memory, for struct fields, array items and
+  // raw memory access. without these flags, the host byte order is used.
+  CTRLFFI_BIG_ENDIAN = 0x400,
+  CTRLFFI_LITTLE_ENDIAN = 0x800,
+  CTRLFFI_BYTEORDER_MASK = CTRLFFI_BIG_ENDIAN | CTRLFFI_LITTLE_ENDIAN
+};
+
 #endif // _FFITYPES_H_
@@ -1,9 +1,12 @@
 #include <FFIValue.hxx>
 
+#include <FFIStringArray.hxx>
+#include <FFITypeTraits.hxx>
 #include <FFITypes.hxx>
 
 #include <Variable.hxx>
 #include <CharVar.hxx>
+#include <DynVar.hxx>
 #include <FloatVar.hxx>
 #include <IntegerVar.hxx>
 #include <UIntegerVar.hxx>
@@ -11,6 +14,9 @@
 #include <ULongVar.hxx>
 #include <TextVar.hxx>
 
+#include <cstring>
+#include <vector>
+
 //------------------------------------------------------------------------------
 // helper class template FFIScalarValue
 
@@ -19,6 +25,8 @@ template <typename CType, typename CtrlType>
 class FFIScalarValue : public FFIValue
 {
 public:
+  /// Initializes the value with zero, for output parameters
+  FFIScalarValue() : value() { }
 
   virtual void setValue(const Variable &var)
   {
@@ -31,32 +39,53 @@ public:
   }
 
   virtual void writeValueToRawMemory(const Variable &var, void *rawMemory) const
+  {
+    write(var, rawMemory);
+  }
+
+  virtual void readValueFromRawMemory(Variable &var, const void *rawMemory) const
+  {
+    read(var, rawMemory);
+  }
+
+  virtual Variable *allocateCtrlVar() const { return new CtrlType; };
+
+  virtual void *getPtr() { return static_cast<void *>(&value); }
+
+  /// Stateless version of writeValueToRawMemory, for FFITypeTraits
+  static void write(const Variable &var, void *rawMemory)
   {
     // convert any Ctrl type to expected Ctrl type
     CtrlType tmpVar;
     tmpVar = var;
 
-    // convert the Ctrl Type to its native peer
-    CType *nativeValue = static_cast<CType *>(rawMemory);
-    *nativeValue = static_cast<CType>(tmpVar.getValue());
+    // convert the Ctrl Type to its native peer. memcpy, because the memory
+    // is not necessarily aligned (e.g. packed structs).
+    CType nativeValue = static_cast<CType>(tmpVar.getValue());
+    memcpy(rawMemory, &nativeValue, sizeof(CType));
   }
 
-  virtual void readValueFromRawMemory(Variable &var, const void *rawMemory) const
+  /// Stateless version of readValueFromRawMemory, for FFITypeTraits
+  static void read(Variable &var, const void *rawMemory)
   {
-    // cast the void pointer to its expected native type
-    const CType *nativeValue = static_cast<const CType *>(rawMemory);
+    // copy the memory to its expected native type
+    CType nativeValue;
+    memcpy(&nativeValue, rawMemory, sizeof(CType));
+
+    // a variable of the expected type is set directly, others are converted
+    if (var.isA() == CtrlType().isA())
+    {
+      static_cast<CtrlType &>(var).setValue(nativeValue);
+      return;
+    }
 
     // store the native value in the corresponding Ctrl type
     CtrlType tmpVar;
-    tmpVar.setValue(*nativeValue);
+    tmpVar.setValue(nativeValue);
 
     var = tmpVar;
   }
 
-  virtual Variable *allocateCtrlVar() const { return new CtrlType; };
-
-  virtual void *getPtr() { return static_cast<void *>(&value); }
-
 private:
   CType value;
 };
@@ -126,6 +155,21 @@ public:
   }
 
   virtual void writeValueToRawMemory(const Variable &var, void *rawMemory) const
+  {
+    write(var, rawMemory);
+  }
+
+  virtual void readValueFromRawMemory(Variable &var, const void *rawMemory) const
+  {
+    read(var, rawMemory);
+  }
+
+  virtual Variable *allocateCtrlVar() const { return new ULongVar; };
+
+  virtual void *getPtr() { return static_cast<void *>(&value); }
+
+  /// Stateless version of writeValueToRawMemory, for FFITypeTraits
+  static void write(const Variable &var, void *rawMemory)
   {
     // convert any Ctrl type to expected Ctrl type
     ULongVar tmpVar;
@@ -133,26 +177,30 @@ public:
     uintptr_t ptrValue = static_cast<uintptr_t>(tmpVar.getValue());
 
     // convert the Ctrl Type to its native peer
-    void **nativeValue = static_cast<void **>(rawMemory);
-    *nativeValue = reinterpret_cast<void *>(ptrValue);
+    void *nativeValue = reinterpret_cast<void *>(ptrValue);
+    memcpy(rawMemory, &nativeValue, sizeof(void *));
   }
 
-  virtual void readValueFromRawMemory(Variable &var, const void *rawMemory) const
+  /// Stateless version of readValueFromRawMemory, for FFITypeTraits
+  static void read(Variable &var, const void *rawMemory)
   {
-    // cast the void pointer to its expected native type
-    const uintptr_t *ptrValue = static_cast<const uintptr_t *>(rawMemory);
+    // copy the memory to its expected native type
+    uintptr_t ptrValue;
+    memcpy(&ptrValue, rawMemory, sizeof(uintptr_t));
+
+    if (var.isA() == ULONG_VAR)
+    {
+      static_cast<ULongVar &>(var).setValue(ptrValue);
+      return;
+    }
 
     // store the native value in the corresponding Ctrl type
     ULongVar tmpVar;
-    tmpVar.setValue(*ptrValue);
+    tmpVar.setValue(ptrValue);
 
     var = tmpVar;
   }
 
-  virtual Variable *allocateCtrlVar() const { return new ULongVar; };
-
-  virtual void *getPtr() { return static_cast<void *>(&value); }
-
 private:
   void *value;
 };
@@ -207,59 +255,274 @@ private:
   TextVar textStorage;
 };
 
+//------------------------------------------------------------------------------
+// helper class FFIStringArrayValue
+
+/**
+ * An implementation of FFIValue that stores and owns a packed array of
+ * strings (see FFIStringArray), converted from a dyn_string.
+ *
+ * Like FFICharPointerValue, this is read-only for the function. It can give
+ * a table like "const char *argv[]" to a function, or receive a table
+ * terminated by a null pointer as return value, which is copied to a dyn_string.
+ */
+class FFIStringArrayValue : public FFIValue
+{
+public:
+  FFIStringArrayValue() : value(0) { }
+
+  virtual void setValue(const Variable &var)
+  {
+    if (! var.isDynVar())
+    {
+      // TODO: error. not a dyn.
+      storage.assign(1, static_cast<const char *>(0));
+    }
+    else
+    {
+      const DynVar &texts = static_cast<const DynVar &>(var);
+
+      // the storage is made of pointers, so that the table is aligned
+      size_t size = FFIStringArray::getPackedSize(texts);
+      storage.assign((size + sizeof(char *) - 1) / sizeof(char *), static_cast<const char *>(0));
+      FFIStringArray::pack(texts, reinterpret_cast<char *>(&storage[0]));
+    }
+
+    value = &storage[0];
+  }
+
+  virtual void getValue(Variable &var) const
+  {
+    DynVar tmpVar(TEXT_VAR);
+    if (value)
+    {
+      FFIStringArray::unpack(value, FFIStringArray::NULL_TERMINATED, tmpVar);
+    }
+    var = tmpVar;
+  }
+
+  virtual void writeValueToRawMemory(const Variable &var, void *rawMemory) const
+  {
+    // TODO: error?
+  }
+
+  virtual void readValueFromRawMemory(Variable &var, const void *rawMemory) const
+  {
+    // TODO: error?
+  }
+
+  virtual Variable *allocateCtrlVar() const { return new DynVar(TEXT_VAR); };
+
+  virtual void *getPtr() { return static_cast<void *>(&value); }
+
+private:
+  const char **value;
+  std::vector<const char *> storage;
+};
 
 //------------------------------------------------------------------------------
-// FFIValue factory method
+// helper class FFIOutSlotValue
 
-FFIValue *FFIValue::allocateValue(int type)
+/**
+ * Base class for output-only parameters that receive a pointer, e.g. char **.
+ *
+ * The pointer slot is part of this value, so no buffer has to be allocated
+ * for it. The function gets the address of the slot, and the pointer stored
+ * there is converted by the derived class after the call.
+ */
+class FFIOutSlotValue : public FFIValue
+{
+public:
+  FFIOutSlotValue() : slot(0), slotPtr(0) { }
+
+  // the slot is never set from Ctrl and cannot be read from raw memory
+  virtual void setValue(const Variable &) { }
+  virtual void writeValueToRawMemory(const Variable &, void *) const { }
+  virtual void readValueFromRawMemory(Variable &, const void *) const { }
+
+  virtual void *getPtr()
+  {
+    slotPtr = &slot;
+    return static_cast<void *>(&slotPtr);
+  }
+
+protected:
+  /// The pointer written by the function
+  void *slot;
+  /// The address of the slot, which is passed to the function
+  void **slotPtr;
+};
+
+//------------------------------------------------------------------------------
+// helper class FFIStringOutValue
+
+/**
+ * An implementation of FFIValue for char ** output parameters.
+ * The returned text is copied to a TextVar. A null pointer gives an empty string.
+ */
+class FFIStringOutValue : public FFIOutSlotValue
 {
-  switch (type)
+public:
+  virtual void getValue(Variable &var) const
   {
-    // non-fixed length types
-    case CTRLFFI_UCHAR:  return new FFIScalarValue<unsigned char,  UIntegerVar>();
-    case CTRLFFI_CHAR:   return new FFIScalarValue<char,           CharVar>();
-    case CTRLFFI_USHORT: return new FFIScalarValue<unsigned short, UIntegerVar>();
-    case CTRLFFI_SHORT:  return new FFIScalarValue<short,          IntegerVar>();
-    case CTRLFFI_UINT:   return new FFIScalarValue<unsigned int,   UIntegerVar>();
-    case CTRLFFI_INT:    return new FFIScalarValue<int,            IntegerVar>();
-    case CTRLFFI_ULONG:  return new FFIScalarValue<unsigned long,  ULongVar>();
-    case CTRLFFI_LONG:   return new FFIScalarValue<long,           LongVar>();
-    case CTRLFFI_FLOAT:  return new FFIScalarValue<float,          FloatVar>();
-    case CTRLFFI_DOUBLE: return new FFIScalarValue<double,         FloatVar>();
-    // fixed length types
-    case CTRLFFI_UINT8:  return new FFIScalarValue<uint8_t,  UIntegerVar>();
-    case CTRLFFI_INT8:   return new FFIScalarValue<int8_t,   IntegerVar>();
-    case CTRLFFI_UINT16: return new FFIScalarValue<uint16_t, UIntegerVar>();
-    case CTRLFFI_INT16:  return new FFIScalarValue<int16_t,  IntegerVar>();
-    case CTRLFFI_UINT32: return new FFIScalarValue<uint32_t, UIntegerVar>();
-    case CTRLFFI_INT32:  return new FFIScalarValue<int32_t,  IntegerVar>();
-    case CTRLFFI_UINT64: return new FFIScalarValue<uint64_t, ULongVar>();
-    case CTRLFFI_INT64:  return new FFIScalarValue<int64_t,  LongVar>();
-    // pointer types
-    case CTRLFFI_UCHAR_PTR:  return new FFIPointerToScalarValue<unsigned char,  UIntegerVar>();
-    case CTRLFFI_CHAR_PTR:   return new FFIPointerToScalarValue<char,           CharVar>();
-    case CTRLFFI_USHORT_PTR: return new FFIPointerToScalarValue<unsigned short, UIntegerVar>();
-    case CTRLFFI_SHORT_PTR:  return new FFIPointerToScalarValue<short,          IntegerVar>();
-    case CTRLFFI_UINT_PTR:   return new FFIPointerToScalarValue<unsigned int,   UIntegerVar>();
-    case CTRLFFI_INT_PTR:    return new FFIPointerToScalarValue<int,            IntegerVar>();
-    case CTRLFFI_ULONG_PTR:  return new FFIPointerToScalarValue<unsigned long,  ULongVar>();
-    case CTRLFFI_LONG_PTR:   return new FFIPointerToScalarValue<long,           LongVar>();
-    case CTRLFFI_FLOAT_PTR:  return new FFIPointerToScalarValue<float,          FloatVar>();
-    case CTRLFFI_DOUBLE_PTR: return new FFIPointerToScalarValue<double,         FloatVar>();
-
-    case CTRLFFI_UINT8_PTR:  return new FFIPointerToScalarValue<uint8_t,  UIntegerVar>();
-    case CTRLFFI_INT8_PTR:   return new FFIPointerToScalarValue<int8_t,   IntegerVar>();
-    case CTRLFFI_UINT16_PTR: return new FFIPointerToScalarValue<uint16_t, UIntegerVar>();
-    case CTRLFFI_INT16_PTR:  return new FFIPointerToScalarValue<int16_t,  IntegerVar>();
-    case CTRLFFI_UINT32_PTR: return new FFIPointerToScalarValue<uint32_t, UIntegerVar>();
-    case CTRLFFI_INT32_PTR:  return new FFIPointerToScalarValue<int32_t,  IntegerVar>();
-    case CTRLFFI_UINT64_PTR: return new FFIPointerToScalarValue<uint64_t, ULongVar>();
-    case CTRLFFI_INT64_PTR:  return new FFIPointerToScalarValue<int64_t,  LongVar>();
-    // special types
-    case CTRLFFI_POINTER:    return new FFIPointerValue();
-    case CTRLFFI_VOID:       return new FFIVoidValue();
-    case CTRLFFI_STRING:     return new FFICharPointerValue();
+    TextVar tmpVar;
+    tmpVar.setValue(slot ? static_cast<const char *>(slot) : "");
+    var = tmpVar;
   }
 
-  return 0;
+  virtual Variable *allocateCtrlVar() const { return new TextVar; };
+};
+
+//------------------------------------------------------------------------------
+// helper class FFIPointerOutValue
+
+/**
+ * An implementation of FFIValue for void ** output parameters, e.g. handles
+ * created by the function. The returned pointer is converted to a ULongVar.
+ */
+class FFIPointerOutValue : public FFIOutSlotValue
+{
+public:
+  virtual void getValue(Variable &var) const
+  {
+    ULongVar tmpVar;
+    tmpVar.setValue(reinterpret_cast<uintptr_t>(slot));
+    var = tmpVar;
+  }
+
+  virtual Variable *allocateCtrlVar() const { return new ULongVar; };
+};
+
+
+//------------------------------------------------------------------------------
+// FFITypeTraits table
+
+/// Returns a new Ctrl variable of the given class
+template <typename CtrlType>
+static Variable *allocateCtrlVar()
+{
+  return new CtrlType;
+}
+
+/// Returns a new dyn_string
+static Variable *allocateDynString()
+{
+  return new DynVar(TEXT_VAR);
+}
+
+/// Returns a new FFIValue of the given class
+template <typename ValueType>
+static FFIValue *allocateValue()
+{
+  return new ValueType;
+}
+
+// the entries of the types with a C type and a Ctrl type
+#define SCALAR_TRAITS(NAME, FFI_TYPE, C_TYPE, CTRL_CLASS, CTRL_TYPE) \
+  { NAME, &FFI_TYPE, CTRL_TYPE, sizeof(C_TYPE), \
+    &FFIScalarValue<C_TYPE, CTRL_CLASS>::read, &FFIScalarValue<C_TYPE, CTRL_CLASS>::write, \
+    &allocateCtrlVar<CTRL_CLASS>, &allocateValue<FFIScalarValue<C_TYPE, CTRL_CLASS> > }
+
+#define POINTER_TO_SCALAR_TRAITS(NAME, C_TYPE, CTRL_CLASS, CTRL_TYPE) \
+  { NAME, &ffi_type_pointer, CTRL_TYPE, sizeof(C_TYPE), \
+    &FFIScalarValue<C_TYPE, CTRL_CLASS>::read, &FFIScalarValue<C_TYPE, CTRL_CLASS>::write, \
+    &allocateCtrlVar<CTRL_CLASS>, &allocateValue<FFIPointerToScalarValue<C_TYPE, CTRL_CLASS> > }
+
+// the entries of the markers, which are not valid types
+#define NO_TRAITS { 0, 0, NO_VAR, 0, 0, 0, 0, 0 }
+
+/// The traits of all types, indexed by IntegralType
+static const FFITypeTraits TYPE_TRAITS[] = {
+  NO_TRAITS, // CTRLFFI_FIRST_VALUE_TYPE
+
+  // non-fixed length types
+  SCALAR_TRAITS("FFI_UCHAR",  ffi_type_uchar,  unsigned char,  UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_CHAR",   ffi_type_schar,  char,           CharVar,     CHAR_VAR),
+  SCALAR_TRAITS("FFI_USHORT", ffi_type_ushort, unsigned short, UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_SHORT",  ffi_type_sshort, short,          IntegerVar,  INTEGER_VAR),
+  SCALAR_TRAITS("FFI_UINT",   ffi_type_uint,   unsigned int,   UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_INT",    ffi_type_sint,   int,            IntegerVar,  INTEGER_VAR),
+  SCALAR_TRAITS("FFI_ULONG",  ffi_type_ulong,  unsigned long,  ULongVar,    ULONG_VAR),
+  SCALAR_TRAITS("FFI_LONG",   ffi_type_slong,  long,           LongVar,     LONG_VAR),
+  SCALAR_TRAITS("FFI_FLOAT",  ffi_type_float,  float,          FloatVar,    FLOAT_VAR),
+  SCALAR_TRAITS("FFI_DOUBLE", ffi_type_double, double,         FloatVar,    FLOAT_VAR),
+  // fixed length types
+  SCALAR_TRAITS("FFI_UINT8",  ffi_type_uint8,  uint8_t,  UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_INT8",   ffi_type_sint8,  int8_t,   IntegerVar,  INTEGER_VAR),
+  SCALAR_TRAITS("FFI_UINT16", ffi_type_uint16, uint16_t, UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_INT16",  ffi_type_sint16, int16_t,  IntegerVar,  INTEGER_VAR),
+  SCALAR_TRAITS("FFI_UINT32", ffi_type_uint32, uint32_t, UIntegerVar, UINTEGER_VAR),
+  SCALAR_TRAITS("FFI_INT32",  ffi_type_sint32, int32_t,  IntegerVar,  INTEGER_VAR),
+  SCALAR_TRAITS("FFI_UINT64", ffi_type_uint64, uint64_t, ULongVar,    ULONG_VAR),
+  SCALAR_TRAITS("FFI_INT64",  ffi_type_sint64, int64_t,  LongVar,     LONG_VAR),
+
+  NO_TRAITS, // CTRLFFI_LAST_VALUE_TYPE
+  NO_TRAITS, // CTRLFFI_FIRST_PTR
+
+  // pointer types
+  POINTER_TO_SCALAR_TRAITS("FFI_UCHAR_PTR",  unsigned char,  UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_CHAR_PTR",   char,           CharVar,     CHAR_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_USHORT_PTR", unsigned short, UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_SHORT_PTR",  short,          IntegerVar,  INTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_UINT_PTR",   unsigned int,   UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_INT_PTR",    int,            IntegerVar,  INTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_ULONG_PTR",  unsigned long,  ULongVar,    ULONG_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_LONG_PTR",   long,           LongVar,     LONG_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_FLOAT_PTR",  float,          FloatVar,    FLOAT_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_DOUBLE_PTR", double,         FloatVar,    FLOAT_VAR),
+
+  POINTER_TO_SCALAR_TRAITS("FFI_UINT8_PTR",  uint8_t,  UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_INT8_PTR",   int8_t,   IntegerVar,  INTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_UINT16_PTR", uint16_t, UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_INT16_PTR",  int16_t,  IntegerVar,  INTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_UINT32_PTR", uint32_t, UIntegerVar, UINTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_INT32_PTR",  int32_t,  IntegerVar,  INTEGER_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_UINT64_PTR", uint64_t, ULongVar,    ULONG_VAR),
+  POINTER_TO_SCALAR_TRAITS("FFI_INT64_PTR",  int64_t,  LongVar,     LONG_VAR),
+
+  NO_TRAITS, // CTRLFFI_LAST_PTR
+
+  // special types
+  { "FFI_POINTER", &ffi_type_pointer, ULONG_VAR, sizeof(void *),
+    &FFIPointerValue::read, &FFIPointerValue::write,
+    &allocateCtrlVar<ULongVar>, &allocateValue<FFIPointerValue> },
+  { "FFI_VOID", &ffi_type_void, NO_VAR, 0, 0, 0, 0, &allocateValue<FFIVoidValue> },
+  { "FFI_STRING", &ffi_type_pointer, TEXT_VAR, 0, 0, 0,
+    &allocateCtrlVar<TextVar>, &allocateValue<FFICharPointerValue> },
+  { "FFI_STRING_OUT", &ffi_type_pointer, TEXT_VAR, 0, 0, 0,
+    &allocateCtrlVar<TextVar>, &allocateValue<FFIStringOutValue> },
+  { "FFI_POINTER_OUT", &ffi_type_pointer, ULONG_VAR, 0, 0, 0,
+    &allocateCtrlVar<ULongVar>, &allocateValue<FFIPointerOutValue> },
+  { "FFI_STRING_ARRAY", &ffi_type_pointer, DYNTEXT_VAR, 0, 0, 0,
+    &allocateDynString, &allocateValue<FFIStringArrayValue> }
+};
+
+#undef SCALAR_TRAITS
+#undef POINTER_TO_SCALAR_TRAITS
+
+// fails to compile unless there is one entry per IntegralType
+typedef char TYPE_TRAITS_SIZE_CHECK[(sizeof(TYPE_TRAITS) / sizeof(*TYPE_TRAITS) == CTRLFFI_MAX_VALUE) ? 1 : -1];
+
+const FFITypeTraits &FFITypeTraits::get(int type)
+{
+  static const FFITypeTraits invalid = NO_TRAITS;
+
+  if (type < 0 || type >= CTRLFFI_MAX_VALUE)
+  {
+    return invalid;
+  }
+
+  return TYPE_TRAITS[type];
+}
+
+#undef NO_TRAITS
+
+//------------------------------------------------------------------------------
+// FFIValue factory method
+
+FFIValue *FFIValue::allocateValue(int type)
+{
+  FFITypeTraits::AllocateValueFunction allocate = FFITypeTraits::get(type).allocateValue;
+
+  return allocate ? allocate() : 0;
 }
@@ -0,0 +1,558 @@
+#!/usr/bin/env python3
+"""
+ffibindgen - generates a CtrlFFI binding library from a C header.
+
+The generated Ctrl library contains:
+  - one dyn_int layout per struct, including the padding bytes, with the
+    size of the struct and the index of each field in the layout,
+  - an init function that fills all layouts and declares all functions
+    in one go,
+  - one typed wrapper per function, which caches the function id.
+
+The header is parsed with a simple stand-in parser that understands the
+usual subset of API headers: structs, typedefs, enums and function
+prototypes. Macros are not expanded, and bitfields, unions, variadic
+functions and structs passed by value are not supported. Declarations
+that cannot be handled are reported on stderr and skipped.
+
+Struct layouts follow the natural alignment rules of the selected ABI.
+With --check, a C file with static assertions for all sizes and offsets is
+written, which can be compiled against the header to verify the layouts.
+
+Usage:
+  ffibindgen.py [--abi lp64|llp64|ilp32] [--prefix NAME] [--check FILE.c]
+                --library LIBPATH -o OUTPUT.ctl HEADER.h
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# name: (ffi type, Ctrl type, size). the size of long depends on the ABI.
+SCALARS = {
+    'char':               ('FFI_CHAR',   'char',  1),
+    'signed char':        ('FFI_INT8',   'int',   1),
+    'unsigned char':      ('FFI_UCHAR',  'uint',  1),
+    'short':              ('FFI_SHORT',  'int',   2),
+    'unsigned short':     ('FFI_USHORT', 'uint',  2),
+    'int':                ('FFI_INT',    'int',   4),
+    'unsigned int':       ('FFI_UINT',   'uint',  4),
+    'long':               ('FFI_LONG',   'long',  None),
+    'unsigned long':      ('FFI_ULONG',  'ulong', None),
+    'long long':          ('FFI_INT64',  'long',  8),
+    'unsigned long long': ('FFI_UINT64', 'ulong', 8),
+    'float':              ('FFI_FLOAT',  'float', 4),
+    'double':             ('FFI_DOUBLE', 'float', 8),
+    'int8_t':             ('FFI_INT8',   'int',   1),
+    'uint8_t':            ('FFI_UINT8',  'uint',  1),
+    'int16_t':            ('FFI_INT16',  'int',   2),
+    'uint16_t':           ('FFI_UINT16', 'uint',  2),
+    'int32_t':            ('FFI_INT32',  'int',   4),
+    'uint32_t':           ('FFI_UINT32', 'uint',  4),
+    'int64_t':            ('FFI_INT64',  'long',  8),
+    'uint64_t':           ('FFI_UINT64', 'ulong', 8),
+    'bool':               ('FFI_UINT8',  'uint',  1),
+    '_Bool':              ('FFI_UINT8',  'uint',  1),
+}
+
+# size of long and of pointers per ABI
+ABIS = {
+    'lp64':  {'long': 8, 'pointer': 8},
+    'llp64': {'long': 4, 'pointer': 8},
+    'ilp32': {'long': 4, 'pointer': 4},
+}
+
+# typedefs that depend on the ABI
+SIZED_TYPEDEFS = {
+    'size_t':    {'lp64': 'unsigned long', 'llp64': 'unsigned long long', 'ilp32': 'unsigned int'},
+    'ssize_t':   {'lp64': 'long',          'llp64': 'long long',          'ilp32': 'int'},
+    'intptr_t':  {'lp64': 'long',          'llp64': 'long long',          'ilp32': 'int'},
+    'uintptr_t': {'lp64': 'unsigned long', 'llp64': 'unsigned long long', 'ilp32': 'unsigned int'},
+}
+
+CTRL_TYPES = {
+    'FFI_POINTER': 'ulong',
+    'FFI_STRING':  'string',
+}
+
+
+class BindgenError(Exception):
+    pass
+
+
+class Type(object):
+    """A parsed C type: a base name, a pointer depth and constness of the pointee."""
+
+    def __init__(self, base, pointers, const):
+        self.base = base
+        self.pointers = pointers
+        self.const = const
+
+    def __str__(self):
+        return ('const ' if self.const else '') + self.base + ' *' * self.pointers
+
+
+class Field(object):
+    def __init__(self, name, ffitype, offset, size):
+        self.name = name
+        self.ffitype = ffitype
+        self.offset = offset
+        self.size = size
+
+
+class Struct(object):
+    def __init__(self, name):
+        self.name = name
+        self.size = 0
+        self.align = 1
+        # list of (field name or None for padding, ffi type, offset)
+        self.entries = []
+        # field name -> (index of the first layout entry, offset, C type)
+        self.fields = []
+
+
+class Function(object):
+    def __init__(self, name, ret, params):
+        self.name = name
+        self.ret = ret
+        # list of (name, ffi type, C type)
+        self.params = params
+
+
+#------------------------------------------------------------------------------
+# parsing
+
+def strip_source(text):
+    """Removes comments, preprocessor lines, extern "C" blocks and attributes."""
+    text = re.sub(r'/\*.*?\*/', ' ', text, flags=re.S)
+    text = re.sub(r'//[^\n]*', ' ', text)
+    text = re.sub(r'\\\n', ' ', text)
+    text = re.sub(r'^\s*#[^\n]*', ' ', text, flags=re.M)
+    text = re.sub(r'extern\s+"C"\s*\{', ' ', text)
+    text = re.sub(r'__attribute__\s*\(\(.*?\)\)', ' ', text)
+    text = re.sub(r'\b(extern|static|inline|__cdecl|__stdcall|WINAPI|CALLBACK)\b', ' ', text)
+    return text
+
+
+def split_declarations(text):
+    """Splits the source into top-level declarations, ending at ';'."""
+    decls = []
+    depth = 0
+    current = []
+    for ch in text:
+        if ch == '{':
+            depth += 1
+        elif ch == '}':
+            depth -= 1
+            if depth < 0:
+                # closing brace of an extern "C" block
+                depth = 0
+                continue
+        if ch == ';' and depth == 0:
+            decl = ' '.join(''.join(current).split())
+            if decl:
+                decls.append(decl)
+            current = []
+        else:
+            current.append(ch)
+    return decls
+
+
+class Parser(object):
+    def __init__(self, abi):
+        self.abi = abi
+        self.typedefs = {}
+        self.structs = {}
+        self.struct_order = []
+        self.functions = []
+        self.warnings = []
+
+    def warn(self, text):
+        self.warnings.append(text)
+
+    def parse(self, text):
+        for decl in split_declarations(strip_source(text)):
+            try:
+                self.parse_declaration(decl)
+            except BindgenError as e:
+                self.warn('skipped "%s": %s' % (decl[:60], e))
+
+    def parse_declaration(self, decl):
+        m = re.match(r'^(typedef\s+)?(struct|union|enum)\s*(\w+)?\s*\{(.*)\}\s*(.*)$', decl, re.S)
+        if m:
+            is_typedef, kind, tag, body, names = m.groups()
+            if kind == 'union':
+                raise BindgenError('unions are not supported')
+            if kind == 'enum':
+                for name in self.split_names(names):
+                    self.typedefs[name] = Type('int', 0, False)
+                return
+            aliases = self.split_names(names) if is_typedef else []
+            if aliases:
+                name = aliases[0]
+            elif tag:
+                name = 'struct ' + tag
+            else:
+                raise BindgenError('anonymous struct')
+            struct = self.parse_struct(name, body)
+            if tag:
+                self.structs['struct ' + tag] = struct
+            for alias in aliases:
+                if alias.startswith('*'):
+                    self.typedefs[alias.lstrip('*').strip()] = Type('void', 1, False)
+                else:
+                    self.structs[alias] = struct
+            return
+
+        if decl.startswith('typedef '):
+            if '(' in decl:
+                # function pointer typedef, treat as an opaque pointer
+                m = re.search(r'\(\s*\*\s*(\w+)\s*\)', decl)
+                if m:
+                    self.typedefs[m.group(1)] = Type('void', 1, False)
+                    return
+                raise BindgenError('unsupported typedef')
+            ctype, name = self.split_declarator(decl[len('typedef '):])
+            self.typedefs[name] = ctype
+            return
+
+        if decl.startswith('struct ') and '(' not in decl:
+            # forward declaration
+            return
+
+        if '(' in decl:
+            self.parse_function(decl)
+            return
+
+        raise BindgenError('unsupported declaration')
+
+    @staticmethod
+    def split_names(names):
+        return [n.strip() for n in names.split(',') if n.strip()]
+
+    def split_declarator(self, text):
+        """Splits 'const char *name' into (Type, name)."""
+        m = re.match(r'^(.*?)(\w+)\s*$', text.strip(), re.S)
+        if not m:
+            raise BindgenError('cannot parse declarator "%s"' % text)
+        return self.parse_type(m.group(1)), m.group(2)
+
+    def parse_type(self, text):
+        pointers = text.count('*')
+        words = text.replace('*', ' ').split()
+        const = 'const' in words
+        words = [w for w in words if w not in ('const', 'volatile', 'signed')
+                 or (w == 'signed' and words == ['signed', 'char'])]
+        if words and words[-1] == 'int' and len(words) > 1:
+            # 'unsigned long int' is 'unsigned long'
+            words = words[:-1]
+        if words == ['unsigned']:
+            words = ['unsigned', 'int']
+        if not words:
+            raise BindgenError('missing type in "%s"' % text)
+        base = ' '.join(words)
+
+        # resolve typedefs
+        while base in self.typedefs:
+            alias = self.typedefs[base]
+            base = alias.base
+            pointers += alias.pointers
+            const = const or alias.const
+        if base in SIZED_TYPEDEFS:
+            base = SIZED_TYPEDEFS[base][self.abi]
+        return Type(base, pointers, const)
+
+    def scalar(self, base):
+        """Returns (ffi type, Ctrl type, size) for a scalar base type or None."""
+        if base not in SCALARS:
+            return None
+        ffitype, ctrltype, size = SCALARS[base]
+        if size is None:
+            size = ABIS[self.abi]['long']
+        return ffitype, ctrltype, size
+
+    def find_struct(self, base):
+        return self.structs.get(base) or self.structs.get('struct ' + base)
+
+    def layout_of(self, ctype):
+        """Returns (list of ffi types, size, alignment) of a field type."""
+        if ctype.pointers > 0:
+            size = ABIS[self.abi]['pointer']
+            return [('FFI_POINTER', 0)], size, size
+        scalar = self.scalar(ctype.base)
+        if scalar:
+            return [(scalar[0], 0)], scalar[2], scalar[2]
+        struct = self.find_struct(ctype.base)
+        if struct:
+            return [(t, o) for (_, t, o) in struct.entries], struct.size, struct.align
+        raise BindgenError('unknown type "%s"' % ctype.base)
+
+    def parse_struct(self, name, body):
+        struct = Struct(name)
+        offset = 0
+        for member in [m.strip() for m in body.split(';') if m.strip()]:
+            if ':' in member:
+                raise BindgenError('bitfields are not supported')
+            if '{' in member:
+                raise BindgenError('nested struct definitions are not supported')
+            # split 'int a, *b, c[4]' into declarators sharing the base type
+            m = re.match(r'^(.*?\b\w+\b[\s*]*?)\s*(\**\s*\w+\s*(\[\s*\d+\s*\])*)\s*((,.*)?)$', member, re.S)
+            if not m:
+                raise BindgenError('cannot parse member "%s"' % member)
+            declarators = [m.group(2)] + self.split_names(m.group(4).lstrip(','))
+            basetext = m.group(1)
+            for declarator in declarators:
+                count = 1
+                for dim in re.findall(r'\[\s*(\d+)\s*\]', declarator):
+                    count *= int(dim)
+                declarator = re.sub(r'\[.*', '', declarator)
+                ctype, fieldname = self.split_declarator(basetext + ' ' + declarator)
+                types, size, align = self.layout_of(ctype)
+
+                # insert padding for the alignment of the field
+                padding = (-offset) % align
+                for i in range(padding):
+                    struct.entries.append((None, 'FFI_UINT8', offset + i))
+                offset += padding
+
+                struct.fields.append((fieldname, len(struct.entries) + 1, offset, ctype, count))
+                for i in range(count):
+                    for ffitype, suboffset in types:
+                        struct.entries.append((fieldname, ffitype, offset + suboffset))
+                    offset += size
+                struct.align = max(struct.align, align)
+
+        # trailing padding, so that arrays of the struct are aligned
+        padding = (-offset) % struct.align
+        for i in range(padding):
+            struct.entries.append((None, 'FFI_UINT8', offset + i))
+        struct.size = offset + padding
+        if name not in self.struct_order:
+            self.struct_order.append(name)
+        return struct
+
+    def param_type(self, ctype, is_return):
+        """Maps a C type to (ffi type, Ctrl type, by reference)."""
+        if ctype.pointers == 0:
+            if ctype.base == 'void':
+                return 'FFI_VOID', None, False
+            scalar = self.scalar(ctype.base)
+            if scalar:
+                return scalar[0], scalar[1], False
+            raise BindgenError('type "%s" cannot be passed by value' % ctype.base)
+
+        if ctype.pointers == 1 and ctype.const and ctype.base == 'char':
+            return 'FFI_STRING', 'string', False
+
+        if ctype.pointers == 1 and not ctype.const and not is_return and ctype.base != 'char':
+            scalar = self.scalar(ctype.base)
+            if scalar:
+                return scalar[0] + '_PTR', scalar[1], True
+
+        # T ** parameters usually return a string or a handle created by the function
+        if ctype.pointers == 2 and not is_return:
+            if ctype.base == 'char':
+                return 'FFI_STRING_OUT', 'string', True
+            return 'FFI_POINTER_OUT', 'ulong', True
+
+        return 'FFI_POINTER', 'ulong', False
+
+    def parse_function(self, decl):
+        m = re.match(r'^(.*?)\(\s*(.*)\s*\)$', decl, re.S)
+        if not m or '(' in m.group(2):
+            raise BindgenError('function pointers as parameters are not supported')
+        ret, name = self.split_declarator(m.group(1))
+        params = []
+        paramtext = m.group(2).strip()
+        if paramtext not in ('', 'void'):
+            for i, p in enumerate(self.split_names(paramtext)):
+                if p == '...':
+                    raise BindgenError('variadic functions are not supported')
+                if re.search(r'\[\s*\d*\s*\]$', p):
+                    p = re.sub(r'\[\s*\d*\s*\]$', '', p) + ' *'
+                    p = re.sub(r'(\w+)\s*\*$', r'* \1', p)
+                lastword = re.search(r'(\w+)\s*$', p)
+                if p.endswith('*') or not lastword or lastword.group(1) in SCALARS \
+                        or lastword.group(1) in self.typedefs or len(p.split()) == 1:
+                    # unnamed parameter
+                    ctype, pname = self.parse_type(p), 'arg%d' % (i + 1)
+                else:
+                    ctype, pname = self.split_declarator(p)
+                params.append((pname,) + self.param_type(ctype, False))
+        self.functions.append(Function(name, self.param_type(ret, True), params))
+
+
+#------------------------------------------------------------------------------
+# output
+
+def ctrl_identifier(name):
+    return re.sub(r'\W', '_', name)
+
+
+def generate(parser, header, library, prefix):
+    out = []
+    w = out.append
+    w('// Generated by ffibindgen.py from %s. Do not edit.' % os.path.basename(header))
+    w('')
+    w('#uses "CtrlFFI"')
+    w('')
+    w('const string %sLIBRARY = "%s";' % (prefix, library))
+
+    # structs
+    for name in parser.struct_order:
+        struct = parser.structs[name]
+        ident = prefix + ctrl_identifier(name.replace('struct ', ''))
+        w('')
+        w('//' + '-' * 78)
+        cname = name if name.startswith('struct ') else 'struct ' + name
+        w('// %s: %d bytes, alignment %d' % (cname, struct.size, struct.align))
+        w('')
+        w('// layout for ffiBufferToStruct/ffiFillBufferWithStruct, filled by %sinit()' % prefix)
+        w('dyn_int %s_LAYOUT;' % ident)
+        w('const uint %s_SIZE = %d;' % (ident, struct.size))
+        w('')
+        w('// index of each field in %s_LAYOUT, and its offset in the struct' % ident)
+        for fieldname, index, offset, ctype, count in struct.fields:
+            suffix = '[%d]' % count if count > 1 else ''
+            w('const int %s_%s = %d; // offset %d: %s %s%s' % (ident, fieldname, index, offset, ctype, fieldname, suffix))
+
+    # function ids
+    if parser.functions:
+        w('')
+        w('//' + '-' * 78)
+        w('// function ids, set by %sinit()' % prefix)
+        w('')
+        for func in parser.functions:
+            w('uint %s%s_id;' % (prefix, func.name))
+
+    # init function
+    w('')
+    w('//' + '-' * 78)
+    w('')
+    w('// set by %sinit(), which only runs once' % prefix)
+    w('bool %sinitialized;' % prefix)
+    w('bool %sinitResult;' % prefix)
+    w('')
+    w('// Fills all struct layouts and declares all functions.')
+    w('// Returns false if a function could not be declared.')
+    w('bool %sinit()' % prefix)
+    w('{')
+    w('  // a missing function must not be declared again on each call of a wrapper')
+    w('  if (%sinitialized)' % prefix)
+    w('  {')
+    w('    return %sinitResult;' % prefix)
+    w('  }')
+    w('')
+    w('  %sinitialized = true;' % prefix)
+    w('  bool ok = true;')
+    for name in parser.struct_order:
+        struct = parser.structs[name]
+        ident = prefix + ctrl_identifier(name.replace('struct ', ''))
+        w('')
+        w('  %s_LAYOUT = makeDynInt(' % ident)
+        for i, (fieldname, ffitype, offset) in enumerate(struct.entries):
+            sep = ',' if i + 1 < len(struct.entries) else ''
+            comment = fieldname if fieldname else 'padding'
+            w('    %s%s // %d: %s' % (ffitype, sep, offset, comment))
+        w('  );')
+    if parser.functions:
+        w('')
+    for func in parser.functions:
+        types = [func.ret[0]] + [p[1] for p in func.params]
+        w('  %s%s_id = ffiDeclareFunction(%sLIBRARY, "%s", %s);' % (prefix, func.name, prefix, func.name, ', '.join(types)))
+        w('  ok = ok && %s%s_id != 0;' % (prefix, func.name))
+    w('')
+    w('  %sinitResult = ok;' % prefix)
+    w('  return ok;')
+    w('}')
+
+    # wrappers
+    for func in parser.functions:
+        rettype, retctrl, _ = func.ret
+        params = ', '.join('%s %s%s' % (ctrl, '&' if byref else '', pname)
+                           for (pname, _, ctrl, byref) in func.params)
+        args = ''.join(', ' + pname for (pname, _, _, _) in func.params)
+        w('')
+        w('//' + '-' * 78)
+        w('')
+        w('%s %s%s(%s)' % (retctrl or 'void', prefix, func.name, params))
+        w('{')
+        w('  if (! %s%s_id)' % (prefix, func.name))
+        w('  {')
+        w('    %sinit();' % prefix)
+        w('  }')
+        w('')
+        if rettype == 'FFI_VOID':
+            w('  if (! ffiCallFunction(%s%s_id, 0%s))' % (prefix, func.name, args))
+        else:
+            # returned as is if the call fails
+            w('  %s result = %s;' % (retctrl, '""' if retctrl == 'string' else '0'))
+            w('  if (! ffiCallFunction(%s%s_id, result%s))' % (prefix, func.name, args))
+        w('  {')
+        w('    throwError(makeError("", PRIO_SEVERE, ERR_CONTROL, 0, "%s%s: cannot call %s in " + %sLIBRARY));'
+          % (prefix, func.name, func.name, prefix))
+        w('  }')
+        if rettype != 'FFI_VOID':
+            w('')
+            w('  return result;')
+        w('}')
+
+    return '\n'.join(out) + '\n'
+
+
+def generate_check(parser, header):
+    """Writes C static assertions for all struct sizes and field offsets.
+    The directory of the header has to be in the include path."""
+    out = []
+    w = out.append
+    w('/* Generated by ffibindgen.py from %s. Compile to verify the layouts. */' % os.path.basename(header))
+    w('#include <stddef.h>')
+    w('#include "%s"' % os.path.basename(header))
+    w('')
+    w('/* a negative array size fails the compilation */')
+    w('#define CHECK_LINE(cond, line) typedef char check_line_##line[(cond) ? 1 : -1]')
+    w('#define CHECK(cond, line) CHECK_LINE(cond, line)')
+    w('')
+    for name in parser.struct_order:
+        struct = parser.structs[name]
+        w('CHECK(sizeof(%s) == %d, __LINE__);' % (name, struct.size))
+        for fieldname, index, offset, _, _ in struct.fields:
+            w('CHECK(offsetof(%s, %s) == %d, __LINE__);' % (name, fieldname, offset))
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    argparser = argparse.ArgumentParser(description='Generates a CtrlFFI binding library from a C header.')
+    argparser.add_argument('header')
+    argparser.add_argument('-o', '--output', required=True, help='Ctrl library to write')
+    argparser.add_argument('--library', required=True, help='path of the shared library for ffiDeclareFunction')
+    argparser.add_argument('--prefix', help='prefix for all generated names (default: header name + "_")')
+    argparser.add_argument('--abi', choices=sorted(ABIS), default='lp64', help='data model for struct layouts')
+    argparser.add_argument('--check', help='also write a C file with static assertions for the layouts')
+    args = argparser.parse_args()
+
+    prefix = args.prefix
+    if prefix is None:
+        prefix = ctrl_identifier(os.path.splitext(os.path.basename(args.header))[0]) + '_'
+
+    with open(args.header) as f:
+        source = f.read()
+
+    parser = Parser(args.abi)
+    parser.parse(source)
+    for warning in parser.warnings:
+        sys.stderr.write('ffibindgen: %s\n' % warning)
+
+    with open(args.output, 'w') as f:
+        f.write(generate(parser, args.header, args.library, prefix))
+
+    if args.check:
+        with open(args.check, 'w') as f:
+            f.write(generate_check(parser, args.header))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
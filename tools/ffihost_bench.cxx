@@ -0,0 +1,104 @@
+// Compares the latency of in-process calls with calls through CtrlFFIHost.
+//
+// Usage: ffihost_bench [host executable [iterations]]
+//
+// Build and run with "make host-bench".
+
+#include <FFIHostProtocol.hxx>
+#include <FFIRemoteHost.hxx>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <dlfcn.h>
+#include <time.h>
+
+static const char *LIBRARY = "libc.so.6";
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, std::vector<double> &samples)
+{
+  std::sort(samples.begin(), samples.end());
+
+  double sum = 0;
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    sum += samples[i];
+  }
+
+  printf("%-16s mean %9.0f ns  p50 %9.0f ns  p99 %9.0f ns  max %9.0f ns\n", name,
+         sum / samples.size(), samples[samples.size() / 2],
+         samples[samples.size() * 99 / 100], samples.back());
+}
+
+int main(int argc, char *argv[])
+{
+  const char *hostExecutable = (argc > 1) ? argv[1] : "./CtrlFFIHost";
+  int iterations = (argc > 2) ? atoi(argv[2]) : 100000;
+
+  if (iterations < 1)
+  {
+    return 2;
+  }
+
+  // long labs(long), as a call which does nearly nothing
+  std::vector<int> argTypes(1, CTRLFFI_LONG);
+  ffi_type *ffiArgTypes[] = { &ffi_type_slong };
+  ffi_cif cif;
+  ffi_prep_cif(&cif, FFI_DEFAULT_ABI, 1, &ffi_type_slong, ffiArgTypes);
+
+  void *library = dlopen(LIBRARY, RTLD_NOW);
+  void *symbol = library ? dlsym(library, "labs") : 0;
+  if (! symbol)
+  {
+    fprintf(stderr, "labs not found\n");
+    return 1;
+  }
+
+  FFIRemoteHost host(LIBRARY, hostExecutable);
+  int remoteFunction = host.declare("labs", CTRLFFI_LONG, argTypes);
+  if (remoteFunction < 0)
+  {
+    fprintf(stderr, "could not start %s\n", hostExecutable);
+    return 1;
+  }
+
+  std::vector<double> local(iterations);
+  std::vector<double> remote(iterations);
+
+  for (int i = 0; i < iterations; ++i)
+  {
+    long arg = -i;
+    ffi_arg result = 0;
+    void *argValues[] = { &arg };
+
+    double start = now();
+    ffi_call(&cif, reinterpret_cast<void (*)()>(symbol), &result, argValues);
+    local[i] = now() - start;
+
+    long remoteResult = 0;
+    start = now();
+    bool ok = host.call(remoteFunction, &remoteResult, argValues);
+    remote[i] = now() - start;
+
+    if (! ok || remoteResult != (long) result)
+    {
+      fprintf(stderr, "wrong result for %ld\n", arg);
+      return 1;
+    }
+  }
+
+  printf("%d calls of labs()\n", iterations);
+  report("in-process", local);
+  report("out-of-process", remote);
+
+  return 0;
+}
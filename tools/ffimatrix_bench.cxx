@@ -0,0 +1,122 @@
+// Compares the blocked transposition of ffiFillBufferWithMatrix and
+// ffiBufferToMatrix for column-major matrices with a naive transposition and
+// with a plain copy, for square matrices of up to 2048 x 2048 items.
+//
+// Usage: ffimatrix_bench [iterations]
+//
+// The conversion of the items from and to Ctrl is the same for both layouts,
+// and needs a WinCC OA manager, so it is not part of this benchmark.
+//
+// Build and run with "make matrix-bench".
+
+#include <FFIKernels.hxx>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <time.h>
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/// Transposes item by item, like a loop over the columns of a column-major matrix
+template <typename T>
+static void transposeNaive(T *dest, const T *src, size_t rows, size_t cols)
+{
+  for (size_t r = 0; r < rows; ++r)
+  {
+    for (size_t c = 0; c < cols; ++c)
+    {
+      dest[c * rows + r] = src[r * cols + c];
+    }
+  }
+}
+
+/// Returns the best time of a number of runs in ns
+template <typename T>
+static double measure(int method, T *dest, const T *src, size_t n, int iterations)
+{
+  double best = 0;
+
+  for (int i = 0; i < iterations; ++i)
+  {
+    double start = now();
+
+    switch (method)
+    {
+      case 0:  memcpy(dest, src, n * n * sizeof(T)); break;
+      case 1:  transposeNaive(dest, src, n, n); break;
+      default: FFIKernels::transpose(dest, n, src, n, n, n, sizeof(T)); break;
+    }
+
+    double duration = now() - start;
+    if (i == 0 || duration < best)
+    {
+      best = duration;
+    }
+  }
+
+  return best;
+}
+
+template <typename T>
+static bool run(const char *typeName, int iterations)
+{
+  static const size_t SIZES[] = { 64, 256, 512, 1024, 2048 };
+  static const char *METHODS[] = { "copy", "naive", "blocked" };
+
+  for (size_t s = 0; s < sizeof(SIZES) / sizeof(*SIZES); ++s)
+  {
+    size_t n = SIZES[s];
+    std::vector<T> src(n * n), dest(n * n), expected(n * n);
+
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+      src[i] = (T) (i % 1000);
+    }
+
+    transposeNaive(&expected[0], &src[0], n, n);
+    FFIKernels::transpose(&dest[0], n, &src[0], n, n, n, sizeof(T));
+    if (dest != expected)
+    {
+      fprintf(stderr, "wrong result for %s %u x %u\n", typeName, (unsigned int) n, (unsigned int) n);
+      return false;
+    }
+
+    // read and written once
+    double bytes = 2.0 * n * n * sizeof(T);
+
+    for (int method = 0; method < 3; ++method)
+    {
+      double ns = measure(method, &dest[0], &src[0], n, iterations);
+      printf("%-6s %4u x %-4u %-8s %10.3f ms %8.2f GB/s\n", typeName, (unsigned int) n, (unsigned int) n,
+             METHODS[method], ns / 1e6, bytes / ns);
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = (argc > 1) ? atoi(argv[1]) : 10;
+
+  if (iterations < 1)
+  {
+    return 2;
+  }
+
+  if (! run<float>("float", iterations) || ! run<double>("double", iterations))
+  {
+    return 1;
+  }
+
+  return 0;
+}
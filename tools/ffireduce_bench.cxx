@@ -0,0 +1,160 @@
+// Compares the blocked reduction of ffiBufferReduce with a naive loop that
+// computes the same aggregates item by item, with Welford's algorithm for the
+// variance, for packed and strided arrays of 1M items.
+//
+// Usage: ffireduce_bench [iterations]
+//
+// The conversion of the results to Ctrl values needs a WinCC OA manager, so
+// it is not part of this benchmark.
+//
+// Build and run with "make reduce-bench".
+
+#include <FFIKernels.hxx>
+#include <FFITypes.hxx>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+#include <time.h>
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/// Computes the aggregates item by item
+template <typename T>
+static void reduceNaive(const unsigned char *data, size_t count, size_t stride,
+                        double above, double below, FFIKernels::Reduction &result)
+{
+  double min = HUGE_VAL, max = -HUGE_VAL, mean = 0;
+
+  result.sum = 0;
+  result.squaredDeviations = 0;
+  result.minIndex = FFIKernels::NOT_FOUND;
+  result.maxIndex = FFIKernels::NOT_FOUND;
+  result.above = 0;
+  result.below = 0;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    T item;
+    memcpy(&item, data + i * stride, sizeof(T));
+    double value = (double) item;
+
+    result.sum += value;
+    if (value < min || (result.minIndex == FFIKernels::NOT_FOUND && value == min))
+    {
+      min = value;
+      result.minIndex = i;
+    }
+    if (value > max || (result.maxIndex == FFIKernels::NOT_FOUND && value == max))
+    {
+      max = value;
+      result.maxIndex = i;
+    }
+    result.above += (value > above) ? 1 : 0;
+    result.below += (value < below) ? 1 : 0;
+
+    double delta = value - mean;
+    mean += delta / (i + 1);
+    result.squaredDeviations += delta * (value - mean);
+  }
+}
+
+/// Returns the best time of a number of runs in ns
+template <typename T>
+static double measure(bool naive, int type, const unsigned char *data, size_t count, size_t stride,
+                      int iterations, FFIKernels::Reduction &result)
+{
+  double best = 0;
+
+  for (int i = 0; i < iterations; ++i)
+  {
+    double start = now();
+
+    if (naive)
+    {
+      reduceNaive<T>(data, count, stride, 0.5, -0.5, result);
+    }
+    else
+    {
+      FFIKernels::reduce(data, count, stride, type, false, 0.5, -0.5, true, result);
+    }
+
+    double duration = now() - start;
+    if (i == 0 || duration < best)
+    {
+      best = duration;
+    }
+  }
+
+  return best;
+}
+
+template <typename T>
+static bool run(const char *typeName, int type, int iterations)
+{
+  static const size_t COUNT = 1 << 20;
+
+  // packed, and a field of a 16 byte record
+  const size_t STRIDES[] = { sizeof(T), 16 };
+
+  for (size_t s = 0; s < sizeof(STRIDES) / sizeof(*STRIDES); ++s)
+  {
+    size_t stride = STRIDES[s];
+    std::vector<unsigned char> data(COUNT * stride);
+
+    srand(1);
+    for (size_t i = 0; i < COUNT; ++i)
+    {
+      T value = (T) (rand() % 2001 - 1000);
+      memcpy(&data[i * stride], &value, sizeof(T));
+    }
+
+    FFIKernels::Reduction expected, result;
+    double naive = measure<T>(true, type, &data[0], COUNT, stride, iterations, expected);
+    double blocked = measure<T>(false, type, &data[0], COUNT, stride, iterations, result);
+
+    if (result.minIndex != expected.minIndex || result.maxIndex != expected.maxIndex ||
+        result.above != expected.above || result.below != expected.below ||
+        fabs(result.sum - expected.sum) > 1e-6 * fabs(expected.sum) + 1e-6 ||
+        fabs(result.squaredDeviations - expected.squaredDeviations) > 1e-9 * expected.squaredDeviations)
+    {
+      fprintf(stderr, "wrong result for %s with stride %u\n", typeName, (unsigned int) stride);
+      return false;
+    }
+
+    printf("%-8s stride %2u  naive %8.3f ms  blocked %8.3f ms  %5.2fx\n", typeName, (unsigned int) stride,
+           naive / 1e6, blocked / 1e6, naive / blocked);
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = (argc > 1) ? atoi(argv[1]) : 10;
+
+  if (iterations < 1)
+  {
+    return 2;
+  }
+
+  if (! run<int16_t>("int16", CTRLFFI_INT16, iterations) ||
+      ! run<int32_t>("int32", CTRLFFI_INT32, iterations) ||
+      ! run<int64_t>("int64", CTRLFFI_INT64, iterations) ||
+      ! run<float>("float", CTRLFFI_FLOAT, iterations) ||
+      ! run<double>("double", CTRLFFI_DOUBLE, iterations))
+  {
+    return 1;
+  }
+
+  return 0;
+}
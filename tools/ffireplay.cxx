@@ -0,0 +1,465 @@
+// Replays a log written by ffiStartRecording outside of WinCC OA, and reports
+// the throughput and latency percentiles of each function.
+//
+// Usage: ffireplay [--repeat N] [--map LIBRARY=REPLACEMENT] [--scratch BYTES] LOG
+//
+// The calls are issued in the recorded order with the recorded inputs, against
+// the recorded libraries or against replacements given with --map (e.g. stubs).
+// --repeat replays the whole log N times.
+//
+// Only the inputs of the calls are known, so a few things differ from the
+// recording:
+//  - FFI_POINTER arguments point to a zeroed scratch buffer of --scratch bytes
+//    (default 65536), or are null if they were null
+//  - memory returned through out slots is not freed
+//  - functions declared by address cannot be replayed and are skipped
+//
+// Build with "make ffireplay".
+
+#include <FFIHostProtocol.hxx>
+#include <FFIKernels.hxx>
+#include <FFIRecordFormat.hxx>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <time.h>
+
+/// A function of the log
+struct Function
+{
+  std::string library;
+  std::string name;
+  int returnType;
+  std::vector<int> argTypes;
+  std::vector<ffi_type *> ffiArgTypes;
+  ffi_cif cif;
+  void (*funcPtr)(void);
+  /// Why the function cannot be called, empty if it can
+  std::string skipReason;
+
+  std::vector<double> recorded;
+  std::vector<double> replayed;
+  size_t skipped;
+};
+
+/// How an argument is passed
+enum ArgKind
+{
+  ARG_VALUE,
+  ARG_PTR,
+  ARG_STRING,
+  ARG_STRING_ARRAY,
+  ARG_POINTER,
+  ARG_OUT
+};
+
+/// An argument of a call. The value is stored in the input of the call at
+/// offset, preceded by an 8 byte holder for the pointer that is passed.
+struct Argument
+{
+  ArgKind kind;
+  size_t offset;
+  /// Number of recorded bytes
+  size_t size;
+  bool isNull;
+};
+
+/// A call of the log
+struct Call
+{
+  Function *function;
+  double duration;
+  std::vector<Argument> args;
+  /// The recorded inputs
+  std::vector<char> input;
+};
+
+//------------------------------------------------------------------------------
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t alignUp(size_t size)
+{
+  return (size + 7) & ~(size_t) 7;
+}
+
+static ArgKind getArgKind(int type)
+{
+  if (type > CTRLFFI_FIRST_PTR && type < CTRLFFI_LAST_PTR)
+  {
+    return ARG_PTR;
+  }
+
+  switch (type)
+  {
+    case CTRLFFI_STRING:      return ARG_STRING;
+    case CTRLFFI_STRING_ARRAY: return ARG_STRING_ARRAY;
+    case CTRLFFI_POINTER:     return ARG_POINTER;
+    case CTRLFFI_STRING_OUT:  // fall through
+    case CTRLFFI_POINTER_OUT: return ARG_OUT;
+    default:                  return ARG_VALUE;
+  }
+}
+
+static ffi_type *getArgFFIType(int type)
+{
+  return (getArgKind(type) == ARG_VALUE) ? getHostFFIType(type) : &ffi_type_pointer;
+}
+
+static double percentile(const std::vector<double> &sorted, int percent)
+{
+  return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * percent / 100];
+}
+
+//------------------------------------------------------------------------------
+
+/// Loads the function of a declaration. Sets skipReason on failure.
+static void loadFunction(Function &function, const std::map<std::string, std::string> &libraryMap)
+{
+  if (function.library.empty())
+  {
+    function.skipReason = "declared by address";
+    return;
+  }
+
+  std::map<std::string, std::string>::const_iterator mapped = libraryMap.find(function.library);
+  const std::string &path = (mapped != libraryMap.end()) ? mapped->second : function.library;
+
+  // libraries stay loaded until the process exits
+  void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  void *symbol = library ? dlsym(library, function.name.c_str()) : 0;
+  if (! symbol)
+  {
+    function.skipReason = "not found in " + path;
+    return;
+  }
+
+  ffi_type *returnType = getArgFFIType(function.returnType);
+  for (size_t i = 0; i < function.argTypes.size(); ++i)
+  {
+    function.ffiArgTypes.push_back(getArgFFIType(function.argTypes[i]));
+    if (! function.ffiArgTypes.back())
+    {
+      returnType = 0;
+    }
+  }
+
+  if (! returnType || ffi_prep_cif(&function.cif, FFI_DEFAULT_ABI, (unsigned int) function.argTypes.size(),
+                                   returnType, function.ffiArgTypes.empty() ? 0 : &function.ffiArgTypes[0]) != FFI_OK)
+  {
+    function.skipReason = "unsupported signature";
+    return;
+  }
+
+  function.funcPtr = reinterpret_cast<void (*)(void)>(symbol);
+}
+
+//------------------------------------------------------------------------------
+
+/// Reads the log. Returns false if it is not valid.
+static bool readLog(const std::vector<char> &data, std::map<unsigned int, Function> &functions,
+                    std::vector<Call> &calls, const std::map<std::string, std::string> &libraryMap)
+{
+  const char *pos = data.empty() ? 0 : &data[0];
+  const char *end = pos + data.size();
+
+  FFIRecordHeader header;
+  if (! readRecordValue(pos, end, header) || memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0)
+  {
+    fprintf(stderr, "ffireplay: not a CtrlFFI recording\n");
+    return false;
+  }
+
+  if (header.version != RECORD_VERSION || header.pointerSize != sizeof(void *) ||
+      header.bigEndian != (FFIKernels::isBigEndianHost() ? 1u : 0u))
+  {
+    fprintf(stderr, "ffireplay: the recording was made with another version or platform\n");
+    return false;
+  }
+
+  while (pos < end)
+  {
+    char kind = *pos++;
+    unsigned int funcId;
+    if (! readRecordValue(pos, end, funcId))
+    {
+      break;
+    }
+
+    if (kind == RECORD_FUNCTION)
+    {
+      Function &function = functions[funcId];
+      unsigned int argCount = 0;
+
+      if (! readRecordString(pos, end, function.library) || ! readRecordString(pos, end, function.name) ||
+          ! readRecordValue(pos, end, function.returnType) || ! readRecordValue(pos, end, argCount))
+      {
+        break;
+      }
+
+      function.argTypes.clear();
+      for (unsigned int i = 0; i < argCount; ++i)
+      {
+        int type, direction;
+        if (! readRecordValue(pos, end, type) || ! readRecordValue(pos, end, direction))
+        {
+          break;
+        }
+        function.argTypes.push_back(type);
+      }
+
+      function.funcPtr = 0;
+      function.skipped = 0;
+      loadFunction(function, libraryMap);
+    }
+    else if (kind == RECORD_CALL)
+    {
+      std::map<unsigned int, Function>::iterator it = functions.find(funcId);
+      long long start, duration;
+      if (it == functions.end() || ! readRecordValue(pos, end, start) || ! readRecordValue(pos, end, duration))
+      {
+        break;
+      }
+
+      Call call;
+      call.function = &(it->second);
+      call.duration = (double) duration;
+
+      bool complete = true;
+      for (size_t i = 0; i < call.function->argTypes.size(); ++i)
+      {
+        unsigned int size;
+        if (! readRecordValue(pos, end, size) || (size != RECORD_NULL && (size_t) (end - pos) < size))
+        {
+          complete = false;
+          break;
+        }
+
+        Argument arg;
+        arg.kind = getArgKind(call.function->argTypes[i]);
+        arg.isNull = (size == RECORD_NULL);
+        arg.offset = call.input.size() + 8;
+
+        // holder, value and a terminator for strings
+        size_t valueSize = arg.isNull ? 0 : size;
+        arg.size = valueSize;
+        call.input.resize(arg.offset + alignUp(std::max(valueSize + 1, (size_t) 8)), 0);
+        if (valueSize)
+        {
+          memcpy(&call.input[arg.offset], pos, valueSize);
+          pos += valueSize;
+        }
+
+        call.args.push_back(arg);
+      }
+
+      if (! complete)
+      {
+        break;
+      }
+
+      calls.push_back(call);
+    }
+    else
+    {
+      fprintf(stderr, "ffireplay: unknown record kind %d\n", kind);
+      return false;
+    }
+  }
+
+  if (pos < end)
+  {
+    // e.g. the manager was stopped while recording
+    fprintf(stderr, "ffireplay: the recording is truncated, replaying %u calls\n", (unsigned int) calls.size());
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  int repeat = 1;
+  size_t scratchSize = 65536;
+  std::map<std::string, std::string> libraryMap;
+  const char *logPath = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--repeat" && i + 1 < argc)
+    {
+      repeat = atoi(argv[++i]);
+    }
+    else if (arg == "--scratch" && i + 1 < argc)
+    {
+      scratchSize = (size_t) atol(argv[++i]);
+    }
+    else if (arg == "--map" && i + 1 < argc)
+    {
+      std::string mapping = argv[++i];
+      size_t separator = mapping.find('=');
+      if (separator == std::string::npos)
+      {
+        logPath = 0;
+        break;
+      }
+      libraryMap[mapping.substr(0, separator)] = mapping.substr(separator + 1);
+    }
+    else
+    {
+      logPath = argv[i];
+    }
+  }
+
+  if (! logPath || repeat < 1)
+  {
+    fprintf(stderr, "usage: ffireplay [--repeat N] [--map LIBRARY=REPLACEMENT] [--scratch BYTES] LOG\n");
+    return 2;
+  }
+
+  FILE *file = fopen(logPath, "rb");
+  if (! file)
+  {
+    fprintf(stderr, "ffireplay: cannot open %s\n", logPath);
+    return 1;
+  }
+
+  std::vector<char> data;
+  char block[65536];
+  size_t count;
+  while ((count = fread(block, 1, sizeof(block), file)) > 0)
+  {
+    data.insert(data.end(), block, block + count);
+  }
+  fclose(file);
+
+  std::map<unsigned int, Function> functions;
+  std::vector<Call> calls;
+  if (! readLog(data, functions, calls, libraryMap))
+  {
+    return 1;
+  }
+
+  std::vector<char> scratch(scratchSize, 0);
+  std::vector<char> work;
+  std::vector<void *> argValues;
+  // the pointer tables of string arrays, one per argument
+  std::vector<std::vector<const char *> > tables;
+  union { ffi_arg integer; double real; void *pointer; char text[16]; } returnValue;
+
+  double replayStart = now();
+
+  for (int round = 0; round < repeat; ++round)
+  {
+    for (std::vector<Call>::iterator call = calls.begin(); call != calls.end(); ++call)
+    {
+      Function &function = *(call->function);
+      if (! function.funcPtr)
+      {
+        ++function.skipped;
+        continue;
+      }
+
+      if (round == 0)
+      {
+        function.recorded.push_back(call->duration);
+      }
+
+      // restore the inputs, since the previous call may have changed them
+      work = call->input;
+      argValues.resize(call->args.size());
+      tables.resize(std::max(tables.size(), call->args.size()));
+
+      for (size_t i = 0; i < call->args.size(); ++i)
+      {
+        const Argument &arg = call->args[i];
+        char *value = work.empty() ? 0 : &work[arg.offset];
+        void **holder = reinterpret_cast<void **>(value - 8);
+
+        switch (arg.kind)
+        {
+          case ARG_VALUE:   argValues[i] = value; continue;
+          case ARG_POINTER: *holder = (arg.isNull || scratch.empty()) ? 0 : &scratch[0]; break;
+          case ARG_PTR:     // fall through
+          case ARG_STRING:  *holder = arg.isNull ? 0 : value; break;
+          case ARG_OUT:     *holder = value; break;
+          case ARG_STRING_ARRAY:
+            if (arg.isNull)
+            {
+              *holder = 0;
+              break;
+            }
+
+            // the texts were recorded one after the other
+            tables[i].clear();
+            for (size_t pos = 0; pos < arg.size; pos += strlen(value + pos) + 1)
+            {
+              tables[i].push_back(value + pos);
+            }
+            tables[i].push_back(0);
+            *holder = &tables[i][0];
+            break;
+        }
+
+        argValues[i] = holder;
+      }
+
+      double start = now();
+      ffi_call(&function.cif, function.funcPtr, &returnValue, argValues.empty() ? 0 : &argValues[0]);
+      function.replayed.push_back(now() - start);
+    }
+  }
+
+  double replayDuration = now() - replayStart;
+
+  printf("%-32s %8s %12s %10s %10s %10s %10s %12s\n",
+         "function", "calls", "calls/s", "p50 ns", "p90 ns", "p99 ns", "max ns", "recorded p50");
+
+  for (std::map<unsigned int, Function>::iterator it = functions.begin(); it != functions.end(); ++it)
+  {
+    Function &function = it->second;
+    if (! function.skipReason.empty())
+    {
+      printf("%-32s skipped %u calls: %s\n", function.name.c_str(),
+             (unsigned int) (function.skipped / repeat), function.skipReason.c_str());
+      continue;
+    }
+
+    if (function.replayed.empty())
+    {
+      continue;
+    }
+
+    std::sort(function.replayed.begin(), function.replayed.end());
+    std::sort(function.recorded.begin(), function.recorded.end());
+
+    double total = 0;
+    for (size_t i = 0; i < function.replayed.size(); ++i)
+    {
+      total += function.replayed[i];
+    }
+
+    printf("%-32s %8u %12.0f %10.0f %10.0f %10.0f %10.0f %12.0f\n", function.name.c_str(),
+           (unsigned int) function.replayed.size(), function.replayed.size() / total * 1e9,
+           percentile(function.replayed, 50), percentile(function.replayed, 90),
+           percentile(function.replayed, 99), function.replayed.back(),
+           percentile(function.recorded, 50));
+  }
+
+  printf("replayed %u calls in %.3f s\n", (unsigned int) (calls.size() * repeat), replayDuration / 1e9);
+
+  return 0;
+}
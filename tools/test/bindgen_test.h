@@ -0,0 +1,57 @@
+/* Test header for ffibindgen.py, covering padding, nested structs, arrays,
+ * typedefs and the different kinds of parameters. */
+
+#ifndef BINDGEN_TEST_H
+#define BINDGEN_TEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct device device_t;
+
+typedef enum { STATE_IDLE, STATE_RUNNING } state_t;
+
+typedef void (*event_callback)(void *context, int event);
+
+/* needs padding after id and at the end */
+typedef struct sample
+{
+  uint16_t id;
+  double value;
+  state_t state;
+} sample_t;
+
+struct range
+{
+  float min, max;
+};
+
+typedef struct
+{
+  char name[8];
+  struct range limits;
+  sample_t last;
+  uint8_t flags;
+  const char *unit;
+  size_t count;
+} channel_t;
+
+device_t *device_open(const char *address, int port);
+void device_close(device_t *device);
+int device_read(device_t *device, sample_t *samples, size_t maxSamples);
+int device_get_state(device_t *device, state_t *state);
+int device_get_serial(device_t *device, char **serial);
+double device_scale(double value, float factor);
+const char *device_last_error(void);
+int device_subscribe(device_t *device, event_callback callback, void *context);
+int device_log(const char *format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif